@@ -3,6 +3,7 @@
 #include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <pow.h>
 #include <primitives/block.h>
@@ -10,6 +11,8 @@
 #include <util/system.h>
 
 #include <algorithm>
+#include <cassert>
+#include <cstring>
 
 typedef std::vector<unsigned char> valtype;
 
@@ -23,66 +26,120 @@ uint32_t DecodeLE32(const unsigned char* bytes) {
 	return res;
 }
 
+namespace {
+	/** The checks of CAuxPow::check before the merkle branches are walked. */
+	bool checkBranchSizes(const CAuxBlockHeader& auxHeader, const int nChainId, const Consensus::Params& params) {
+		if (params.fStrictChainId && auxHeader.parentBlock.GetChainId() == nChainId)
+			return error("Aux POW parent has our chain ID");
+
+		if (auxHeader.vChainMerkleBranch.size() > 30)
+			return error("Aux POW chain merkle branch too long");
+
+		return true;
+	}
+
+	/** The checks of CAuxPow::check on the roots of the chain merkle branch
+	 and of the parent block merkle branch.  */
+	bool checkRoots(const CAuxBlockHeader& auxHeader, const int nChainId, const uint256& nRootHash,
+			const uint256& nParentRootHash) {
+		valtype vchRootHash(nRootHash.begin(), nRootHash.end());
+		std::reverse(vchRootHash.begin(), vchRootHash.end()); // correct endian
+
+		// Check that we are in the parent block merkle tree
+		if (nParentRootHash != auxHeader.parentBlock.hashMerkleRoot)
+			return error("Aux POW merkle root incorrect");
+
+		// Check that there is at least one input
+		if (auxHeader.coinbaseTx->vin.empty())
+			return error("Aux POW coinbase has no inputs");
+
+		const CScript script = auxHeader.coinbaseTx->vin[0].scriptSig;
+
+		// Check that the same work is not submitted twice to our chain
+		const unsigned char* const mmHeaderBegin = pchMergedMiningHeader;
+		const unsigned char* const mmHeaderEnd = mmHeaderBegin + sizeof(pchMergedMiningHeader);
+		CScript::const_iterator pcHead = std::search(script.begin(), script.end(), mmHeaderBegin, mmHeaderEnd);
+		CScript::const_iterator pc = std::search(script.begin(), script.end(), vchRootHash.begin(), vchRootHash.end());
+
+
+		// Check that the chain merkle root is in the coinbase
+		if (pc == script.end())
+			return error("Aux POW missing chain merkle root in parent coinbase");
+
+		if (pcHead != script.end()) {
+			// Enforce only one chain merkle root by checking that a single instance of the merged
+			// mining header exists just before.
+			if (script.end() != std::search(pcHead + 1, script.end(), mmHeaderBegin, mmHeaderEnd))
+				return error("Multiple merged mining headers in coinbase");
+			if (pcHead + sizeof(pchMergedMiningHeader) != pc)
+				return error("Merged mining header is not just before chain merkle root");
+		} else
+	        return error("Merged mining header is missing");
+
+		// Ensure we are at a deterministic point in the merkle leaves by hashing
+		// a nonce and our chain ID and comparing to the index.
+		pc += vchRootHash.size();
+		if (script.end() - pc < 8)
+			return error("Aux POW missing chain merkle tree size and nonce in parent coinbase");
+
+		const uint32_t nSize = DecodeLE32(&pc[0]);
+		const unsigned merkleHeight = auxHeader.vChainMerkleBranch.size();
+		if (nSize != (1u << merkleHeight))
+			return error("Aux POW merkle branch size does not match parent coinbase");
+
+		const uint32_t nNonce = DecodeLE32(&pc[4]);
+		if (auxHeader.nChainIndex != CAuxPow::getExpectedIndex(nNonce, nChainId, merkleHeight))
+			return error("Aux POW wrong index");
+
+		return true;
+	}
+}  // anonymous namespace
+
 bool CAuxPow::check(const CAuxBlockHeader& auxHeader, const uint256& hashAuxBlock,
 		const int nChainId, const Consensus::Params& params) {
-	if (params.fStrictChainId && auxHeader.parentBlock.GetChainId() == nChainId)
-		return error("Aux POW parent has our chain ID");
-
-	if (auxHeader.vChainMerkleBranch.size() > 30)
-		return error("Aux POW chain merkle branch too long");
+	if (!checkBranchSizes(auxHeader, nChainId, params))
+		return false;
 
 	const uint256 nRootHash = CAuxPow::checkMerkleBranch(hashAuxBlock, auxHeader.vChainMerkleBranch,
 			auxHeader.nChainIndex);
-	valtype vchRootHash(nRootHash.begin(), nRootHash.end());
-	std::reverse(vchRootHash.begin(), vchRootHash.end()); // correct endian
-
-	// Check that we are in the parent block merkle tree
-	if (CAuxPow::checkMerkleBranch(auxHeader.coinbaseTx->GetHash(), auxHeader.vMerkleBranch, 0) != auxHeader.parentBlock.hashMerkleRoot)
-		return error("Aux POW merkle root incorrect");
-
-	// Check that there is at least one input
-	if (auxHeader.coinbaseTx->vin.empty())
-		return error("Aux POW coinbase has no inputs");
-
-	const CScript script = auxHeader.coinbaseTx->vin[0].scriptSig;
-
-	// Check that the same work is not submitted twice to our chain
-	const unsigned char* const mmHeaderBegin = pchMergedMiningHeader;
-	const unsigned char* const mmHeaderEnd = mmHeaderBegin + sizeof(pchMergedMiningHeader);
-	CScript::const_iterator pcHead = std::search(script.begin(), script.end(), mmHeaderBegin, mmHeaderEnd);
-	CScript::const_iterator pc = std::search(script.begin(), script.end(), vchRootHash.begin(), vchRootHash.end());
-
-
-	// Check that the chain merkle root is in the coinbase
-	if (pc == script.end())
-		return error("Aux POW missing chain merkle root in parent coinbase");
-
-	if (pcHead != script.end()) {
-		// Enforce only one chain merkle root by checking that a single instance of the merged
-		// mining header exists just before.
-		if (script.end() != std::search(pcHead + 1, script.end(), mmHeaderBegin, mmHeaderEnd))
-			return error("Multiple merged mining headers in coinbase");
-		if (pcHead + sizeof(pchMergedMiningHeader) != pc)
-			return error("Merged mining header is not just before chain merkle root");
-	} else
-        return error("Merged mining header is missing");
-
-	// Ensure we are at a deterministic point in the merkle leaves by hashing
-	// a nonce and our chain ID and comparing to the index.
-	pc += vchRootHash.size();
-	if (script.end() - pc < 8)
-		return error("Aux POW missing chain merkle tree size and nonce in parent coinbase");
-
-	const uint32_t nSize = DecodeLE32(&pc[0]);
-	const unsigned merkleHeight = auxHeader.vChainMerkleBranch.size();
-	if (nSize != (1u << merkleHeight))
-		return error("Aux POW merkle branch size does not match parent coinbase");
-
-	const uint32_t nNonce = DecodeLE32(&pc[4]);
-	if (auxHeader.nChainIndex != CAuxPow::getExpectedIndex(nNonce, nChainId, merkleHeight))
-		return error("Aux POW wrong index");
-
-	return true;
+	const uint256 nParentRootHash = CAuxPow::checkMerkleBranch(auxHeader.coinbaseTx->GetHash(),
+			auxHeader.vMerkleBranch, 0);
+
+	return checkRoots(auxHeader, nChainId, nRootHash, nParentRootHash);
+}
+
+std::vector<bool> CAuxPow::checkBatch(const std::vector<const CBlockHeader*>& headers,
+		const Consensus::Params& params) {
+	static const std::vector<uint256> emptyBranch;
+
+	/* Branches 2i and 2i+1 are the chain merkle branch and the parent block
+	 merkle branch of header i.  */
+	std::vector<bool> res(headers.size(), false);
+	std::vector<uint256> hashes(2 * headers.size());
+	std::vector<const std::vector<uint256>*> branches(2 * headers.size(), &emptyBranch);
+	std::vector<int> indices(2 * headers.size(), -1);
+	for (size_t i = 0; i < headers.size(); ++i) {
+		const CAuxBlockHeader& auxHeader = *headers[i]->auxHeader;
+		if (!checkBranchSizes(auxHeader, headers[i]->GetChainId(), params))
+			continue;
+
+		res[i] = true;
+		hashes[2 * i] = headers[i]->GetHash();
+		branches[2 * i] = &auxHeader.vChainMerkleBranch;
+		indices[2 * i] = auxHeader.nChainIndex;
+		hashes[2 * i + 1] = auxHeader.coinbaseTx->GetHash();
+		branches[2 * i + 1] = &auxHeader.vMerkleBranch;
+		indices[2 * i + 1] = 0;
+	}
+
+	CAuxPow::checkMerkleBranches(hashes, branches, indices);
+
+	for (size_t i = 0; i < headers.size(); ++i) {
+		if (res[i])
+			res[i] = checkRoots(*headers[i]->auxHeader, headers[i]->GetChainId(), hashes[2 * i], hashes[2 * i + 1]);
+	}
+
+	return res;
 }
 
 uint256 CAuxPow::checkMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex) {
@@ -99,6 +156,49 @@ uint256 CAuxPow::checkMerkleBranch(uint256 hash, const std::vector<uint256>& vMe
 	return hash;
 }
 
+void CAuxPow::checkMerkleBranches(std::vector<uint256>& hashes,
+		const std::vector<const std::vector<uint256>*>& branches, const std::vector<int>& indices) {
+	assert(hashes.size() == branches.size() && hashes.size() == indices.size());
+
+	std::vector<int> nIndex(indices);
+	std::vector<size_t> lanes;
+	for (size_t i = 0; i < hashes.size(); ++i) {
+		if (nIndex[i] == -1)
+			hashes[i].SetNull();
+		else
+			lanes.push_back(i);
+	}
+
+	/* Each level is hashed as one SHA256D64 call over the concatenated
+	 64-byte inputs of all branches that are not done yet.  */
+	std::vector<unsigned char> buffer;
+	for (size_t level = 0; ; ++level) {
+		lanes.erase(std::remove_if(lanes.begin(), lanes.end(),
+				[&](size_t i) { return branches[i]->size() <= level; }), lanes.end());
+		if (lanes.empty())
+			break;
+
+		buffer.resize(64 * lanes.size());
+		for (size_t k = 0; k < lanes.size(); ++k) {
+			const size_t i = lanes[k];
+			const uint256& sibling = (*branches[i])[level];
+			unsigned char* const input = buffer.data() + 64 * k;
+			if (nIndex[i] & 1) {
+				memcpy(input, sibling.begin(), 32);
+				memcpy(input + 32, hashes[i].begin(), 32);
+			} else {
+				memcpy(input, hashes[i].begin(), 32);
+				memcpy(input + 32, sibling.begin(), 32);
+			}
+			nIndex[i] >>= 1;
+		}
+
+		SHA256D64(buffer.data(), buffer.data(), lanes.size());
+		for (size_t k = 0; k < lanes.size(); ++k)
+			memcpy(hashes[lanes[k]].begin(), buffer.data() + 32 * k, 32);
+	}
+}
+
 int CAuxPow::getExpectedIndex(uint32_t nNonce, int nChainId, unsigned h) {
 	// Choose a pseudo-random slot in the chain merkle tree
 	// but have it be fixed for a size/nonce/chain combination.
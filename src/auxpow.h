@@ -11,6 +11,7 @@
 #include <uint256.h>
 
 #include <memory>
+#include <vector>
 
 class CAuxBlockHeader;
 class CBlockHeader;
@@ -34,6 +35,18 @@ public:
 	static void initBlockHeader(CBlockHeader& header);
 
 	static uint256 checkMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
+
+	/** Same as checkMerkleBranch for each of the given hashes, but walks all
+	 * branches level by level and hashes each level with one SHA256D64 call,
+	 * which handles several branches at once on SIMD capable CPUs. */
+	static void checkMerkleBranches(std::vector<uint256>& hashes,
+			const std::vector<const std::vector<uint256>*>& branches, const std::vector<int>& indices);
+
+	/** Same as check(*header->auxHeader, header->GetHash(), header->GetChainId(), params)
+	 * for each of the headers, with the merkle branches of all of them walked
+	 * together by checkMerkleBranches. */
+	static std::vector<bool> checkBatch(const std::vector<const CBlockHeader*>& headers,
+			const Consensus::Params& params);
 };
 
 
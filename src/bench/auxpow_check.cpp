@@ -0,0 +1,110 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <auxpow.h>
+#include <chainparams.h>
+#include <crypto/sha256.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <script/script.h>
+#include <versionbits.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+/** Number of proofs checked per benchmark iteration */
+static const size_t AUXPOW_PROOFS = 2000;
+
+/** Appends a 32-bit little endian integer. */
+static void AppendLE32(std::vector<unsigned char>& data, uint32_t n)
+{
+    for (int i = 0; i < 4; i++) {
+        data.push_back(n & 0xFF);
+        n >>= 8;
+    }
+}
+
+/**
+ * Valid auxpow headers as a syncing node sees them: the parent blocks have a
+ * few thousand transactions and merge-mine eight chains.
+ */
+static std::vector<CBlockHeader> CreateAuxpowHeaders(const Consensus::Params& params)
+{
+    FastRandomContext rng(true);
+    const unsigned nChainHeight = 3;
+    const unsigned nParentHeight = 12;
+
+    std::vector<CBlockHeader> headers(AUXPOW_PROOFS);
+    for (size_t i = 0; i < headers.size(); i++) {
+        CBlockHeader& header = headers[i];
+        header.SetBaseVersion(VERSIONBITS_BASE_BLOCK_VERSION, params.nAuxpowChainId);
+        header.SetBlockHeaderVersion(true);
+        header.hashPrevBlock = rng.rand256();
+
+        std::shared_ptr<CAuxBlockHeader> auxHeader = std::make_shared<CAuxBlockHeader>();
+        for (unsigned h = 0; h < nChainHeight; h++) {
+            auxHeader->vChainMerkleBranch.push_back(rng.rand256());
+        }
+        const uint32_t nNonce = i;
+        auxHeader->nChainIndex = CAuxPow::getExpectedIndex(nNonce, params.nAuxpowChainId, nChainHeight);
+        const uint256 hashRoot = CAuxPow::checkMerkleBranch(header.GetHash(), auxHeader->vChainMerkleBranch, auxHeader->nChainIndex);
+
+        std::vector<unsigned char> data(pchMergedMiningHeader, pchMergedMiningHeader + sizeof(pchMergedMiningHeader));
+        data.insert(data.end(), hashRoot.begin(), hashRoot.end());
+        std::reverse(data.end() - 32, data.end());
+        AppendLE32(data, 1u << nChainHeight);
+        AppendLE32(data, nNonce);
+
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << data;
+        auxHeader->coinbaseTx = MakeTransactionRef(std::move(coinbase));
+
+        for (unsigned h = 0; h < nParentHeight; h++) {
+            auxHeader->vMerkleBranch.push_back(rng.rand256());
+        }
+        auxHeader->parentBlock.hashMerkleRoot = CAuxPow::checkMerkleBranch(auxHeader->coinbaseTx->GetHash(), auxHeader->vMerkleBranch, 0);
+
+        header.auxHeader = auxHeader;
+        assert(CAuxPow::check(*auxHeader, header.GetHash(), header.GetChainId(), params));
+    }
+
+    return headers;
+}
+
+static void AuxpowCheck(benchmark::State& state, bool fBatch)
+{
+    SHA256AutoDetect();
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const std::vector<CBlockHeader> headers = CreateAuxpowHeaders(params);
+    std::vector<const CBlockHeader*> pheaders;
+    for (const CBlockHeader& header : headers) {
+        pheaders.push_back(&header);
+    }
+
+    while (state.KeepRunning()) {
+        if (fBatch) {
+            const std::vector<bool> valid = CAuxPow::checkBatch(pheaders, params);
+            assert(std::all_of(valid.begin(), valid.end(), [](bool f) { return f; }));
+        } else {
+            for (const CBlockHeader& header : headers) {
+                bool fValid = CAuxPow::check(*header.auxHeader, header.GetHash(), header.GetChainId(), params);
+                assert(fValid);
+            }
+        }
+    }
+}
+
+/** One iteration checks AUXPOW_PROOFS proofs, one after the other. */
+static void AuxpowCheckSerial(benchmark::State& state) { AuxpowCheck(state, false); }
+/** One iteration checks AUXPOW_PROOFS proofs, with their merkle branches hashed in SIMD lanes. */
+static void AuxpowCheckBatch(benchmark::State& state) { AuxpowCheck(state, true); }
+
+BENCHMARK(AuxpowCheckSerial, 20);
+BENCHMARK(AuxpowCheckBatch, 20);
@@ -0,0 +1,80 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <primitives/block.h>
+#include <primitives/blockview.h>
+#include <streams.h>
+#include <version.h>
+
+// Compare decoding a block into a CBlock, which allocates every transaction,
+// script and witness item separately, with decoding it into a CBlockView,
+// which makes one allocation for all of its records.
+
+static const size_t LARGE_BLOCK_SIZE = 32 * 1000 * 1000;
+
+/** Block 413567 with its transactions repeated until it reaches LARGE_BLOCK_SIZE. */
+static std::vector<unsigned char> LargeBlock()
+{
+    CBlock block;
+    CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+    stream >> block;
+
+    CBlock large(block.GetBlockHeader());
+    large.vtx.push_back(block.vtx[0]);
+    size_t size = ::GetSerializeSize(block, PROTOCOL_VERSION);
+    while (size < LARGE_BLOCK_SIZE) {
+        large.vtx.insert(large.vtx.end(), block.vtx.begin() + 1, block.vtx.end());
+        size += ::GetSerializeSize(block, PROTOCOL_VERSION);
+    }
+
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0) << large;
+    return data;
+}
+
+static void DeserializeBlock(benchmark::State& state, const std::vector<unsigned char>& data)
+{
+    while (state.KeepRunning()) {
+        CBlock block;
+        VectorReader(SER_NETWORK, PROTOCOL_VERSION, data, 0) >> block;
+        assert(!block.vtx.empty());
+    }
+}
+
+static void DecodeBlockView(benchmark::State& state, const std::vector<unsigned char>& data)
+{
+    while (state.KeepRunning()) {
+        CBlockView block;
+        bool decoded = block.Decode(data);
+        assert(decoded);
+    }
+}
+
+static void BlockViewDeserialize(benchmark::State& state)
+{
+    DeserializeBlock(state, benchmark::data::block413567);
+}
+
+static void BlockViewDecode(benchmark::State& state)
+{
+    DecodeBlockView(state, benchmark::data::block413567);
+}
+
+static void BlockViewDeserialize32MB(benchmark::State& state)
+{
+    DeserializeBlock(state, LargeBlock());
+}
+
+static void BlockViewDecode32MB(benchmark::State& state)
+{
+    DecodeBlockView(state, LargeBlock());
+}
+
+BENCHMARK(BlockViewDeserialize, 130);
+BENCHMARK(BlockViewDecode, 130);
+BENCHMARK(BlockViewDeserialize32MB, 4);
+BENCHMARK(BlockViewDecode32MB, 4);
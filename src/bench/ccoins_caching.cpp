@@ -4,10 +4,15 @@
 
 #include <bench/bench.h>
 #include <coins.h>
+#include <fs.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
+#include <txdb.h>
 
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 // Microbenchmark for simple accesses to a CCoinsViewCache database. Note from
@@ -50,3 +55,159 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Number of coins spent by the block in the cold cache benchmarks.
+static const size_t COLD_CACHE_COINS = 20000;
+
+/**
+ * A coins database on disk holding COLD_CACHE_COINS coins, with a LevelDB
+ * cache small enough that most reads have to go to the table files.
+ */
+class ColdCoinsDB
+{
+public:
+    const fs::path m_path;
+    std::unique_ptr<CCoinsViewDB> m_db;
+    std::vector<COutPoint> m_outpoints;
+
+    ColdCoinsDB() : m_path(fs::temp_directory_path() / ("bench_ccoins_" + GetRandHash().ToString()))
+    {
+        m_db.reset(new CCoinsViewDB(m_path, 1 << 20, false, true));
+        CCoinsViewCache cache(m_db.get());
+        for (size_t i = 0; i < COLD_CACHE_COINS; ++i) {
+            COutPoint outpoint(GetRandHash(), i % 4);
+            CTxOut txout(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG);
+            cache.AddCoin(outpoint, Coin(txout, 1, false), false);
+            m_outpoints.push_back(outpoint);
+        }
+        cache.SetBestBlock(GetRandHash());
+        bool flushed = cache.Flush();
+        assert(flushed);
+    }
+
+    ~ColdCoinsDB()
+    {
+        m_db.reset();
+        fs::remove_all(m_path);
+    }
+};
+
+// Access the inputs of a block through an empty cache, as ConnectBlock does
+// when -dbcache is small.
+static void CCoinsCachingColdSerial(benchmark::State& state)
+{
+    ColdCoinsDB db;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(db.m_db.get());
+        for (const COutPoint& outpoint : db.m_outpoints) {
+            bool found = !cache.AccessCoin(outpoint).IsSpent();
+            assert(found);
+        }
+    }
+}
+
+// The same, with the misses read by CCoinsViewDB::GetCoins first.
+static void CCoinsCachingColdPrefetch(benchmark::State& state)
+{
+    ColdCoinsDB db;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(db.m_db.get());
+        cache.PrefetchCoins(db.m_outpoints);
+        for (const COutPoint& outpoint : db.m_outpoints) {
+            bool found = !cache.AccessCoin(outpoint).IsSpent();
+            assert(found);
+        }
+    }
+}
+
+BENCHMARK(CCoinsCachingColdSerial, 20);
+BENCHMARK(CCoinsCachingColdPrefetch, 20);
+
+// Number of coins in the coins map benchmarks.
+static const size_t COINS_MAP_COINS = 100000;
+
+static std::vector<std::pair<COutPoint, Coin>> CoinsMapCoins()
+{
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    for (size_t i = 0; i < COINS_MAP_COINS; ++i) {
+        CTxOut txout(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG);
+        coins.emplace_back(COutPoint(GetRandHash(), i % 4), Coin(txout, i, false));
+    }
+    return coins;
+}
+
+// Fill the coins map of CCoinsViewCache and look every coin up, to compare
+// with the node-based map it replaced below. The memory per coin of both maps
+// is compared by the ccoins_map_memory unit test.
+static void CCoinsMapFill(benchmark::State& state)
+{
+    const std::vector<std::pair<COutPoint, Coin>> coins = CoinsMapCoins();
+    while (state.KeepRunning()) {
+        CCoinsMap map;
+        for (const auto& coin : coins) {
+            Coin copy = coin.second;
+            map.emplace(coin.first, std::move(copy));
+        }
+        for (const auto& coin : coins) {
+            bool found = !map.find(coin.first)->second.IsSpent();
+            assert(found);
+        }
+    }
+}
+
+static void CCoinsUnorderedMapFill(benchmark::State& state)
+{
+    struct NodeEntry {
+        Coin coin;
+        unsigned char flags;
+    };
+    const std::vector<std::pair<COutPoint, Coin>> coins = CoinsMapCoins();
+    while (state.KeepRunning()) {
+        std::unordered_map<COutPoint, NodeEntry, SaltedOutpointHasher> map;
+        for (const auto& coin : coins) {
+            map.emplace(coin.first, NodeEntry{coin.second, 0});
+        }
+        for (const auto& coin : coins) {
+            bool found = !map.find(coin.first)->second.coin.IsSpent();
+            assert(found);
+        }
+    }
+}
+
+BENCHMARK(CCoinsMapFill, 10);
+BENCHMARK(CCoinsUnorderedMapFill, 10);
+
+// Write COINS_MAP_COINS modified coins to a coins database on disk, as a
+// flush of a large coins cache does, with the coins in a single LevelDB
+// instance or split into shards written in parallel.
+static void CoinsDBBatchWrite(benchmark::State& state, unsigned int shards)
+{
+    const fs::path path = fs::temp_directory_path() / ("bench_ccoins_" + GetRandHash().ToString());
+    const std::vector<std::pair<COutPoint, Coin>> coins = CoinsMapCoins();
+    {
+        CCoinsViewDB db(path, 8 << 20, false, true, shards);
+        while (state.KeepRunning()) {
+            CCoinsMap map;
+            for (const auto& coin : coins) {
+                Coin copy = coin.second;
+                map.emplace(coin.first, std::move(copy)).first->second.flags = CCoinsCacheEntry::DIRTY;
+            }
+            bool written = db.BatchWrite(map, GetRandHash());
+            assert(written);
+        }
+    }
+    fs::remove_all(path);
+}
+
+static void CCoinsDBBatchWrite(benchmark::State& state)
+{
+    CoinsDBBatchWrite(state, 0);
+}
+
+static void CCoinsDBBatchWriteSharded(benchmark::State& state)
+{
+    CoinsDBBatchWrite(state, 8);
+}
+
+BENCHMARK(CCoinsDBBatchWrite, 5);
+BENCHMARK(CCoinsDBBatchWriteSharded, 5);
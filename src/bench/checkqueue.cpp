@@ -20,7 +20,7 @@ static const unsigned int QUEUE_BATCH_SIZE = 128;
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+static void RunPrevectorJob(benchmark::State& state, int nThreads)
 {
     struct PrevectorJob {
         prevector<PREVECTOR_SIZE, uint8_t> p;
@@ -37,7 +37,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     };
     CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    for (auto x = 0; x < nThreads; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
@@ -58,4 +58,24 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    RunPrevectorJob(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+// The same workload with far more workers than -par used to allow, to
+// show how the work-stealing deques hold up under oversubscription.
+static void CCheckQueueSpeedPrevectorJob32(benchmark::State& state)
+{
+    RunPrevectorJob(state, 32);
+}
+
+static void CCheckQueueSpeedPrevectorJob64(benchmark::State& state)
+{
+    RunPrevectorJob(state, 64);
+}
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob32, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob64, 1400);
@@ -0,0 +1,74 @@
+// Copyright (c) 2020 Electric Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <consensus/ddms.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <validation.h>
+
+#include <cassert>
+#include <vector>
+
+/** A block whose coinbase pays many miners directly, as pools do, plus the witness commitment. */
+static CBlock CreateManyOutputCoinbaseBlock(size_t nOutputs)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(nOutputs);
+    for (size_t i = 0; i < nOutputs; i++) {
+        const unsigned char* raw = ddmsAllowedScriptsRaw[i % DDMS_ALLOWED_SCRIPTS_NUMBER];
+        coinbase.vout[i].scriptPubKey = CScript(raw, raw + DDMS_SCRIPT_LENGTH);
+        coinbase.vout[i].nValue = 1000;
+    }
+
+    CTxOut commitment;
+    commitment.scriptPubKey.resize(38);
+    commitment.scriptPubKey[0] = OP_RETURN;
+    commitment.scriptPubKey[1] = 0x24;
+    commitment.scriptPubKey[2] = 0xaa;
+    commitment.scriptPubKey[3] = 0x21;
+    commitment.scriptPubKey[4] = 0xa9;
+    commitment.scriptPubKey[5] = 0xed;
+    coinbase.vout.push_back(commitment);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    return block;
+}
+
+static void DdmsCoinbaseCheck(benchmark::State& state)
+{
+    const CBlock block = CreateManyOutputCoinbaseBlock(500);
+    while (state.KeepRunning()) {
+        bool fValid = DdmsVerifyCoinbase(block);
+        assert(fValid);
+    }
+}
+
+/** The same check, comparing every output with every allowed script as done before. */
+static void DdmsCoinbaseCheckLinear(benchmark::State& state)
+{
+    const CBlock block = CreateManyOutputCoinbaseBlock(500);
+    const CTransactionRef& cb = block.vtx[0];
+    std::vector<CScript> allowed;
+    for (size_t k = 0; k < DDMS_ALLOWED_SCRIPTS_NUMBER; ++k) {
+        allowed.emplace_back(ddmsAllowedScriptsRaw[k], ddmsAllowedScriptsRaw[k] + DDMS_SCRIPT_LENGTH);
+    }
+    while (state.KeepRunning()) {
+        for (uint32_t i = 0; i < cb->vout.size(); ++i) {
+            if (i == (uint32_t)GetWitnessCommitmentIndex(block)) continue;
+            bool fFound = false;
+            for (size_t k = 0; k < DDMS_ALLOWED_SCRIPTS_NUMBER && !fFound; ++k) {
+                fFound = cb->vout[i].scriptPubKey == allowed[k];
+            }
+            assert(fFound);
+        }
+    }
+}
+
+BENCHMARK(DdmsCoinbaseCheck, 2000);
+BENCHMARK(DdmsCoinbaseCheckLinear, 5);
@@ -7,6 +7,10 @@
 #include <uint256.h>
 #include <random.h>
 #include <consensus/merkle.h>
+#include <validation.h>
+#include <workerpool.h>
+
+#include <boost/thread.hpp>
 
 static void MerkleRoot(benchmark::State& state)
 {
@@ -23,4 +27,36 @@ static void MerkleRoot(benchmark::State& state)
     }
 }
 
+/** Merkle root of nLeaves leaves, with the tree levels hashed on nThreads worker pool threads (0 for the calling thread). */
+static void MerkleRootLarge(benchmark::State& state, size_t nLeaves, int nThreads)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves(nLeaves);
+    for (auto& item : leaves) {
+        item = rng.rand256();
+    }
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads; ++i) {
+        threads.create_thread([] { g_worker_pool.Thread(); });
+    }
+    g_parallel_script_checks = nThreads > 0;
+    while (state.KeepRunning()) {
+        bool mutation = false;
+        const std::vector<std::vector<uint256>> levels = ComputeMerkleLevelsParallel(std::vector<uint256>(leaves), &mutation);
+        leaves[mutation] = levels.back()[0];
+    }
+    g_parallel_script_checks = false;
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+static void MerkleRoot10k(benchmark::State& state) { MerkleRootLarge(state, 10000, 0); }
+static void MerkleRoot100k(benchmark::State& state) { MerkleRootLarge(state, 100000, 0); }
+static void MerkleRoot10kParallel(benchmark::State& state) { MerkleRootLarge(state, 10000, 4); }
+static void MerkleRoot100kParallel(benchmark::State& state) { MerkleRootLarge(state, 100000, 4); }
+
 BENCHMARK(MerkleRoot, 800);
+BENCHMARK(MerkleRoot10k, 500);
+BENCHMARK(MerkleRoot100k, 50);
+BENCHMARK(MerkleRoot10kParallel, 500);
+BENCHMARK(MerkleRoot100kParallel, 50);
@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <random.h>
+
+#include <cassert>
+#include <vector>
+
+/** A synthetic header chain whose nBits follow LWMA, as a syncing node sees it. */
+struct LwmaChain
+{
+    std::vector<uint256> hashes;
+    std::vector<CBlockIndex> blocks;
+
+    LwmaChain(size_t nBlocks, const Consensus::Params& params) : hashes(nBlocks), blocks(nBlocks)
+    {
+        FastRandomContext rng(true);
+        for (size_t i = 0; i < nBlocks; i++) {
+            hashes[i] = ArithToUint256(arith_uint256(i + 1));
+            blocks[i].phashBlock = &hashes[i];
+            blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+            blocks[i].nHeight = i;
+            // Solvetimes around the target spacing, with some out-of-order timestamps
+            int64_t nDelta = rng.randrange(params.nPowTargetSpacing * 2);
+            if (rng.randrange(50) == 0) nDelta -= params.nPowTargetSpacing;
+            blocks[i].nTime = i ? blocks[i - 1].nTime + nDelta : 1600000000;
+            blocks[i].nBits = i ? LwmaCalculateNextWorkRequired(&blocks[i - 1], params) : UintToArith256(params.powLimit).GetCompact();
+            blocks[i].BuildSkip();
+        }
+    }
+};
+
+static void LwmaValidateHeaders(benchmark::State& state, size_t nHeaders, bool fIncremental)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    LwmaChain chain(nHeaders, params);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 1; i < nHeaders; i++) {
+            const CBlockIndex* pindexPrev = &chain.blocks[i - 1];
+            const unsigned int nBits = fIncremental ? LwmaCalculateNextWorkRequired(pindexPrev, params) : LwmaCalculateNextWorkRequiredFull(pindexPrev, params);
+            assert(nBits == chain.blocks[i].nBits);
+        }
+    }
+}
+
+static void LwmaHeaderSyncIncremental(benchmark::State& state) { LwmaValidateHeaders(state, 1000 * 1000, true); }
+static void LwmaHeaderSyncFull(benchmark::State& state) { LwmaValidateHeaders(state, 20 * 1000, false); }
+
+BENCHMARK(LwmaHeaderSyncIncremental, 1);
+BENCHMARK(LwmaHeaderSyncFull, 1);
@@ -133,6 +133,8 @@ public:
     // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
     ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
     bool IsTxAvailable(size_t index) const;
+    //! The coinbase, which is always prefilled, or nullptr before InitData.
+    CTransactionRef GetCoinbase() const { return txn_available.empty() ? nullptr : txn_available[0]; }
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
 };
 
@@ -5,6 +5,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <txdb.h>
 #include <validation.h>
 
 /**
@@ -54,20 +55,29 @@ CBlockHeader CBlockIndex::GetBlockHeader() const {
     CBlock block;
     block.nVersion       = nVersion;
 
-    /* The CBlockIndex object's block header is missing the auxpow.
-     * So if this is an auxpow block, read it from disk instead. We only
-     * have to read the actual *header*, not the full block. */
-    if (block.IsAuxPow()) {
-    	ReadBlockFromDisk(block, this, Params().GetConsensus());
-    	return block.GetBlockHeader();
-    }
-
     if (pprev)
         block.hashPrevBlock = pprev->GetBlockHash();
     block.hashMerkleRoot = hashMerkleRoot;
     block.nTime          = nTime;
     block.nBits          = nBits;
     block.nNonce         = nNonce;
+
+    /* The CBlockIndex object's block header is missing the auxpow.
+     * Look it up in the auxpow header store of the block tree DB, and
+     * only fall back to the block file for entries that were never
+     * stored there (the block file is not available for pruned or
+     * headers-only blocks anyway). */
+    if (block.IsAuxPow()) {
+        std::shared_ptr<CAuxBlockHeader> auxHeader = std::make_shared<CAuxBlockHeader>();
+        if (pblocktree && pblocktree->ReadAuxBlockHeader(GetBlockHash(), *auxHeader)) {
+            block.auxHeader = auxHeader;
+        } else {
+            CBlockHeader headerOnDisk;
+            if (ReadBlockHeaderFromDisk(headerOnDisk, this, Params().GetConsensus()))
+                block.auxHeader = headerOnDisk.auxHeader;
+        }
+    }
+
     return block.GetBlockHeader();
 }
 
@@ -8,6 +8,11 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +21,22 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Maximum number of threads that get their own deque in a CCheckQueue; further threads only steal */
+static const int MAX_CHECKQUEUE_WORKERS = 128;
+
+/** Utilisation counters of one CCheckQueue thread. */
+struct CCheckQueueWorkerStats
+{
+    //! Number of checks this thread executed
+    uint64_t nChecks{0};
+    //! Number of batches this thread executed
+    uint64_t nBatches{0};
+    //! Number of checks this thread took from the deques of other threads
+    uint64_t nStolen{0};
+    //! Time spent executing checks, in microseconds
+    uint64_t nBusyMicros{0};
+};
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +46,34 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread owns a deque. The master spreads added verifications over
+  * all deques; a thread works off the back of its own deque and, once that
+  * is empty, steals from the front of the others. The shared mutex is only
+  * taken to sleep and wake up, so workers do not contend on it while there
+  * is work left.
+  *
+  * A thread holds its deque from the start to the end of Thread(), so
+  * that threads that are stopped and started again reuse the deques of
+  * the earlier ones.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    /** Per-thread state: the deque of pending checks and utilisation counters. */
+    struct Worker
+    {
+        //! Protects deque; held only to push or take checks, never while running them
+        std::mutex mutex;
+        std::deque<T> deque;
+        std::atomic<uint64_t> nChecks{0};
+        std::atomic<uint64_t> nBatches{0};
+        std::atomic<uint64_t> nStolen{0};
+        std::atomic<uint64_t> nBusyMicros{0};
+    };
+
+    //! Mutex to sleep on when out of work
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,86 +82,160 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The deques of all threads; slot 0 belongs to the master. Allocated as threads register.
+    std::unique_ptr<Worker> workers[MAX_CHECKQUEUE_WORKERS];
+
+    //! The number of slots allocated (including the master's). Never shrinks.
+    std::atomic<int> nSlots;
+
+    //! Protects the allocation of slots and vFreeSlots
+    std::mutex mutexSlots;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Allocated slots whose thread has stopped
+    std::vector<int> vFreeSlots;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Slot the next batch of added checks starts at.
+    int nNextSlot;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! Number of verifications that are in a deque. Only changed while holding the mutex of that deque.
+    std::atomic<unsigned int> nQueued;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    int NumSlots() const
+    {
+        return nSlots.load();
+    }
+
+    /** Hand a slot to a starting thread, or MAX_CHECKQUEUE_WORKERS if there is none left. */
+    int RegisterSlot()
+    {
+        std::lock_guard<std::mutex> lock(mutexSlots);
+        if (!vFreeSlots.empty()) {
+            const int nSlot = vFreeSlots.back();
+            vFreeSlots.pop_back();
+            return nSlot;
+        }
+        const int nSlot = nSlots.load();
+        if (nSlot == MAX_CHECKQUEUE_WORKERS) return nSlot;
+        workers[nSlot].reset(new Worker);
+        nSlots = nSlot + 1;
+        return nSlot;
+    }
+
+    /** Take the slot back from a stopping thread. Checks left in its deque go to the master's. */
+    void UnregisterSlot(int nSlot)
+    {
+        if (nSlot == MAX_CHECKQUEUE_WORKERS) return;
+        {
+            std::lock_guard<std::mutex> lock(workers[nSlot]->mutex);
+            std::lock_guard<std::mutex> lockMaster(workers[0]->mutex);
+            for (T& check : workers[nSlot]->deque) {
+                workers[0]->deque.push_back(T());
+                check.swap(workers[0]->deque.back());
+            }
+            workers[nSlot]->deque.clear();
+        }
+        std::lock_guard<std::mutex> lock(mutexSlots);
+        vFreeSlots.push_back(nSlot);
+    }
+
+    /** Move up to half of the checks of a deque (at most nBatchSize) into vChecks. */
+    unsigned int Take(Worker& worker, std::vector<T>& vChecks, bool fOwn)
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        std::deque<T>& deque = worker.deque;
+        unsigned int nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, (deque.size() + 1) / 2));
+        nNow = std::min<size_t>(nNow, deque.size());
+        vChecks.resize(nNow);
+        nQueued -= nNow;
+        for (unsigned int i = 0; i < nNow; i++) {
+            // The owner works off the back, thieves take from the front.
+            if (fOwn) {
+                vChecks[i].swap(deque.back());
+                deque.pop_back();
+            } else {
+                vChecks[i].swap(deque.front());
+                deque.pop_front();
+            }
+        }
+        return nNow;
+    }
+
+    /** Fill vChecks from the thread's own deque, or steal from another one. */
+    unsigned int Next(int nSlot, std::vector<T>& vChecks)
+    {
+        unsigned int nNow = 0;
+        if (nSlot < MAX_CHECKQUEUE_WORKERS) {
+            nNow = Take(*workers[nSlot], vChecks, true);
+        }
+        const int nSlotsNow = NumSlots();
+        for (int i = 1; nNow == 0 && i <= nSlotsNow; i++) {
+            const int nVictim = (nSlot + i) % nSlotsNow;
+            if (nVictim == nSlot) continue;
+            nNow = Take(*workers[nVictim], vChecks, false);
+            if (nNow && nSlot < MAX_CHECKQUEUE_WORKERS) {
+                workers[nSlot]->nStolen += nNow;
+            }
+        }
+        return nNow;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(int nSlot, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+            const unsigned int nNow = Next(nSlot, vChecks);
+            if (nNow) {
+                // Check whether we need to do work at all
+                bool fOk = fAllOk;
+                const auto start = std::chrono::steady_clock::now();
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                // Destroy the checks before they are counted as done, so that
+                // the master does not return while they still hold resources.
+                vChecks.clear();
+                if (nSlot < MAX_CHECKQUEUE_WORKERS) {
+                    Worker& self = *workers[nSlot];
+                    self.nChecks += nNow;
+                    self.nBatches++;
+                    self.nBusyMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                if (!fOk) fAllOk = false;
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster && nTodo == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                // return the current status
+                return fRet;
+            }
+            // A deque still has checks that another thread raced us to.
+            // Add counts checks before it notifies under the mutex, so
+            // nothing added after this test can be missed by the wait.
+            if (nQueued != 0) continue;
+            (fMaster ? condMaster : condWorker).wait(lock); // wait
         } while (true);
     }
 
@@ -127,35 +244,70 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nSlots(1), nNextSlot(0), fAllOk(true), nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn)
+    {
+        workers[0].reset(new Worker);
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        // Give the slot back however the thread stops, including by interruption.
+        struct SlotGuard {
+            CCheckQueue& queue;
+            const int nSlot;
+            ~SlotGuard() { queue.UnregisterSlot(nSlot); }
+        } guard{*this, RegisterSlot()};
+        Loop(guard.nSlot);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty()) return;
         nTodo += vChecks.size();
+        // Spread the checks over the deques in contiguous chunks, starting
+        // where the previous call left off so small batches rotate as well.
+        const int nSlotsNow = NumSlots();
+        const size_t nChunk = (vChecks.size() + nSlotsNow - 1) / nSlotsNow;
+        for (size_t i = 0; i < vChecks.size(); i += nChunk) {
+            Worker& worker = *workers[nNextSlot];
+            nNextSlot = (nNextSlot + 1) % nSlotsNow;
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            const size_t nEnd = std::min(i + nChunk, vChecks.size());
+            for (size_t j = i; j < nEnd; j++) {
+                worker.deque.push_back(T());
+                vChecks[j].swap(worker.deque.back());
+            }
+            nQueued += nEnd - i;
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
+    //! Utilisation counters of every thread that has a deque; the master comes first.
+    std::vector<CCheckQueueWorkerStats> GetWorkerStats() const
+    {
+        std::vector<CCheckQueueWorkerStats> stats(NumSlots());
+        for (size_t i = 0; i < stats.size(); i++) {
+            const Worker& worker = *workers[i];
+            stats[i].nChecks = worker.nChecks;
+            stats[i].nBatches = worker.nBatches;
+            stats[i].nStolen = worker.nStolen;
+            stats[i].nBusyMicros = worker.nBusyMicros;
+        }
+        return stats;
+    }
+
     ~CCheckQueue()
     {
     }
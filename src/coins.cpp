@@ -9,10 +9,14 @@
 #include <random.h>
 #include <version.h>
 
+#include <tuple>
+#include <unordered_set>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWritePartial(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
@@ -21,6 +25,14 @@ bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
     return GetCoin(outpoint, coin);
 }
 
+void CCoinsView::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const
+{
+    coins.assign(outpoints.size(), Coin());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (!GetCoin(outpoints[i], coins[i])) coins[i].Clear();
+    }
+}
+
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
 bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
@@ -28,15 +40,296 @@ uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWritePartial(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWritePartial(mapCoins, hashBlock); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
+Coin CCoinsCacheEntry::GetCoin() const
+{
+    Coin coin;
+    coin.out.nValue = GetValue();
+    coin.nHeight = m_code >> 1;
+    coin.fCoinBase = m_code & 1;
+    CScript& script = coin.out.scriptPubKey;
+    switch (m_script_type) {
+    case SCRIPT_NONE:
+        break;
+    case SCRIPT_P2PKH:
+        script << OP_DUP << OP_HASH160;
+        script.insert(script.end(), 20);
+        script.insert(script.end(), m_script, m_script + 20);
+        script << OP_EQUALVERIFY << OP_CHECKSIG;
+        break;
+    case SCRIPT_P2SH:
+        script << OP_HASH160;
+        script.insert(script.end(), 20);
+        script.insert(script.end(), m_script, m_script + 20);
+        script << OP_EQUAL;
+        break;
+    case SCRIPT_P2WPKH:
+        script << OP_0;
+        script.insert(script.end(), 20);
+        script.insert(script.end(), m_script, m_script + 20);
+        break;
+    case SCRIPT_POOLED:
+        script = *GetPooledScript();
+        break;
+    }
+    return coin;
+}
+
+CCoinsMap::iterator CCoinsMap::find(const COutPoint& outpoint)
+{
+    if (m_size == 0) return end();
+    const size_t hash = m_hasher(outpoint);
+    const unsigned char tag = Tag(hash);
+    const size_t mask = m_capacity - 1;
+    // There is always an empty slot, as the load is kept below 1.
+    for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+        const unsigned char ctrl = m_ctrl[pos];
+        if (ctrl == CTRL_EMPTY) return end();
+        if (ctrl == tag && Slot(m_index[pos]).first == outpoint) return iterator(this, m_index[pos]);
+    }
+}
+
+std::pair<CCoinsMap::iterator, bool> CCoinsMap::emplace(const COutPoint& outpoint)
+{
+    if (!Fits(m_size + m_deleted + 1, m_capacity)) {
+        // Grow when the live entries take more than half of the maximum
+        // load, otherwise only clear the tombstones.
+        Rehash(Fits(2 * (m_size + 1), m_capacity) ? m_capacity : std::max(MIN_CAPACITY, 2 * m_capacity));
+    }
+    const size_t hash = m_hasher(outpoint);
+    const unsigned char tag = Tag(hash);
+    const size_t mask = m_capacity - 1;
+    size_t pos = hash & mask;
+    size_t deleted = m_capacity;
+    for (;; pos = (pos + 1) & mask) {
+        const unsigned char ctrl = m_ctrl[pos];
+        if (ctrl == CTRL_EMPTY) break;
+        if (ctrl == CTRL_DELETED) {
+            if (deleted == m_capacity) deleted = pos;
+        } else if (ctrl == tag && Slot(m_index[pos]).first == outpoint) {
+            return {iterator(this, m_index[pos]), false};
+        }
+    }
+    if (deleted != m_capacity) {
+        pos = deleted;
+        --m_deleted;
+    }
+
+    uint32_t slot;
+    if (!m_free_slots.empty()) {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    } else {
+        if (m_slots_used == m_slots_allocated) {
+            const size_t chunk_size = ChunkSize(m_chunks.size());
+            m_chunks.emplace_back(new value_type[chunk_size]);
+            m_slots_allocated += chunk_size;
+        }
+        slot = m_slots_used++;
+    }
+    value_type& entry = Slot(slot);
+    entry.first = outpoint;
+    entry.second = CCoinsCacheEntry();
+    entry.second.m_used = true;
+    m_ctrl[pos] = tag;
+    m_index[pos] = slot;
+    ++m_size;
+    return {iterator(this, slot), true};
+}
+
+std::pair<CCoinsMap::iterator, bool> CCoinsMap::emplace(const COutPoint& outpoint, Coin&& coin)
+{
+    std::pair<iterator, bool> ret = emplace(outpoint);
+    if (ret.second) SetCoin(ret.first->second, std::move(coin));
+    return ret;
+}
+
+CCoinsMap::iterator CCoinsMap::erase(iterator it)
+{
+    const uint32_t slot = it.m_pos;
+    value_type& entry = Slot(slot);
+    const size_t mask = m_capacity - 1;
+    size_t pos = m_hasher(entry.first) & mask;
+    while (!(m_ctrl[pos] & CTRL_FULL) || m_index[pos] != slot) pos = (pos + 1) & mask;
+    // Linear probing never continues past an empty slot, so a slot followed
+    // by one can be emptied rather than marked deleted.
+    if (m_ctrl[(pos + 1) & mask] == CTRL_EMPTY) {
+        m_ctrl[pos] = CTRL_EMPTY;
+    } else {
+        m_ctrl[pos] = CTRL_DELETED;
+        ++m_deleted;
+    }
+
+    ReleaseScript(entry.second);
+    entry.second = CCoinsCacheEntry();
+    m_free_slots.push_back(slot);
+    --m_size;
+    return iterator(this, slot + 1);
+}
+
+void CCoinsMap::clear()
+{
+    m_size = 0;
+    m_ctrl.reset();
+    m_index.reset();
+    m_capacity = 0;
+    m_deleted = 0;
+    std::vector<std::unique_ptr<value_type[]>>().swap(m_chunks);
+    m_slots_used = 0;
+    m_slots_allocated = 0;
+    std::vector<uint32_t>().swap(m_free_slots);
+    std::vector<std::unique_ptr<CScript[]>>().swap(m_pool_chunks);
+    std::vector<CScript*>().swap(m_pool_free);
+}
+
+void CCoinsMap::shrink_to_fit()
+{
+    // An entry only moves down, to a slot that is free or was left by an
+    // entry moved before it.
+    uint32_t used = 0;
+    for (uint32_t slot = NextUsed(0); slot < m_slots_used; slot = NextUsed(slot + 1)) {
+        if (slot != used) {
+            Slot(used) = Slot(slot);
+            Slot(slot).second = CCoinsCacheEntry();
+        }
+        ++used;
+    }
+    m_slots_used = used;
+    std::vector<uint32_t>().swap(m_free_slots);
+    // Move the pooled scripts to as few chunks as they need.
+    std::vector<std::unique_ptr<CScript[]>> pool_chunks;
+    std::vector<CScript*> pool_free;
+    for (uint32_t slot = 0; slot < m_slots_used; ++slot) {
+        CCoinsCacheEntry& entry = Slot(slot).second;
+        if (entry.m_script_type != CCoinsCacheEntry::SCRIPT_POOLED) continue;
+        if (pool_free.empty()) {
+            pool_chunks.emplace_back(new CScript[POOL_CHUNK_SIZE]);
+            for (size_t i = 0; i < POOL_CHUNK_SIZE; ++i) {
+                pool_free.push_back(&pool_chunks.back()[i]);
+            }
+        }
+        CScript* node = pool_free.back();
+        pool_free.pop_back();
+        *node = std::move(*entry.GetPooledScript());
+        memcpy(entry.m_script, &node, sizeof(node));
+    }
+    m_pool_chunks.swap(pool_chunks);
+    m_pool_free.swap(pool_free);
+    size_t chunks = 0;
+    m_slots_allocated = 0;
+    while (m_slots_allocated < m_slots_used) m_slots_allocated += ChunkSize(chunks++);
+    m_chunks.resize(chunks);
+    m_chunks.shrink_to_fit();
+    size_t capacity = MIN_CAPACITY;
+    while (!Fits(m_size, capacity)) capacity *= 2;
+    if (m_size == 0) {
+        m_ctrl.reset();
+        m_index.reset();
+        m_capacity = 0;
+        m_deleted = 0;
+    } else {
+        Rehash(capacity);
+    }
+}
+
+void CCoinsMap::reserve(size_t n)
+{
+    size_t capacity = std::max(MIN_CAPACITY, m_capacity);
+    while (!Fits(n, capacity)) capacity *= 2;
+    if (capacity > m_capacity) Rehash(capacity);
+}
+
+void CCoinsMap::Rehash(size_t capacity)
+{
+    m_ctrl.reset(new unsigned char[capacity]());
+    m_index.reset(new uint32_t[capacity]);
+    m_capacity = capacity;
+    m_deleted = 0;
+    const size_t mask = capacity - 1;
+    for (uint32_t slot = NextUsed(0); slot < m_slots_used; slot = NextUsed(slot + 1)) {
+        const size_t hash = m_hasher(Slot(slot).first);
+        size_t pos = hash & mask;
+        while (m_ctrl[pos] != CTRL_EMPTY) pos = (pos + 1) & mask;
+        m_ctrl[pos] = Tag(hash);
+        m_index[pos] = slot;
+    }
+}
+
+void CCoinsMap::SetCoin(CCoinsCacheEntry& entry, Coin&& coin)
+{
+    ReleaseScript(entry);
+    entry.SetValue(coin.out.nValue);
+    entry.m_code = coin.nHeight * uint32_t{2} + coin.fCoinBase;
+    if (coin.IsSpent()) return;
+
+    const CScript& script = coin.out.scriptPubKey;
+    if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        entry.m_script_type = CCoinsCacheEntry::SCRIPT_P2PKH;
+        memcpy(entry.m_script, script.data() + 3, 20);
+    } else if (script.IsPayToScriptHash()) {
+        entry.m_script_type = CCoinsCacheEntry::SCRIPT_P2SH;
+        memcpy(entry.m_script, script.data() + 2, 20);
+    } else if (script.size() == 22 && script[0] == OP_0 && script[1] == 20) {
+        entry.m_script_type = CCoinsCacheEntry::SCRIPT_P2WPKH;
+        memcpy(entry.m_script, script.data() + 2, 20);
+    } else {
+        if (m_pool_free.empty()) {
+            m_pool_chunks.emplace_back(new CScript[POOL_CHUNK_SIZE]);
+            for (size_t i = 0; i < POOL_CHUNK_SIZE; ++i) {
+                m_pool_free.push_back(&m_pool_chunks.back()[i]);
+            }
+        }
+        CScript* node = m_pool_free.back();
+        m_pool_free.pop_back();
+        *node = std::move(coin.out.scriptPubKey);
+        entry.m_script_type = CCoinsCacheEntry::SCRIPT_POOLED;
+        memcpy(entry.m_script, &node, sizeof(node));
+    }
+}
+
+void CCoinsMap::ClearCoin(CCoinsCacheEntry& entry)
+{
+    ReleaseScript(entry);
+    entry.SetValue(-1);
+    entry.m_code = 0;
+}
+
+void CCoinsMap::ReleaseScript(CCoinsCacheEntry& entry)
+{
+    if (entry.m_script_type == CCoinsCacheEntry::SCRIPT_POOLED) {
+        CScript* node = entry.GetPooledScript();
+        // Free the heap memory of long scripts now rather than on reuse.
+        *node = CScript();
+        m_pool_free.push_back(node);
+    }
+    entry.m_script_type = CCoinsCacheEntry::SCRIPT_NONE;
+}
+
+size_t CCoinsMap::DynamicMemoryUsage() const
+{
+    size_t usage = 0;
+    if (m_capacity > 0) {
+        usage += memusage::MallocUsage(m_capacity) + memusage::MallocUsage(m_capacity * sizeof(uint32_t));
+    }
+    for (size_t i = 0; i < m_chunks.size(); ++i) {
+        usage += memusage::MallocUsage(ChunkSize(i) * sizeof(value_type));
+    }
+    usage += memusage::DynamicUsage(m_chunks) + memusage::DynamicUsage(m_free_slots);
+    usage += m_pool_chunks.size() * memusage::MallocUsage(POOL_CHUNK_SIZE * sizeof(CScript));
+    usage += memusage::DynamicUsage(m_pool_chunks) + memusage::DynamicUsage(m_pool_free);
+    return usage;
+}
+
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    return cacheCoins.DynamicMemoryUsage() + cachedCoinsUsage + memusage::DynamicUsage(m_dirty_queue);
 }
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
@@ -46,44 +339,72 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
-    CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
-    if (ret->second.coin.IsSpent()) {
+    CCoinsMap::iterator ret = cacheCoins.emplace(outpoint, std::move(tmp)).first;
+    if (ret->second.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
-    cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
+    cachedCoinsUsage += ret->second.DynamicMemoryUsage();
     return ret;
 }
 
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
-        coin = it->second.coin;
+        coin = it->second.GetCoin();
         return !coin.IsSpent();
     }
     return false;
 }
 
+void CCoinsViewCache::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    PrefetchCoins(outpoints);
+    coins.assign(outpoints.size(), Coin());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        CCoinsMap::const_iterator it = cacheCoins.find(outpoints[i]);
+        if (it != cacheCoins.end()) coins[i] = it->second.GetCoin();
+    }
+}
+
+size_t CCoinsViewCache::PrefetchCoins(const std::vector<COutPoint>& outpoints) const {
+    std::vector<COutPoint> missing;
+    for (const COutPoint& outpoint : outpoints) {
+        if (!cacheCoins.count(outpoint)) missing.push_back(outpoint);
+    }
+    if (missing.empty()) return 0;
+    std::vector<Coin> coins;
+    base->GetCoins(missing, coins);
+    for (size_t i = 0; i < missing.size(); ++i) {
+        if (coins[i].IsSpent()) continue;
+        CCoinsMap::iterator it;
+        bool inserted;
+        std::tie(it, inserted) = cacheCoins.emplace(missing[i], std::move(coins[i]));
+        if (inserted) cachedCoinsUsage += it->second.DynamicMemoryUsage();
+    }
+    return missing.size();
+}
+
 void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possible_overwrite) {
     assert(!coin.IsSpent());
     if (coin.out.scriptPubKey.IsUnspendable()) return;
     CCoinsMap::iterator it;
     bool inserted;
-    std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
+    std::tie(it, inserted) = cacheCoins.emplace(outpoint);
     bool fresh = false;
     if (!inserted) {
-        cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        cachedCoinsUsage -= it->second.DynamicMemoryUsage();
     }
     if (!possible_overwrite) {
-        if (!it->second.coin.IsSpent()) {
+        if (!it->second.IsSpent()) {
             throw std::logic_error("Adding new coin that replaces non-pruned entry");
         }
         fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
     }
-    it->second.coin = std::move(coin);
-    it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
-    cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    cacheCoins.SetCoin(it->second, std::move(coin));
+    MarkDirty(it);
+    if (fresh) it->second.flags |= CCoinsCacheEntry::FRESH;
+    cachedCoinsUsage += it->second.DynamicMemoryUsage();
 }
 
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check) {
@@ -100,38 +421,37 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool
 bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     CCoinsMap::iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) return false;
-    cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+    cachedCoinsUsage -= it->second.DynamicMemoryUsage();
     if (moveout) {
-        *moveout = std::move(it->second.coin);
+        *moveout = it->second.GetCoin();
     }
     if (it->second.flags & CCoinsCacheEntry::FRESH) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) --cachedDirtyCoins;
         cacheCoins.erase(it);
     } else {
-        it->second.flags |= CCoinsCacheEntry::DIRTY;
-        it->second.coin.Clear();
+        MarkDirty(it);
+        cacheCoins.ClearCoin(it->second);
     }
     return true;
 }
 
-static const Coin coinEmpty;
-
-const Coin& CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
+Coin CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) {
-        return coinEmpty;
+        return Coin();
     } else {
-        return it->second.coin;
+        return it->second.GetCoin();
     }
 }
 
 bool CCoinsViewCache::HaveCoin(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
-    return (it != cacheCoins.end() && !it->second.coin.IsSpent());
+    return (it != cacheCoins.end() && !it->second.IsSpent());
 }
 
 bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = cacheCoins.find(outpoint);
-    return (it != cacheCoins.end() && !it->second.coin.IsSpent());
+    return (it != cacheCoins.end() && !it->second.IsSpent());
 }
 
 uint256 CCoinsViewCache::GetBestBlock() const {
@@ -154,13 +474,13 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
         if (itUs == cacheCoins.end()) {
             // The parent cache does not have an entry, while the child does
             // We can ignore it if it's both FRESH and pruned in the child
-            if (!(it->second.flags & CCoinsCacheEntry::FRESH && it->second.coin.IsSpent())) {
+            if (!(it->second.flags & CCoinsCacheEntry::FRESH && it->second.IsSpent())) {
                 // Otherwise we will need to create it in the parent
                 // and move the data up and mark it as dirty
-                CCoinsCacheEntry& entry = cacheCoins[it->first];
-                entry.coin = std::move(it->second.coin);
-                cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
-                entry.flags = CCoinsCacheEntry::DIRTY;
+                CCoinsMap::iterator itNew = cacheCoins.emplace(it->first, it->second.GetCoin()).first;
+                CCoinsCacheEntry& entry = itNew->second;
+                cachedCoinsUsage += entry.DynamicMemoryUsage();
+                MarkDirty(itNew);
                 // We can mark it FRESH in the parent if it was FRESH in the child
                 // Otherwise it might have just been flushed from the parent's cache
                 // and already exist in the grandparent
@@ -173,23 +493,24 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             // parent cache entry has unspent outputs. If this ever happens,
             // it means the FRESH flag was misapplied and there is a logic
             // error in the calling code.
-            if ((it->second.flags & CCoinsCacheEntry::FRESH) && !itUs->second.coin.IsSpent()) {
+            if ((it->second.flags & CCoinsCacheEntry::FRESH) && !itUs->second.IsSpent()) {
                 throw std::logic_error("FRESH flag misapplied to cache entry for base transaction with spendable outputs");
             }
 
             // Found the entry in the parent cache
-            if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent()) {
+            if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.IsSpent()) {
                 // The grandparent does not have an entry, and the child is
                 // modified and being pruned. This means we can just delete
                 // it from the parent.
-                cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
+                cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
+                if (itUs->second.flags & CCoinsCacheEntry::DIRTY) --cachedDirtyCoins;
                 cacheCoins.erase(itUs);
             } else {
                 // A normal modification.
-                cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.coin = std::move(it->second.coin);
-                cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
+                cacheCoins.SetCoin(itUs->second, it->second.GetCoin());
+                cachedCoinsUsage += itUs->second.DynamicMemoryUsage();
+                MarkDirty(itUs);
                 // NOTE: It is possible the child has a FRESH flag here in
                 // the event the entry we found in the parent is pruned. But
                 // we must not copy that FRESH flag to the parent as that
@@ -206,14 +527,152 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    cachedDirtyCoins = 0;
+    m_partial_write = false;
+    m_dirty_queue.clear();
     return fOk;
 }
 
+void CCoinsViewCache::MarkDirty(CCoinsMap::iterator it) {
+    if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+        ++cachedDirtyCoins;
+        m_dirty_queue.push_back(cacheCoins.position(it));
+        CompactDirtyQueue();
+    }
+    it->second.flags |= CCoinsCacheEntry::DIRTY;
+}
+
+bool CCoinsViewCache::IsDirtyAt(uint32_t pos) const {
+    CCoinsMap::iterator it = cacheCoins.begin_at(pos);
+    return it != cacheCoins.end() && cacheCoins.position(it) == pos && (it->second.flags & CCoinsCacheEntry::DIRTY);
+}
+
+void CCoinsViewCache::CompactDirtyQueue() {
+    // Erased entries leave their position behind, and a reused slot can be
+    // queued twice, so keep the queue within a constant factor of the DIRTY
+    // entries. This is amortized over the pushes since the last compaction.
+    if (m_dirty_queue.size() <= 2 * cachedDirtyCoins + 1024) return;
+    std::unordered_set<uint32_t> seen;
+    std::deque<uint32_t> queue;
+    for (uint32_t pos : m_dirty_queue) {
+        if (IsDirtyAt(pos) && seen.insert(pos).second) queue.push_back(pos);
+    }
+    m_dirty_queue.swap(queue);
+}
+
+bool CCoinsViewCache::WriteDirty(size_t max_entries) {
+    if (cachedDirtyCoins > 0 && max_entries > 0) {
+        // Take the entries in the order they were first modified in. Each
+        // call only looks at the queued positions it consumes.
+        CCoinsMap batch;
+        std::vector<uint32_t> written;
+        while (!m_dirty_queue.empty() && written.size() < max_entries) {
+            const uint32_t pos = m_dirty_queue.front();
+            m_dirty_queue.pop_front();
+            if (!IsDirtyAt(pos)) continue;
+            CCoinsMap::iterator it = cacheCoins.begin_at(pos);
+            CCoinsMap::iterator copy;
+            bool inserted;
+            std::tie(copy, inserted) = batch.emplace(it->first, it->second.GetCoin());
+            if (!inserted) continue;
+            copy->second.flags = it->second.flags;
+            written.push_back(pos);
+        }
+        if (!base->BatchWritePartial(batch, GetBestBlock())) return false;
+        m_partial_write = true;
+
+        // The base has the entries now: spent ones can be dropped, and the
+        // others are unmodified (and not fresh anymore).
+        for (uint32_t pos : written) {
+            CCoinsMap::iterator it = cacheCoins.begin_at(pos);
+            if (it->second.IsSpent()) {
+                cachedCoinsUsage -= it->second.DynamicMemoryUsage();
+                cacheCoins.erase(it);
+            } else {
+                it->second.flags = 0;
+            }
+        }
+        cachedDirtyCoins -= written.size();
+    }
+    // Complete the transition, or move the base to the best block if no
+    // coin changed since it was last written.
+    if (cachedDirtyCoins == 0 && (m_partial_write || base->GetBestBlock() != GetBestBlock())) {
+        CCoinsMap empty;
+        if (!base->BatchWrite(empty, GetBestBlock())) return false;
+        m_partial_write = false;
+    }
+    return true;
+}
+
+bool CCoinsViewCache::TakeDirty(size_t max_entries, CCoinsMap& batch) {
+    while (!m_dirty_queue.empty() && batch.size() < max_entries) {
+        const uint32_t pos = m_dirty_queue.front();
+        m_dirty_queue.pop_front();
+        if (!IsDirtyAt(pos)) continue;
+        CCoinsMap::iterator it = cacheCoins.begin_at(pos);
+        CCoinsMap::iterator copy = batch.emplace(it->first, it->second.GetCoin()).first;
+        copy->second.flags = it->second.flags;
+        // Spent entries must shadow the coins of the base until it has the
+        // batch, so they are only dropped by EndWrite.
+        if (it->second.IsSpent()) m_pending_spent.push_back(it->first);
+        it->second.flags = 0;
+        --cachedDirtyCoins;
+    }
+    m_write_pending = true;
+    m_partial_write = true;
+    return cachedDirtyCoins == 0;
+}
+
+void CCoinsViewCache::EndWrite(bool complete) {
+    for (const COutPoint& outpoint : m_pending_spent) {
+        CCoinsMap::iterator it = cacheCoins.find(outpoint);
+        if (it != cacheCoins.end() && it->second.flags == 0 && it->second.IsSpent()) {
+            cachedCoinsUsage -= it->second.DynamicMemoryUsage();
+            cacheCoins.erase(it);
+        }
+    }
+    std::vector<COutPoint>().swap(m_pending_spent);
+    m_write_pending = false;
+    if (complete) m_partial_write = false;
+}
+
+void CCoinsViewCache::Trim(size_t max_usage) {
+    size_t usage = DynamicMemoryUsage();
+    if (m_write_pending || usage <= max_usage) return;
+    // The entries move, so the DIRTY ones are queued again at their new
+    // position at the end.
+    m_dirty_queue.clear();
+    usage = DynamicMemoryUsage();
+    // Erasing entries does not release the storage of the map, which is
+    // compacted afterwards, so estimate the number of entries that fit, and
+    // erase more if the storage left is still too large.
+    bool erased = true;
+    while (usage > max_usage && erased) {
+        const size_t keep = (size_t)((double)cacheCoins.size() * max_usage / usage);
+        erased = false;
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && cacheCoins.size() > keep;) {
+            if (it->second.flags == 0) {
+                cachedCoinsUsage -= it->second.DynamicMemoryUsage();
+                it = cacheCoins.erase(it);
+                erased = true;
+            } else {
+                ++it;
+            }
+        }
+        cacheCoins.shrink_to_fit();
+        usage = DynamicMemoryUsage();
+    }
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) m_dirty_queue.push_back(cacheCoins.position(it));
+    }
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
+    if (m_write_pending) return;
     CCoinsMap::iterator it = cacheCoins.find(hash);
     if (it != cacheCoins.end() && it->second.flags == 0) {
-        cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        cachedCoinsUsage -= it->second.DynamicMemoryUsage();
         cacheCoins.erase(it);
     }
 }
@@ -249,29 +708,41 @@ bool CCoinsViewCache::HaveInputs(const CTransaction& tx) const
 static const size_t MIN_TRANSACTION_OUTPUT_WEIGHT = WITNESS_SCALE_FACTOR * ::GetSerializeSize(CTxOut(), PROTOCOL_VERSION);
 static const size_t MAX_OUTPUTS_PER_BLOCK = MAX_BLOCK_WEIGHT / MIN_TRANSACTION_OUTPUT_WEIGHT;
 
-const Coin& AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
+Coin AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
 {
     COutPoint iter(txid, 0);
     while (iter.n < MAX_OUTPUTS_PER_BLOCK) {
-        const Coin& alternate = view.AccessCoin(iter);
+        Coin alternate = view.AccessCoin(iter);
         if (!alternate.IsSpent()) return alternate;
         ++iter.n;
     }
-    return coinEmpty;
+    return Coin();
+}
+
+void CCoinsViewErrorCatcher::HandleReadError(const std::runtime_error& e) const {
+    for (auto f : m_err_callbacks) {
+        f();
+    }
+    LogPrintf("Error reading from database: %s\n", e.what());
+    // Starting the shutdown sequence and returning false to the caller would be
+    // interpreted as 'entry not found' (as opposed to unable to read data), and
+    // could lead to invalid interpretation. Just exit immediately, as we can't
+    // continue anyway, and all writes should be atomic.
+    std::abort();
 }
 
 bool CCoinsViewErrorCatcher::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     try {
         return CCoinsViewBacked::GetCoin(outpoint, coin);
     } catch(const std::runtime_error& e) {
-        for (auto f : m_err_callbacks) {
-            f();
-        }
-        LogPrintf("Error reading from database: %s\n", e.what());
-        // Starting the shutdown sequence and returning false to the caller would be
-        // interpreted as 'entry not found' (as opposed to unable to read data), and
-        // could lead to invalid interpretation. Just exit immediately, as we can't
-        // continue anyway, and all writes should be atomic.
-        std::abort();
+        HandleReadError(e);
+    }
+}
+
+void CCoinsViewErrorCatcher::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    try {
+        base->GetCoins(outpoints, coins);
+    } catch(const std::runtime_error& e) {
+        HandleReadError(e);
     }
 }
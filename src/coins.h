@@ -9,6 +9,7 @@
 #include <primitives/transaction.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <crypto/common.h>
 #include <crypto/siphash.h>
 #include <memusage.h>
 #include <serialize.h>
@@ -17,8 +18,13 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <deque>
 #include <functional>
+#include <memory>
+#include <string.h>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 /**
  * A UTXO entry.
@@ -109,9 +115,17 @@ public:
     }
 };
 
-struct CCoinsCacheEntry
+/**
+ * A coin held by CCoinsMap, in a compact form.
+ *
+ * The output scripts of P2PKH, P2SH and P2WPKH coins, which make up most of
+ * the UTXO set, are stored inline as their 20-byte hash. Any other script is
+ * kept in the script pool of the map that holds the entry, and the entry only
+ * points to it. Entries are therefore only ever modified through their map.
+ */
+class CCoinsCacheEntry
 {
-    Coin coin; // The actual cached data.
+public:
     unsigned char flags;
 
     enum Flags {
@@ -124,11 +138,233 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), m_script_type(SCRIPT_NONE), m_used(false), m_code(0)
+    {
+        SetValue(-1);
+    }
+
+    CAmount GetValue() const
+    {
+        CAmount value;
+        memcpy(&value, m_value, sizeof(value));
+        return value;
+    }
+
+    bool IsSpent() const { return GetValue() == -1; }
+
+    //! Decode the cached coin.
+    Coin GetCoin() const;
+
+    //! Heap memory used by the script of the coin, besides its pool node.
+    size_t DynamicMemoryUsage() const
+    {
+        return m_script_type == SCRIPT_POOLED ? memusage::DynamicUsage(*GetPooledScript()) : 0;
+    }
+
+private:
+    friend class CCoinsMap;
+
+    enum ScriptType : unsigned char {
+        SCRIPT_NONE,   // Spent coin
+        SCRIPT_P2PKH,  // m_script holds the key hash
+        SCRIPT_P2SH,   // m_script holds the script hash
+        SCRIPT_P2WPKH, // m_script holds the key hash
+        SCRIPT_POOLED, // m_script holds a pointer to a pool node
+    };
+
+    unsigned char m_script_type;
+    //! Whether the slot of the map holding the entry is in use.
+    bool m_used;
+    //! Height << 1 | coinbase, as in the serialized coin.
+    uint32_t m_code;
+    //! The value, unaligned so that the entry only needs 4-byte alignment.
+    unsigned char m_value[8];
+    unsigned char m_script[20];
+
+    void SetValue(CAmount value) { memcpy(m_value, &value, sizeof(value)); }
+
+    CScript* GetPooledScript() const
+    {
+        CScript* script;
+        memcpy(&script, m_script, sizeof(script));
+        return script;
+    }
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * Hash map from outpoints to cache entries, used by CCoinsViewCache.
+ *
+ * The entries are stored densely in chunks that are never moved, and found
+ * through an open-addressing index probed linearly. Each index slot takes five
+ * bytes: the position of its entry, and a control byte holding seven bits of
+ * the hash of the outpoint, so that a probe rarely has to look at an entry
+ * that does not match. Growing the map only rebuilds the index. Erasing an
+ * entry leaves a tombstone in the index until the next rebuild, and its slot
+ * is reused by the next insertion.
+ *
+ * Together with the compact entries, a coin takes about 80 bytes, against
+ * about 140 in a node-based std::unordered_map.
+ *
+ * The interface follows std::unordered_map where CCoinsViewCache uses it, but
+ * coins must be set and cleared through SetCoin() and ClearCoin().
+ * Iteration follows the storage order, and references to the entries stay
+ * valid until they are erased.
+ */
+class CCoinsMap
+{
+public:
+    struct value_type {
+        COutPoint first;
+        CCoinsCacheEntry second;
+    };
+
+    template <bool is_const>
+    class Iterator
+    {
+        friend class CCoinsMap;
+        template <bool>
+        friend class Iterator;
+        typedef typename std::conditional<is_const, const value_type, value_type>::type Value;
+
+        const CCoinsMap* m_map{nullptr};
+        uint32_t m_pos{0};
+
+        Iterator(const CCoinsMap* map, uint32_t pos) : m_map(map), m_pos(m_map->NextUsed(pos)) {}
+
+    public:
+        Iterator() = default;
+        //! Allow the conversion of iterator to const_iterator.
+        Iterator(const Iterator<false>& other) : m_map(other.m_map), m_pos(other.m_pos) {}
+
+        Value& operator*() const { return const_cast<CCoinsMap*>(m_map)->Slot(m_pos); }
+        Value* operator->() const { return &**this; }
+        Iterator& operator++()
+        {
+            m_pos = m_map->NextUsed(m_pos + 1);
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        friend bool operator==(const Iterator& a, const Iterator& b) { return a.m_pos == b.m_pos; }
+        friend bool operator!=(const Iterator& a, const Iterator& b) { return a.m_pos != b.m_pos; }
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    CCoinsMap() = default;
+    CCoinsMap(const CCoinsMap&) = delete;
+    CCoinsMap& operator=(const CCoinsMap&) = delete;
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_slots_used); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_slots_used); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    //! Position of an entry in the iteration order. It does not change until
+    //! the entry is erased, so an iteration can be resumed from it later.
+    size_t position(const_iterator it) const { return it.m_pos; }
+    iterator begin_at(size_t pos) { return iterator(this, std::min<size_t>(pos, m_slots_used)); }
+
+    iterator find(const COutPoint& outpoint);
+    const_iterator find(const COutPoint& outpoint) const { return const_cast<CCoinsMap*>(this)->find(outpoint); }
+    size_t count(const COutPoint& outpoint) const { return find(outpoint) != end() ? 1 : 0; }
+
+    /**
+     * Insert a spent entry without flags for the outpoint, unless the map
+     * already has one. Returns the entry and whether it was inserted.
+     */
+    std::pair<iterator, bool> emplace(const COutPoint& outpoint);
+    //! Same, but set the coin of the inserted entry.
+    std::pair<iterator, bool> emplace(const COutPoint& outpoint, Coin&& coin);
+
+    //! Erase the entry, and return the entry after it.
+    iterator erase(iterator it);
+    //! Erase all the entries and release the memory of the map.
+    void clear();
+    //! Move the entries to the first slots, keeping their order, and release
+    //! the memory of the unused slots and script pool nodes. This changes the
+    //! positions of the entries.
+    void shrink_to_fit();
+    //! Make room in the index for n entries.
+    void reserve(size_t n);
+
+    void SetCoin(CCoinsCacheEntry& entry, Coin&& coin);
+    void ClearCoin(CCoinsCacheEntry& entry);
+
+    /**
+     * Memory used by the index, the entries and the script pool. The heap
+     * memory of the pooled scripts is reported by the entries instead.
+     */
+    size_t DynamicMemoryUsage() const;
+
+private:
+    static constexpr unsigned char CTRL_EMPTY = 0;
+    static constexpr unsigned char CTRL_DELETED = 1;
+    static constexpr unsigned char CTRL_FULL = 0x80;
+    static constexpr size_t MIN_CAPACITY = 16;
+    //! Chunks of entries double in size from the first one up to the last one.
+    static constexpr unsigned int FIRST_CHUNK_BITS = 4;
+    static constexpr unsigned int LAST_CHUNK_BITS = 12;
+    static constexpr uint32_t GROWING_CHUNKS_SIZE = (1 << (LAST_CHUNK_BITS + 1)) - (1 << FIRST_CHUNK_BITS);
+    static constexpr size_t POOL_CHUNK_SIZE = 64;
+
+    SaltedOutpointHasher m_hasher;
+    size_t m_size{0};
+
+    //! The index: control bytes and entry positions, and its tombstones.
+    std::unique_ptr<unsigned char[]> m_ctrl;
+    std::unique_ptr<uint32_t[]> m_index;
+    size_t m_capacity{0};
+    size_t m_deleted{0};
+
+    //! The entries, and the free slots below m_slots_used.
+    std::vector<std::unique_ptr<value_type[]>> m_chunks;
+    uint32_t m_slots_used{0};
+    uint32_t m_slots_allocated{0};
+    std::vector<uint32_t> m_free_slots;
+
+    //! Pool of the scripts that the entries cannot store inline.
+    std::vector<std::unique_ptr<CScript[]>> m_pool_chunks;
+    std::vector<CScript*> m_pool_free;
+
+    static size_t ChunkSize(size_t chunk)
+    {
+        return size_t{1} << std::min<size_t>(FIRST_CHUNK_BITS + chunk, LAST_CHUNK_BITS);
+    }
+
+    value_type& Slot(uint32_t pos) const
+    {
+        if (pos < GROWING_CHUNKS_SIZE) {
+            // Chunk k starts at ((1 << k) - 1) << FIRST_CHUNK_BITS.
+            const uint32_t shifted = pos + (1 << FIRST_CHUNK_BITS);
+            const unsigned int chunk = CountBits(shifted) - 1 - FIRST_CHUNK_BITS;
+            return m_chunks[chunk][shifted - (uint32_t{1} << (FIRST_CHUNK_BITS + chunk))];
+        }
+        pos -= GROWING_CHUNKS_SIZE;
+        return m_chunks[LAST_CHUNK_BITS - FIRST_CHUNK_BITS + 1 + (pos >> LAST_CHUNK_BITS)][pos & ((1 << LAST_CHUNK_BITS) - 1)];
+    }
+
+    uint32_t NextUsed(uint32_t pos) const
+    {
+        while (pos < m_slots_used && !Slot(pos).second.m_used) ++pos;
+        return pos;
+    }
+
+    //! Whether n live and deleted entries fit within the maximum load of 7/8.
+    static bool Fits(size_t n, size_t capacity) { return n * 8 <= capacity * 7; }
+    static unsigned char Tag(size_t hash) { return CTRL_FULL | (hash >> (sizeof(size_t) * 8 - 7)); }
+    void Rehash(size_t capacity);
+    void ReleaseScript(CCoinsCacheEntry& entry);
+};
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -163,6 +399,11 @@ public:
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
+    /** Retrieve the Coins for several outpoints at once. coins[i] is the coin
+     *  for outpoints[i], or a spent coin if no unspent coin was found.
+     */
+    virtual void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const;
+
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
@@ -176,6 +417,12 @@ public:
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
 
+    //! Do a bulk modification that is only part of the transition to
+    //! hashBlock, which a later BatchWrite completes. The view is left in
+    //! the middle of that transition, which ReplayBlocks can finish.
+    //! Returns false if the view does not support it.
+    virtual bool BatchWritePartial(CCoinsMap &mapCoins, const uint256 &hashBlock);
+
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
 
@@ -201,6 +448,7 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWritePartial(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -220,6 +468,32 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Number of DIRTY entries in cacheCoins. */
+    size_t cachedDirtyCoins{0};
+    /* Whether the base holds a part of the changes written by WriteDirty. */
+    bool m_partial_write{false};
+    /*
+     * Positions in cacheCoins of the entries that became DIRTY, in that
+     * order, so that WriteDirty does not have to look for them. Positions
+     * of entries that were erased or written since are skipped by
+     * WriteDirty and dropped by CompactDirtyQueue.
+     */
+    std::deque<uint32_t> m_dirty_queue;
+
+    //! Mark the entry as DIRTY, and queue it for WriteDirty if it was not.
+    void MarkDirty(CCoinsMap::iterator it);
+    //! Whether the entry at the position is a DIRTY one.
+    bool IsDirtyAt(uint32_t pos) const;
+    //! Drop the stale positions once they outnumber the DIRTY entries.
+    void CompactDirtyQueue();
+
+    /*
+     * Whether entries taken by TakeDirty may not be in the base yet, and the
+     * spent ones among them, which are kept cached until EndWrite.
+     */
+    bool m_write_pending{false};
+    std::vector<COutPoint> m_pending_spent;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -231,9 +505,12 @@ public:
     // Standard CCoinsView methods
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    //! Not supported: a cache only holds whole transitions.
+    bool BatchWritePartial(CCoinsMap &mapCoins, const uint256 &hashBlock) override { return false; }
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -246,16 +523,18 @@ public:
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
     /**
-     * Return a reference to Coin in the cache, or a pruned one if not found. This is
-     * more efficient than GetCoin.
-     *
-     * Generally, do not hold the reference returned for more than a short scope.
-     * While the current implementation allows for modifications to the contents
-     * of the cache while holding the reference, this behavior should not be relied
-     * on! To be safe, best to not hold the returned reference through any other
-     * calls to this cache.
+     * Load the coins for the given outpoints that are not cached yet from the
+     * backing view in a single GetCoins call, so that they do not have to be
+     * fetched one at a time later. Returns the number of outpoints that were
+     * not cached.
      */
-    const Coin& AccessCoin(const COutPoint &output) const;
+    size_t PrefetchCoins(const std::vector<COutPoint>& outpoints) const;
+
+    /**
+     * Return a copy of the Coin in the cache, or a pruned one if not found. The
+     * cache keeps its coins in a compact form, so there is no Coin to refer to.
+     */
+    Coin AccessCoin(const COutPoint &output) const;
 
     /**
      * Add a coin. Set potential_overwrite to true if a non-pruned version may
@@ -277,9 +556,47 @@ public:
      */
     bool Flush();
 
+    /**
+     * Write up to max_entries modified entries to the base as part of a
+     * transition to the best block of this cache, and keep them cached as
+     * unmodified entries. Once the base has all the modifications, the
+     * transition is completed, and the base is at the best block of this
+     * cache. If false is returned, the state of the base is undefined.
+     */
+    bool WriteDirty(size_t max_entries);
+
+    /**
+     * Move up to max_entries modified entries into batch, to be written to
+     * the base by the caller, possibly without holding the lock of this
+     * cache, and keep them cached as unmodified entries. Returns whether the
+     * batch holds all the modified entries, in which case it completes the
+     * transition to the best block and must be written with BatchWrite,
+     * otherwise with BatchWritePartial. Until EndWrite is called, no entry is
+     * uncached, so that the base is not read before it has the batch, and
+     * any other write to the base must wait for the batch to be written.
+     */
+    bool TakeDirty(size_t max_entries, CCoinsMap& batch);
+
+    //! Finish a write started by TakeDirty, once the base has the batch.
+    void EndWrite(bool complete);
+
+    /**
+     * Drop unmodified entries until the cache uses at most max_usage bytes,
+     * starting with the ones stored first, and release their memory. The
+     * modified entries are kept. Does nothing while a batch taken by
+     * TakeDirty may not be in the base yet.
+     */
+    void Trim(size_t max_usage);
+
+    //! Number of modified entries that have not been written to the base.
+    size_t GetDirtyCount() const { return cachedDirtyCoins; }
+
+    //! Whether the base is in the middle of a transition started by WriteDirty.
+    bool HasPartialWrite() const { return m_partial_write; }
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
-     * not modified.
+     * not modified and no write started by TakeDirty is pending.
      */
     void Uncache(const COutPoint &outpoint);
 
@@ -322,7 +639,7 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool
 //! This function can be quite expensive because in the event of a transaction
 //! which is not found in the cache, it can cause up to MAX_OUTPUTS_PER_BLOCK
 //! lookups to database, so it should be used with care.
-const Coin& AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
+Coin AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
 
 /**
  * This is a minimally invasive approach to shutdown on LevelDB read errors from the
@@ -341,8 +658,11 @@ public:
     }
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
 
 private:
+    [[noreturn]] void HandleReadError(const std::runtime_error& e) const;
+
     /** A list of callbacks to execute upon leveldb read error. */
     std::vector<std::function<void()>> m_err_callbacks;
 
@@ -1,14 +1,32 @@
 #include <consensus/block_rewards.h>
 
+#include <array>
 
-CAmount GetBlockRewardForHeight(uint32_t height)
- {
-     for(uint32_t i = 0; i < NUMBER_OF_REWARD_REDUCTIONS; i++)
-     {
-         if (height < BOOTSTRAP_PERIOD + i * REWARD_REDUCTION_PERIOD)
-         {
-             return REWARD_AMOUNTS[i];
-         }
-     }
-     return 0;
- }
\ No newline at end of file
+/** GetRewardSupplyBeforeEra for every era, so that supply lookups need no loop */
+static std::array<CAmount, NUMBER_OF_REWARD_REDUCTIONS + 1> ComputeRewardSupplyTable()
+{
+    std::array<CAmount, NUMBER_OF_REWARD_REDUCTIONS + 1> table;
+    for (uint32_t era = 0; era <= NUMBER_OF_REWARD_REDUCTIONS; era++) {
+        table[era] = GetRewardSupplyBeforeEra(era);
+    }
+    return table;
+}
+
+static const std::array<CAmount, NUMBER_OF_REWARD_REDUCTIONS + 1> REWARD_SUPPLY_BEFORE_ERA = ComputeRewardSupplyTable();
+
+CAmount GetRewardSupplyBeforeHeight(uint32_t height)
+{
+    const uint32_t era = GetRewardEra(height);
+    if (era >= NUMBER_OF_REWARD_REDUCTIONS) {
+        return MAX_REWARD_SUPPLY;
+    }
+    return REWARD_SUPPLY_BEFORE_ERA[era] + CAmount{height - GetRewardEraStart(era)} * REWARD_AMOUNTS[era];
+}
+
+CAmount GetBlockRewardsInRange(uint32_t nBeginHeight, uint32_t nEndHeight)
+{
+    if (nEndHeight <= nBeginHeight) {
+        return 0;
+    }
+    return GetRewardSupplyBeforeHeight(nEndHeight) - GetRewardSupplyBeforeHeight(nBeginHeight);
+}
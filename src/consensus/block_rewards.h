@@ -5,7 +5,6 @@
 #ifndef ELCASH_CONSENSUS_BLOCK_REWARDS_H
 #define ELCASH_CONSENSUS_BLOCK_REWARDS_H
 
-#include <array>
 #include <cstdint>
 #include <amount.h>
 
@@ -14,7 +13,7 @@ const uint32_t BOOTSTRAP_PERIOD = 4200;
 const uint32_t REWARD_REDUCTION_PERIOD = 52500;
 const uint32_t NUMBER_OF_REWARD_REDUCTIONS = 39;
 
-const std::array<CAmount, 39> REWARD_AMOUNTS = {
+constexpr CAmount REWARD_AMOUNTS[NUMBER_OF_REWARD_REDUCTIONS] = {
     50000000000,
     7500000000,
     7000000000,
@@ -56,6 +55,36 @@ const std::array<CAmount, 39> REWARD_AMOUNTS = {
     1
 };
 
-CAmount GetBlockRewardForHeight(uint32_t height);
+/** Reward era of a height: 0 for the bootstrap period, then one per reward reduction period */
+constexpr uint32_t GetRewardEra(uint32_t height)
+{
+    return height < BOOTSTRAP_PERIOD ? 0 : 1 + (height - BOOTSTRAP_PERIOD) / REWARD_REDUCTION_PERIOD;
+}
+
+/** First height of a reward era */
+constexpr uint32_t GetRewardEraStart(uint32_t era)
+{
+    return era == 0 ? 0 : BOOTSTRAP_PERIOD + (era - 1) * REWARD_REDUCTION_PERIOD;
+}
+
+constexpr CAmount GetBlockRewardForHeight(uint32_t height)
+{
+    return GetRewardEra(height) < NUMBER_OF_REWARD_REDUCTIONS ? REWARD_AMOUNTS[GetRewardEra(height)] : 0;
+}
+
+/** Sum of the block rewards of all eras before the given one */
+constexpr CAmount GetRewardSupplyBeforeEra(uint32_t era)
+{
+    return era == 0 ? 0 : GetRewardSupplyBeforeEra(era - 1) + CAmount{GetRewardEraStart(era) - GetRewardEraStart(era - 1)} * REWARD_AMOUNTS[era - 1];
+}
+
+/** Sum of the block rewards of all blocks, once all reward reductions have passed */
+constexpr CAmount MAX_REWARD_SUPPLY = GetRewardSupplyBeforeEra(NUMBER_OF_REWARD_REDUCTIONS);
+
+/** Sum of the block rewards for the heights below the given one */
+CAmount GetRewardSupplyBeforeHeight(uint32_t height);
+
+/** Sum of the block rewards for the heights in [nBeginHeight, nEndHeight) */
+CAmount GetBlockRewardsInRange(uint32_t nBeginHeight, uint32_t nEndHeight);
 
 #endif //ELCASH_CONSENSUS_BLOCK_REWARDS_H
\ No newline at end of file
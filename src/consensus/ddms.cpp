@@ -0,0 +1,35 @@
+// Copyright (c) 2020 Electric Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/ddms.h>
+
+#include <algorithm>
+#include <array>
+
+typedef std::array<unsigned char, DDMS_SCRIPT_LENGTH> DdmsScriptKey;
+
+/** ddmsAllowedScriptsRaw, sorted for binary search */
+static std::array<DdmsScriptKey, DDMS_ALLOWED_SCRIPTS_NUMBER> SortDdmsAllowedScripts()
+{
+    std::array<DdmsScriptKey, DDMS_ALLOWED_SCRIPTS_NUMBER> keys;
+    for (size_t i = 0; i < DDMS_ALLOWED_SCRIPTS_NUMBER; i++) {
+        std::copy(ddmsAllowedScriptsRaw[i], ddmsAllowedScriptsRaw[i] + DDMS_SCRIPT_LENGTH, keys[i].begin());
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+bool IsDdmsAllowedScript(const CScript& script)
+{
+    // All allowed scripts have the same length, so anything else is rejected
+    // without looking at the list.
+    if (script.size() != DDMS_SCRIPT_LENGTH) {
+        return false;
+    }
+
+    static const std::array<DdmsScriptKey, DDMS_ALLOWED_SCRIPTS_NUMBER> keys = SortDdmsAllowedScripts();
+    DdmsScriptKey key;
+    std::copy(script.begin(), script.end(), key.begin());
+    return std::binary_search(keys.begin(), keys.end(), key);
+}
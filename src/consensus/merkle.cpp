@@ -5,6 +5,8 @@
 #include <consensus/merkle.h>
 #include <hash.h>
 
+#include <cstring>
+
 /*     WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
        that the following merkle tree algorithm has a serious flaw related to
@@ -61,6 +63,39 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
     return hashes[0];
 }
 
+bool ComputeMerklePairs(uint256* out, const uint256* in, size_t nPairs) {
+    bool mutation = false;
+    for (size_t pos = 0; pos < nPairs; pos++) {
+        if (in[2 * pos] == in[2 * pos + 1]) mutation = true;
+    }
+    SHA256D64(out->begin(), in->begin(), nPairs);
+    return mutation;
+}
+
+void ComputeMerkleLevelEnd(std::vector<uint256>& next, const std::vector<uint256>& level) {
+    next.resize((level.size() + 1) / 2);
+    if (level.size() & 1) {
+        unsigned char pair[64];
+        memcpy(pair, level.back().begin(), 32);
+        memcpy(pair + 32, level.back().begin(), 32);
+        SHA256D64(next.back().begin(), pair, 1);
+    }
+}
+
+std::vector<std::vector<uint256>> ComputeMerkleLevels(std::vector<uint256> leaves, bool* mutated) {
+    bool mutation = false;
+    std::vector<std::vector<uint256>> levels;
+    levels.push_back(std::move(leaves));
+    while (levels.back().size() > 1) {
+        const std::vector<uint256>& level = levels.back();
+        std::vector<uint256> next(level.size() / 2);
+        if (ComputeMerklePairs(next.data(), level.data(), next.size())) mutation = true;
+        ComputeMerkleLevelEnd(next, level);
+        levels.push_back(std::move(next));
+    }
+    if (mutated) *mutated = mutation;
+    return levels;
+}
 
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 {
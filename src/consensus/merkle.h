@@ -12,6 +12,25 @@
 
 uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
 
+/*
+ * Hash nPairs pairs of adjacent hashes of one merkle tree level into out.
+ * Returns true if the two hashes of any pair are equal.
+ */
+bool ComputeMerklePairs(uint256* out, const uint256* in, size_t nPairs);
+
+/*
+ * Compute the merkle tree level above the given one, repeating the last hash
+ * of an odd level. Only the last pair is hashed; the others are expected to be
+ * in next already, as filled by ComputeMerklePairs.
+ */
+void ComputeMerkleLevelEnd(std::vector<uint256>& next, const std::vector<uint256>& level);
+
+/*
+ * Compute all levels of the merkle tree, from the leaves up to the root.
+ * *mutated is set to true if a duplicated subtree was found.
+ */
+std::vector<std::vector<uint256>> ComputeMerkleLevels(std::vector<uint256> leaves, bool* mutated = nullptr);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
@@ -439,6 +439,21 @@ public:
         }
     }
 
+    /** live_elements returns a copy of every element that is not marked as
+     * discardable, e.g. to persist the cache across restarts. Not threadsafe
+     * with any concurrent insert.
+     *
+     * @returns the elements in table order
+     */
+    std::vector<Element> live_elements() const
+    {
+        std::vector<Element> elements;
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                elements.push_back(table[i]);
+        return elements;
+    }
+
     /** contains iterates through the hash locations for a given element
      * and checks to see if it is present.
      *
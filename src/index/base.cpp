@@ -4,6 +4,7 @@
 
 #include <chainparams.h>
 #include <index/base.h>
+#include <primitives/blockview.h>
 #include <shutdown.h>
 #include <tinyformat.h>
 #include <ui_interface.h>
@@ -135,6 +136,21 @@ void BaseIndex::ThreadSync()
                 Commit();
             }
 
+            if (UsesBlockView()) {
+                CBlockView block;
+                if (!ReadBlockViewFromDisk(block, pindex, Params().GetConsensus(), Params().MessageStart())) {
+                    FatalError("%s: Failed to read block %s from disk",
+                               __func__, pindex->GetBlockHash().ToString());
+                    return;
+                }
+                if (!WriteBlockView(block, pindex)) {
+                    FatalError("%s: Failed to write block %s to index database",
+                               __func__, pindex->GetBlockHash().ToString());
+                    return;
+                }
+                continue;
+            }
+
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
                 FatalError("%s: Failed to read block %s from disk",
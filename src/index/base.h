@@ -12,6 +12,7 @@
 #include <validationinterface.h>
 
 class CBlockIndex;
+class CBlockView;
 
 /**
  * Base class for indices of blockchain data. This implements
@@ -74,6 +75,12 @@ protected:
     /// Write update index entries for a newly connected block.
     virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
 
+    /// Indexes that only need the layout, hashes or scripts of the transactions
+    /// can return true here to be synced from a CBlockView through
+    /// WriteBlockView, which spares deserializing every block read from disk.
+    virtual bool UsesBlockView() const { return false; }
+    virtual bool WriteBlockView(const CBlockView& block, const CBlockIndex* pindex) { return true; }
+
     /// Virtual method called internally by Commit that can be overridden to atomically
     /// commit more index state.
     virtual bool CommitInternal(CDBBatch& batch);
@@ -84,6 +91,9 @@ protected:
 
     virtual DB& GetDB() const = 0;
 
+    /// The last block the index is in sync with.
+    const CBlockIndex* CurrentIndex() const { return m_best_block_index.load(); }
+
     /// Get the name of the index for display in logs.
     virtual const char* GetName() const = 0;
 
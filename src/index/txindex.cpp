@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <index/txindex.h>
+#include <primitives/blockview.h>
 #include <shutdown.h>
 #include <ui_interface.h>
 #include <util/system.h>
@@ -259,6 +260,20 @@ bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
     return m_db->WriteTxs(vPos);
 }
 
+bool TxIndex::WriteBlockView(const CBlockView& block, const CBlockIndex* pindex)
+{
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) return true;
+
+    // Transaction offsets are relative to the end of the block header.
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    vPos.reserve(block.Transactions().size());
+    for (const CBlockView::Tx& tx : block.Transactions()) {
+        vPos.emplace_back(block.GetTxHash(tx), CDiskTxPos(pindex->GetBlockPos(), tx.offset - block.HeaderSize()));
+    }
+    return m_db->WriteTxs(vPos);
+}
+
 BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
 
 bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const
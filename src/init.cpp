@@ -21,6 +21,7 @@
 #include <httprpc.h>
 #include <httpserver.h>
 #include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key.h>
@@ -34,6 +35,7 @@
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
+#include <rpc/auxpow_miner.h>
 #include <rpc/blockchain.h>
 #include <rpc/register.h>
 #include <rpc/server.h>
@@ -58,6 +60,7 @@
 
 #include <validationinterface.h>
 #include <walletinitinterface.h>
+#include <workerpool.h>
 
 #include <stdint.h>
 #include <stdio.h>
@@ -167,6 +170,9 @@ void Interrupt(NodeContext& node)
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Interrupt();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
@@ -189,6 +195,7 @@ void Shutdown(NodeContext& node)
     StopREST();
     StopRPC();
     StopHTTPServer();
+    AuxpowMiner::get().stopBuilder();
     for (const auto& client : node.chain_clients) {
         client->flush();
     }
@@ -219,6 +226,7 @@ void Shutdown(NodeContext& node)
     if (node.scheduler) node.scheduler->stop();
     threadGroup.interrupt_all();
     threadGroup.join_all();
+    LogScriptCheckStats();
 
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
@@ -230,6 +238,10 @@ void Shutdown(NodeContext& node)
         DumpMempool(::mempool);
     }
 
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        DumpScriptCaches();
+    }
+
     if (fFeeEstimatesInitialized)
     {
         ::feeEstimator.FlushUnconfirmed();
@@ -251,6 +263,9 @@ void Shutdown(NodeContext& node)
         if (g_chainstate && g_chainstate->CanFlushToDisk()) {
             g_chainstate->ForceFlushStateToDisk();
         }
+        if (g_background_chainstate && g_background_chainstate->CanFlushToDisk()) {
+            g_background_chainstate->ForceFlushStateToDisk();
+        }
     }
 
     // After there are no more peers/RPC left to give us new data which may generate
@@ -262,6 +277,10 @@ void Shutdown(NodeContext& node)
         g_txindex->Stop();
         g_txindex.reset();
     }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Stop();
+        g_coin_stats_index.reset();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
     DestroyAllBlockFilterIndexes();
 
@@ -277,6 +296,10 @@ void Shutdown(NodeContext& node)
             g_chainstate->ForceFlushStateToDisk();
             g_chainstate->ResetCoinsViews();
         }
+        if (g_background_chainstate && g_background_chainstate->CanFlushToDisk()) {
+            g_background_chainstate->ForceFlushStateToDisk();
+            g_background_chainstate->ResetCoinsViews();
+        }
         pblocktree.reset();
     }
     for (const auto& client : node.chain_clients) {
@@ -388,6 +411,8 @@ void SetupServerArgs()
 #endif
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksonly", strprintf("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless '-whitelistforcerelay' is '1', in which case whitelisted peers' transactions will be relayed. RPC transactions are not affected. (default: %u)", DEFAULT_BLOCKSONLY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinsdbshards=<n>", strprintf("Split the coins database into <n> LevelDB instances, which are written in parallel (0 to %d, 0 for a single one). If set, an existing database with another layout is converted at startup (default: keep the layout of an existing database, or 0 for a new one)", MAX_COINS_DB_SHARDS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinsflushbatch=<n>", strprintf("Number of modified coins written to the coins database every second in the background, so that flushing the coins cache has less left to write (0 to disable, default: %u)", DEFAULT_COINS_FLUSH_BATCH), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", ELCASH_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
@@ -400,8 +425,9 @@ void SetupServerArgs()
     gArgs.AddArg("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
-        -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d). Automatic settings start at most %d dedicated threads; set a larger count explicitly to use more",
+        -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS, MAX_AUTO_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-persistsigcache", strprintf("Whether to save the signature and script execution caches on shutdown and load them on restart, so that transactions already verified need not be verified again (default: %u)", DEFAULT_PERSIST_SIGCACHE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", ELCASH_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
@@ -414,6 +440,7 @@ void SetupServerArgs()
 #else
     hidden_args.emplace_back("-sysperms");
 #endif
+    gArgs.AddArg("-coinstatsindex", strprintf("Maintain the statistics of the UTXO set as of every block, used by the gettxoutsetinfo rpc call (default: %u)", DEFAULT_COINSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockfilterindex=<type>",
                  strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
@@ -547,6 +574,8 @@ void SetupServerArgs()
     gArgs.AddArg("-whitelistrelay", strprintf("Add 'relay' permission to whitelisted inbound peers with default permissions. This will accept relayed transactions even when not relaying transactions (default: %d)", DEFAULT_WHITELISTRELAY), ArgsManager::ALLOW_ANY, OptionsCategory::NODE_RELAY);
 
 
+    gArgs.AddArg("-auxpowprebuild", strprintf("Construct blocks for createauxblock in the background when the tip or the mempool changes (default: %u)", DEFAULT_AUXPOW_PREBUILD), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-auxpowtemplatecache=<n>", strprintf("Maximum memory usage of the blocks kept for createauxblock and submitauxblock in MiB (default: %d)", DEFAULT_AUXPOW_TEMPLATE_CACHE_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
@@ -692,18 +721,9 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            FlatFilePos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos)))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        LogPrintf("Reindexing block files...\n");
+        ReindexBlockFiles(chainparams);
+        if (ShutdownRequested()) return;
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -729,6 +749,11 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
         StartShutdown();
         return;
     }
+    if (!ActivateBackgroundChainstate(chainparams)) {
+        LogPrintf("Failed to connect the blocks below the snapshot base\n");
+        StartShutdown();
+        return;
+    }
 
     if (gArgs.GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT)) {
         LogPrintf("Stopping after block import\n");
@@ -981,6 +1006,9 @@ bool AppInitParameterInteraction()
         if (!g_enabled_filter_types.empty()) {
             return InitError(_("Prune mode is incompatible with -blockfilterindex.").translated);
         }
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+            return InitError(_("Prune mode is incompatible with -coinstatsindex.").translated);
+        }
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1038,6 +1066,9 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    if (gArgs.GetArg("-coinsdbshards", 0) < 0 || gArgs.GetArg("-coinsdbshards", 0) > MAX_COINS_DB_SHARDS) {
+        return InitError(strprintf(_("-coinsdbshards must be between 0 and %d").translated, MAX_COINS_DB_SHARDS));
+    }
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
@@ -1263,9 +1294,13 @@ bool AppInitMain(NodeContext& node)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadScriptCaches();
+    }
 
     int script_threads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
-    if (script_threads <= 0) {
+    const bool script_threads_auto = script_threads <= 0;
+    if (script_threads_auto) {
         // -par=0 means autodetect (number of cores - 1 script threads)
         // -par=-n means "leave n cores free" (number of cores - n - 1 script threads)
         script_threads += GetNumCores();
@@ -1274,8 +1309,9 @@ bool AppInitMain(NodeContext& node)
     // Subtract 1 because the main thread counts towards the par threads
     script_threads = std::max(script_threads - 1, 0);
 
-    // Number of script-checking threads <= MAX_SCRIPTCHECK_THREADS
-    script_threads = std::min(script_threads, MAX_SCRIPTCHECK_THREADS);
+    // Number of script-checking threads <= MAX_SCRIPTCHECK_THREADS, or
+    // MAX_AUTO_SCRIPTCHECK_THREADS unless the count is set explicitly
+    script_threads = std::min(script_threads, script_threads_auto ? MAX_AUTO_SCRIPTCHECK_THREADS : MAX_SCRIPTCHECK_THREADS);
 
     LogPrintf("Script verification uses %d additional threads\n", script_threads);
     if (script_threads >= 1) {
@@ -1285,6 +1321,11 @@ bool AppInitMain(NodeContext& node)
         }
     }
 
+    // Start the threads of the worker pool, for disk and database work split into parts
+    for (int i = 0; i < WORKER_POOL_THREADS; ++i) {
+        threadGroup.create_thread([i]() { TraceThread(strprintf("worker.%i", i).c_str(), [] { g_worker_pool.Thread(); }); });
+    }
+
     assert(!node.scheduler);
     node.scheduler = MakeUnique<CScheduler>();
 
@@ -1530,6 +1571,7 @@ bool AppInitMain(NodeContext& node)
                 LOCK(cs_main);
                 // This statement makes ::ChainstateActive() usable.
                 g_chainstate = MakeUnique<CChainState>();
+                g_background_chainstate.reset();
                 UnloadBlockIndex();
 
                 // new CBlockTreeDB tries to delete the existing file, which
@@ -1582,6 +1624,10 @@ bool AppInitMain(NodeContext& node)
                 // At this point we're either in reindex or we've loaded a useful
                 // block tree into BlockIndex()!
 
+                if (!CleanupSnapshotChainstate(fReset || fReindex || fReindexChainState, strLoadError)) {
+                    break;
+                }
+
                 ::ChainstateActive().InitCoinsDB(
                     /* cache_size_bytes */ nCoinDBCache,
                     /* in_memory */ false,
@@ -1600,6 +1646,12 @@ bool AppInitMain(NodeContext& node)
                     break;
                 }
 
+                // Convert to the requested layout, if any.
+                if (gArgs.IsArgSet("-coinsdbshards") && !::ChainstateActive().CoinsDB().Reshard(gArgs.GetArg("-coinsdbshards", 0))) {
+                    strLoadError = _("Error converting chainstate database").translated;
+                    break;
+                }
+
                 // ReplayBlocks is a no-op if we cleared the coinsviewdb with -reindex or -reindex-chainstate
                 if (!::ChainstateActive().ReplayBlocks(chainparams)) {
                     strLoadError = _("Unable to replay blocks. You will need to rebuild the database using -reindex-chainstate.").translated;
@@ -1661,6 +1713,18 @@ bool AppInitMain(NodeContext& node)
                         break;
                     }
                 }
+
+                // A chainstate loaded from a UTXO snapshot goes on top of the one
+                // just loaded, which keeps validating the blocks below it.
+                if (fs::exists(GetDataDir() / SNAPSHOT_CHAINSTATE_DIR) &&
+                        (fPruneMode || gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) || !g_enabled_filter_types.empty() ||
+                         gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX))) {
+                    strLoadError = _("A UTXO snapshot is being validated, which is not supported with pruning or indexes").translated;
+                    break;
+                }
+                if (!LoadSnapshotChainstate(chainparams, strLoadError)) {
+                    break;
+                }
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database").translated;
@@ -1712,6 +1776,12 @@ bool AppInitMain(NodeContext& node)
         g_txindex->Start();
     }
 
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        // The index holds one small record per block, so it needs no cache.
+        g_coin_stats_index = MakeUnique<CoinStatsIndex>(/* cache size */ 0, false, fReindex);
+        g_coin_stats_index->Start();
+    }
+
     for (const auto& filter_type : g_enabled_filter_types) {
         InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
         GetBlockFilterIndex(filter_type)->Start();
@@ -1867,6 +1937,10 @@ bool AppInitMain(NodeContext& node)
         return false;
     }
 
+    if (gArgs.GetBoolArg("-auxpowprebuild", DEFAULT_AUXPOW_PREBUILD)) {
+        AuxpowMiner::get().startBuilder(*node.mempool);
+    }
+
     // ********************************************************* Step 13: finished
 
     SetRPCWarmupFinished();
@@ -1881,5 +1955,7 @@ bool AppInitMain(NodeContext& node)
         banman->DumpBanlist();
     }, DUMP_BANS_INTERVAL);
 
+    node.scheduler->scheduleEvery(FlushCoinsIncremental, COINS_FLUSH_INTERVAL);
+
     return true;
 }
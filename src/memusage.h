@@ -10,7 +10,9 @@
 
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cassert>
+#include <deque>
 #include <map>
 #include <memory>
 #include <set>
@@ -89,6 +91,16 @@ static inline size_t DynamicUsage(const std::vector<X>& v)
     return MallocUsage(v.capacity() * sizeof(X));
 }
 
+template<typename X>
+static inline size_t DynamicUsage(const std::deque<X>& d)
+{
+    // The elements are stored in blocks of 512 bytes (or of one element if
+    // larger), found through a map of pointers with at least 8 entries.
+    const size_t per_block = sizeof(X) < 512 ? 512 / sizeof(X) : 1;
+    const size_t blocks = d.size() / per_block + 1;
+    return blocks * MallocUsage(per_block * sizeof(X)) + MallocUsage(std::max<size_t>(8, blocks + 2) * sizeof(void*));
+}
+
 template<unsigned int N, typename X, typename S, typename D>
 static inline size_t DynamicUsage(const prevector<N, X, S, D>& v)
 {
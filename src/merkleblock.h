@@ -67,11 +67,8 @@ protected:
         return (nTransactions+(1 << height)-1) >> height;
     }
 
-    /** calculate the hash of a node in the merkle tree (at leaf level: the txid's themselves) */
-    uint256 CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid);
-
-    /** recursive function that traverses tree nodes, storing the data as bits and hashes */
-    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+    /** recursive function that traverses tree nodes, storing the data as bits and hashes (vLevels[height][pos] is the hash of a node) */
+    void TraverseAndBuild(int height, unsigned int pos, const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch);
 
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
@@ -107,6 +104,9 @@ public:
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** Construct a partial merkle tree from all levels of the full tree, as computed by ComputeMerkleLevels */
+    CPartialMerkleTree(const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch);
+
     CPartialMerkleTree();
 
     /**
@@ -155,6 +155,9 @@ public:
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids) : CMerkleBlock(block, nullptr, &txids) { }
 
+    // Create from a CBlock whose merkle tree levels are known already, matching the txids in the set
+    CMerkleBlock(const CBlock& block, const std::set<uint256>& txids, const std::vector<std::vector<uint256>>& levels) : CMerkleBlock(block, nullptr, &txids, &levels) { }
+
     CMerkleBlock() {}
 
     ADD_SERIALIZE_METHODS;
@@ -167,7 +170,7 @@ public:
 
 private:
     // Combined constructor to consolidate code
-    CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids);
+    CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids, const std::vector<std::vector<uint256>>* levels = nullptr);
 };
 
 #endif // ELCASH_MERKLEBLOCK_H
@@ -665,6 +665,12 @@ int V1TransportDeserializer::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
+    if (m_discard) {
+        nDataPos += nCopy;
+        if (nDataPos == hdr.nMessageSize) Reset();
+        return nCopy;
+    }
+
     if (vRecv.size() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
         vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
@@ -677,6 +683,33 @@ int V1TransportDeserializer::readData(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
+bool V1TransportDeserializer::GetPartialMessage(std::string& command, std::vector<unsigned char>& prefix, unsigned int max_size) const
+{
+    if (!in_data || m_partial_check_size == 0 || nDataPos < m_partial_check_size || Complete()) return false;
+    command = hdr.GetCommand();
+    const unsigned int size = std::min(nDataPos, max_size);
+    prefix.assign((const unsigned char*)vRecv.data(), (const unsigned char*)vRecv.data() + size);
+    return true;
+}
+
+void V1TransportDeserializer::DeferPartialCheck(unsigned int max_size)
+{
+    if (m_partial_check_size >= max_size) {
+        m_partial_check_size = 0;
+    } else {
+        m_partial_check_size = std::min(2 * m_partial_check_size, max_size);
+    }
+}
+
+void V1TransportDeserializer::FinishPartialCheck(bool discard)
+{
+    m_partial_check_size = 0;
+    if (discard && in_data && !Complete()) {
+        m_discard = true;
+        vRecv = CDataStream(vRecv.GetType(), vRecv.GetVersion());
+    }
+}
+
 const uint256& V1TransportDeserializer::GetMessageHash() const
 {
     assert(Complete());
@@ -1387,6 +1420,8 @@ void CConnman::SocketHandler()
                 bool notify = false;
                 if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
                     pnode->CloseSocketDisconnect();
+                else
+                    CheckPartialMessage(pnode);
                 RecordBytesRecv(nBytes);
                 if (notify) {
                     size_t nSizeAdded = 0;
@@ -1448,6 +1483,39 @@ void CConnman::SocketHandler()
     }
 }
 
+/**
+ * Let the message processor look at the start of a block that is still being
+ * received, so that an invalid one can be dropped without buffering the rest.
+ * The prefix is copied so that no lock is held while it is checked. This
+ * happens once per message, unless the first prefix is too short for the
+ * header and coinbase, in which case it is retried with twice as much.
+ */
+void CConnman::CheckPartialMessage(CNode* pnode)
+{
+    std::string command;
+    std::vector<unsigned char> prefix;
+    {
+        LOCK(pnode->cs_vRecv);
+        if (!pnode->m_deserializer->GetPartialMessage(command, prefix, MAX_PARTIAL_MESSAGE_CHECK_SIZE)) return;
+        if (command != NetMsgType::BLOCK) {
+            pnode->m_deserializer->FinishPartialCheck(false);
+            return;
+        }
+    }
+
+    const PartialMessageCheck result = m_msgproc->CheckPartialMessage(pnode, command, prefix);
+
+    LOCK(pnode->cs_vRecv);
+    if (result == PartialMessageCheck::NEED_MORE) {
+        pnode->m_deserializer->DeferPartialCheck(MAX_PARTIAL_MESSAGE_CHECK_SIZE);
+        return;
+    }
+    if (result == PartialMessageCheck::REJECT) {
+        LogPrint(BCLog::NET, "dropping the rest of a %s message from peer=%d\n", command, pnode->GetId());
+    }
+    pnode->m_deserializer->FinishPartialCheck(result == PartialMessageCheck::REJECT);
+}
+
 void CConnman::ThreadSocketHandler()
 {
     while (!interruptNet)
@@ -355,6 +355,7 @@ private:
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
+    void CheckPartialMessage(CNode* pnode);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -502,6 +503,18 @@ struct CombinerAll
     }
 };
 
+/** Outcome of looking at the start of a message that is still being received. */
+enum class PartialMessageCheck {
+    NEED_MORE, //!< Not enough of the message yet; ask again with twice as much of it
+    ACCEPT,    //!< Nothing wrong found; receive the rest as usual
+    REJECT,    //!< Drop the rest of the message without buffering it
+};
+
+/** Message prefix first handed to NetEventsInterface::CheckPartialMessage, enough for a block header and coinbase. */
+static const unsigned int MIN_PARTIAL_MESSAGE_CHECK_SIZE = 16 * 1024;
+/** Largest message prefix handed to NetEventsInterface::CheckPartialMessage. */
+static const unsigned int MAX_PARTIAL_MESSAGE_CHECK_SIZE = 256 * 1024;
+
 /**
  * Interface for message handling
  */
@@ -509,6 +522,8 @@ class NetEventsInterface
 {
 public:
     virtual bool ProcessMessages(CNode* pnode, std::atomic<bool>& interrupt) = 0;
+    /** Check the first bytes of a message before the rest of it is received. */
+    virtual PartialMessageCheck CheckPartialMessage(CNode* pnode, const std::string& msg_type, const std::vector<unsigned char>& prefix) = 0;
     virtual bool SendMessages(CNode* pnode) = 0;
     virtual void InitializeNode(CNode* pnode) = 0;
     virtual void FinalizeNode(NodeId id, bool& update_connection_time) = 0;
@@ -646,6 +661,12 @@ public:
     virtual int Read(const char *data, unsigned int bytes) = 0;
     // decomposes a message from the context
     virtual CNetMessage GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) = 0;
+    // returns true, with the command and the start of the payload, once an incomplete message that has not been checked yet has enough of it
+    virtual bool GetPartialMessage(std::string& command, std::vector<unsigned char>& prefix, unsigned int max_size) const = 0;
+    // check the current message again once twice as much of its payload has arrived
+    virtual void DeferPartialCheck(unsigned int max_size) = 0;
+    // stop checking the current message, and drop the rest of its payload if discard is set
+    virtual void FinishPartialCheck(bool discard) = 0;
     virtual ~TransportDeserializer() {}
 };
 
@@ -660,6 +681,8 @@ private:
     CDataStream vRecv;              // received message data
     unsigned int nHdrPos;
     unsigned int nDataPos;
+    unsigned int m_partial_check_size; // payload size at which to check the start of the current message, 0 once checked
+    bool m_discard;                 // skip the rest of the current message
 
     const uint256& GetMessageHash() const;
     int readHeader(const char *pch, unsigned int nBytes);
@@ -672,6 +695,8 @@ private:
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
+        m_partial_check_size = MIN_PARTIAL_MESSAGE_CHECK_SIZE;
+        m_discard = false;
         data_hash.SetNull();
         hasher.Reset();
     }
@@ -699,6 +724,9 @@ public:
         return ret;
     }
     CNetMessage GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) override;
+    bool GetPartialMessage(std::string& command, std::vector<unsigned char>& prefix, unsigned int max_size) const override;
+    void DeferPartialCheck(unsigned int max_size) override;
+    void FinishPartialCheck(bool discard) override;
 };
 
 /** The TransportSerializer prepares messages for the network transport
@@ -687,6 +687,43 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     }
 }
 
+/** While a UTXO snapshot is being validated, add the blocks below its base that the background
+ *  chainstate still misses to vBlocks, within the download window ahead of its tip, until it has
+ *  at most count entries. */
+static void FindNextHistoricalBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CChainState* background = ChainstateBackground();
+    if (!background || vBlocks.size() >= count)
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    const CBlockIndex* base = LookupBlockIndex(::ChainstateActive().m_from_snapshot_blockhash);
+    if (!state->fHaveWitness || state->pindexBestKnownBlock == nullptr || state->pindexBestKnownBlock->GetAncestor(base->nHeight) != base) {
+        // This peer cannot serve the history of the snapshot.
+        return;
+    }
+
+    const CBlockIndex* tip = background->m_chain.Tip();
+    const int nStart = tip ? tip->nHeight + 1 : 0;
+    const int nWindowEnd = std::min<int>(base->nHeight, nStart + BLOCK_DOWNLOAD_WINDOW - 1);
+    if (nWindowEnd < nStart)
+        return;
+    std::vector<const CBlockIndex*> vWindow(nWindowEnd - nStart + 1);
+    const CBlockIndex* pindexWalk = base->GetAncestor(nWindowEnd);
+    for (auto it = vWindow.rbegin(); it != vWindow.rend(); ++it) {
+        *it = pindexWalk;
+        pindexWalk = pindexWalk->pprev;
+    }
+    for (const CBlockIndex* pindex : vWindow) {
+        if (pindex->nStatus & BLOCK_HAVE_DATA || mapBlocksInFlight.count(pindex->GetBlockHash()))
+            continue;
+        vBlocks.push_back(pindex);
+        if (vBlocks.size() == count)
+            return;
+    }
+}
+
 void EraseTxRequest(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     g_already_asked_for.erase(txid);
@@ -2791,6 +2828,17 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                     return true;
                 }
 
+                // Check the prefilled coinbase before asking for the missing
+                // transactions. The block is only dropped, to be fetched again
+                // later, since the coinbase is not tied to the header yet.
+                CTransactionRef coinbase = partialBlock.GetCoinbase();
+                BlockValidationState coinbase_state;
+                if (coinbase && !CheckBlockCoinbase(cmpctblock.header, *coinbase, coinbase_state, chainparams.GetConsensus(), pindex->pprev)) {
+                    MarkBlockAsReceived(pindex->GetBlockHash());
+                    MaybePunishNodeForBlock(pfrom->GetId(), coinbase_state, /*via_compact_block*/ true, strprintf("invalid coinbase via cmpctblock: %s", coinbase_state.ToString()));
+                    return true;
+                }
+
                 BlockTransactionsRequest req;
                 for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
                     if (!partialBlock.IsTxAvailable(i))
@@ -3297,6 +3345,51 @@ bool PeerLogicValidation::MaybeDiscourageAndDisconnect(CNode* pnode)
     return false;
 }
 
+PartialMessageCheck PeerLogicValidation::CheckPartialMessage(CNode* pfrom, const std::string& msg_type, const std::vector<unsigned char>& prefix)
+{
+    if (msg_type != NetMsgType::BLOCK) return PartialMessageCheck::ACCEPT;
+
+    // A block starts with its header and its coinbase.
+    CBlockHeader header;
+    CMutableTransaction coinbase;
+    try {
+        VectorReader reader(SER_NETWORK, pfrom->GetRecvVersion(), prefix, 0);
+        reader >> header;
+        if (ReadCompactSize(reader) == 0) return PartialMessageCheck::ACCEPT;
+        reader >> coinbase;
+    } catch (const std::ios_base::failure&) {
+        return prefix.size() < MAX_PARTIAL_MESSAGE_CHECK_SIZE ? PartialMessageCheck::NEED_MORE : PartialMessageCheck::ACCEPT;
+    }
+
+    // This runs on the socket handler thread, which must not wait for
+    // validation. The block is checked in full once received if cs_main
+    // is busy.
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain) return PartialMessageCheck::ACCEPT;
+
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const uint256 hash = header.GetHash();
+    const CBlockIndex* pindex = LookupBlockIndex(hash);
+    const CBlockIndex* pindexPrev = LookupBlockIndex(header.hashPrevBlock);
+    BlockValidationState state;
+    if (pindex && (pindex->nStatus & BLOCK_FAILED_MASK)) {
+        state.Invalid(BlockValidationResult::BLOCK_CACHED_INVALID, "duplicate");
+    } else if (!pindex && !CheckProofOfWork(header, consensusParams)) {
+        state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
+    } else if (pindexPrev) {
+        CheckBlockCoinbase(header, CTransaction(coinbase), state, consensusParams, pindexPrev);
+    }
+    if (state.IsValid()) return PartialMessageCheck::ACCEPT;
+
+    LogPrint(BCLog::NET, "received invalid start of block %s from peer=%d: %s\n", hash.ToString(), pfrom->GetId(), state.ToString());
+    auto in_flight = mapBlocksInFlight.find(hash);
+    if (in_flight != mapBlocksInFlight.end() && in_flight->second.first == pfrom->GetId()) {
+        MarkBlockAsReceived(hash);
+    }
+    MaybePunishNodeForBlock(pfrom->GetId(), state, /*via_compact_block*/ false);
+    return PartialMessageCheck::REJECT;
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
@@ -4019,6 +4112,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            if (!pto->m_limited_node) {
+                FindNextHistoricalBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload);
+            }
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
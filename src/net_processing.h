@@ -63,6 +63,14 @@ public:
     */
     bool ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt) override;
     /**
+    * Reject a block that is still being received if its header or coinbase is invalid.
+    *
+    * @param[in]   pfrom           The node which is sending the message.
+    * @param[in]   msg_type        The type of the message.
+    * @param[in]   prefix          The part of the payload received so far.
+    */
+    PartialMessageCheck CheckPartialMessage(CNode* pfrom, const std::string& msg_type, const std::vector<unsigned char>& prefix) override;
+    /**
     * Send queued protocol messages to be sent to a give node.
     *
     * @param[in]   pto             The node which we are sending messages to.
@@ -10,8 +10,21 @@
 #include <uint256.h>
 
 #include <cstdint>
+#include <memory>
 
+class CBlockIndex;
 class CCoinsView;
+class CCoinsViewCursor;
+class COutPoint;
+class CScript;
+class Coin;
+class MuHash3072;
+
+enum class CoinStatsHashType {
+    HASH_SERIALIZED,
+    MUHASH,
+    NONE,
+};
 
 struct CCoinsStats
 {
@@ -20,15 +33,33 @@ struct CCoinsStats
     uint64_t nTransactions{0};
     uint64_t nTransactionOutputs{0};
     uint64_t nBogoSize{0};
+    //! hash_serialized_2 or MuHash of the set, depending on the hash type.
     uint256 hashSerialized{};
     uint64_t nDiskSize{0};
     CAmount nTotalAmount{0};
 
     //! The number of coins contained.
     uint64_t coins_count{0};
+
+    //! Whether the statistics were read from the coinstats index, which has
+    //! no transaction count, coin count or disk size.
+    bool index_used{false};
 };
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+/**
+ * Calculate statistics about the unspent transaction output set. A MuHash
+ * or no hash is read from the coinstats index when it is enabled, for the
+ * best block of the view or pindex. Otherwise the set is read through
+ * cursor, or a new cursor of the view, and false is returned if it is not
+ * at a known block, as during a partial write of the coins database.
+ */
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED, const CBlockIndex* pindex = nullptr, std::unique_ptr<CCoinsViewCursor> cursor = nullptr);
+
+//! Size of a coin in the bogosize metric.
+uint64_t GetBogoSize(const CScript& script_pub_key);
+
+//! Add a coin to, or remove it from, the MuHash of a set of coins.
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
 
 #endif // ELCASH_NODE_COINSTATS_H
@@ -8,8 +8,12 @@
 #include <arith_uint256.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <uint256.h>
 
+#include <unordered_map>
+#include <vector>
+
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     assert(pindexLast != nullptr);
@@ -79,7 +83,7 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&
 // Algorithm by Zawy, a modification of WT-144 by Tom Harding
 // https://github.com/zawy12/difficulty-algorithms/issues/3#issuecomment-442129791
 
-unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params)
+unsigned int LwmaCalculateNextWorkRequiredFull(const CBlockIndex* pindexLast, const Consensus::Params& params)
 {
     const int64_t T = params.nPowTargetSpacing;
 
@@ -134,4 +138,143 @@ unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const
     if (nextTarget > powLimit) { nextTarget = powLimit; }
 
     return nextTarget.GetCompact();
-} 
+}
+
+namespace {
+
+/**
+ * Running sums of the LWMA window ending at the block at height h, so that the
+ * window of its child can be derived in O(1) instead of walking all N blocks
+ * again. k is N * (N + 1) * T / 2 as in LwmaCalculateNextWorkRequiredFull.
+ */
+struct LwmaWindow
+{
+    //! Hash of the block the window ends at; commits to every block in the window
+    uint256 hashBlock;
+    //! N the sums were computed for
+    int64_t nWindow;
+    //! Sum of target / N / k over the blocks at heights h-N+1 .. h
+    arith_uint256 sumTargets;
+    //! Sum of the timestamps of the blocks at heights h-N .. h-1
+    int64_t sumTimestamps;
+    //! Number of blocks at heights h-N+1 .. h whose time is not above their parent's
+    int nNonIncreasing;
+};
+
+/** Windows are looked up by the block they end at. Small, as only the tip and headers being synced need it. */
+static const size_t LWMA_CACHE_MAX_ENTRIES = 2048;
+
+Mutex g_lwma_mutex;
+std::unordered_map<const CBlockIndex*, LwmaWindow> g_lwma_cache GUARDED_BY(g_lwma_mutex);
+
+arith_uint256 LwmaTargetTerm(const CBlockIndex* pindex, int64_t N, int64_t k)
+{
+    arith_uint256 target;
+    target.SetCompact(pindex->nBits);
+    return target / N / k;
+}
+
+/** Compute the window ending at pindexLast by walking its last N+1 blocks. */
+void LwmaComputeWindow(const CBlockIndex* pindexLast, int64_t N, int64_t k, LwmaWindow& window)
+{
+    window.hashBlock = pindexLast->GetBlockHash();
+    window.nWindow = N;
+    window.sumTargets = 0;
+    window.sumTimestamps = 0;
+    window.nNonIncreasing = 0;
+
+    const CBlockIndex* pindex = pindexLast;
+    for (int64_t i = 0; i < N; i++) {
+        window.sumTargets += LwmaTargetTerm(pindex, N, k);
+        window.sumTimestamps += pindex->pprev->GetBlockTime();
+        if (pindex->GetBlockTime() <= pindex->pprev->GetBlockTime())
+            window.nNonIncreasing++;
+        pindex = pindex->pprev;
+    }
+}
+
+/** Slide the window ending at pindexLast->pprev forward by one block. */
+void LwmaAdvanceWindow(const CBlockIndex* pindexLast, int64_t N, int64_t k, const LwmaWindow& prev, LwmaWindow& window)
+{
+    const CBlockIndex* pindexDrop = pindexLast->GetAncestor(pindexLast->nHeight - N);
+
+    window.hashBlock = pindexLast->GetBlockHash();
+    window.nWindow = N;
+    window.sumTargets = prev.sumTargets - LwmaTargetTerm(pindexDrop, N, k) + LwmaTargetTerm(pindexLast, N, k);
+    window.sumTimestamps = prev.sumTimestamps - pindexDrop->pprev->GetBlockTime() + pindexLast->pprev->GetBlockTime();
+    window.nNonIncreasing = prev.nNonIncreasing;
+    if (pindexDrop->GetBlockTime() <= pindexDrop->pprev->GetBlockTime())
+        window.nNonIncreasing--;
+    if (pindexLast->GetBlockTime() <= pindexLast->pprev->GetBlockTime())
+        window.nNonIncreasing++;
+}
+
+/** The weighted solvetime sum of the window, with the same clamping of non-increasing timestamps as the full loop. */
+int64_t LwmaWeightedSolvetimes(const CBlockIndex* pindexLast, int64_t N, const LwmaWindow& window)
+{
+    // Without out-of-order timestamps every solvetime is the plain time
+    // difference, and the weighted sum telescopes to N * t(h) - sum(t(h-N .. h-1)).
+    if (window.nNonIncreasing == 0)
+        return N * pindexLast->GetBlockTime() - window.sumTimestamps;
+
+    std::vector<int64_t> vTimestamps(N + 1);
+    const CBlockIndex* pindex = pindexLast;
+    for (int64_t i = N; i >= 0; i--) {
+        vTimestamps[i] = pindex->GetBlockTime();
+        pindex = pindex->pprev;
+    }
+
+    int64_t previousTimestamp = vTimestamps[0];
+    int64_t sumWeightedSolvetimes = 0;
+    for (int64_t j = 1; j <= N; j++) {
+        const int64_t thisTimestamp = (vTimestamps[j] > previousTimestamp) ? vTimestamps[j] : previousTimestamp + 1;
+        sumWeightedSolvetimes += (thisTimestamp - previousTimestamp) * j;
+        previousTimestamp = thisTimestamp;
+    }
+    return sumWeightedSolvetimes;
+}
+
+} // namespace
+
+unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    const int64_t T = params.nPowTargetSpacing;
+    const int64_t N = params.nLwmaAveragingWindow;
+    const int64_t k = N * (N + 1) * T / 2;
+    const arith_uint256 powLimit = UintToArith256(params.powLimit);
+
+    if (pindexLast->nHeight < N) { return powLimit.GetCompact(); }
+
+    // Block indexes without a hash cannot be told apart in the cache
+    if (pindexLast->phashBlock == nullptr)
+        return LwmaCalculateNextWorkRequiredFull(pindexLast, params);
+
+    LwmaWindow window;
+    {
+        LOCK(g_lwma_mutex);
+        auto it = g_lwma_cache.find(pindexLast);
+        if (it != g_lwma_cache.end() && it->second.nWindow == N && it->second.hashBlock == pindexLast->GetBlockHash()) {
+            window = it->second;
+        } else {
+            auto itPrev = pindexLast->pprev->nHeight >= N ? g_lwma_cache.find(pindexLast->pprev) : g_lwma_cache.end();
+            if (itPrev != g_lwma_cache.end() && itPrev->second.nWindow == N && itPrev->second.hashBlock == pindexLast->pprev->GetBlockHash()) {
+                LwmaAdvanceWindow(pindexLast, N, k, itPrev->second, window);
+            } else {
+                LwmaComputeWindow(pindexLast, N, k, window);
+            }
+            if (g_lwma_cache.size() >= LWMA_CACHE_MAX_ENTRIES)
+                g_lwma_cache.clear();
+            g_lwma_cache[pindexLast] = window;
+        }
+    }
+
+    const int64_t sumWeightedSolvetimes = LwmaWeightedSolvetimes(pindexLast, N, window);
+    arith_uint256 nextTarget = window.sumTargets * sumWeightedSolvetimes;
+    if (nextTarget > powLimit) { nextTarget = powLimit; }
+
+#ifdef DEBUG
+    assert(nextTarget.GetCompact() == LwmaCalculateNextWorkRequiredFull(pindexLast, params));
+#endif
+
+    return nextTarget.GetCompact();
+}
@@ -0,0 +1,290 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/blockview.h>
+
+#include <crypto/common.h>
+#include <hash.h>
+#include <serialize.h>
+#include <streams.h>
+#include <version.h>
+
+#include <assert.h>
+#include <limits>
+#include <new>
+#include <string.h>
+
+struct CBlockView::Counts {
+    size_t txs{0};
+    size_t inputs{0};
+    size_t outputs{0};
+    size_t witness{0};
+};
+
+namespace {
+
+/** Bounds-checked reader over the serialized block, following the rules of serialize.h. */
+class Cursor
+{
+    const std::vector<unsigned char>& m_data;
+
+public:
+    size_t m_pos;
+
+    Cursor(const std::vector<unsigned char>& data, size_t pos) : m_data(data), m_pos(pos) {}
+
+    const unsigned char* Here() const { return m_data.data() + m_pos; }
+
+    bool Skip(uint64_t size)
+    {
+        if (m_data.size() - m_pos < size) return false;
+        m_pos += size;
+        return true;
+    }
+
+    bool ReadByte(unsigned char& b)
+    {
+        if (m_pos >= m_data.size()) return false;
+        b = m_data[m_pos++];
+        return true;
+    }
+
+    bool Read32(uint32_t& n)
+    {
+        if (m_data.size() - m_pos < 4) return false;
+        n = ReadLE32(Here());
+        m_pos += 4;
+        return true;
+    }
+
+    bool Read64(uint64_t& n)
+    {
+        if (m_data.size() - m_pos < 8) return false;
+        n = ReadLE64(Here());
+        m_pos += 8;
+        return true;
+    }
+
+    bool ReadCompactSize(uint64_t& n)
+    {
+        unsigned char size;
+        if (!ReadByte(size)) return false;
+        if (size < 253) {
+            n = size;
+        } else if (size == 253) {
+            if (m_data.size() - m_pos < 2) return false;
+            n = ReadLE16(Here());
+            m_pos += 2;
+            if (n < 253) return false;
+        } else if (size == 254) {
+            uint32_t n32;
+            if (!Read32(n32)) return false;
+            n = n32;
+            if (n < 0x10000u) return false;
+        } else {
+            if (!Read64(n)) return false;
+            if (n < 0x100000000ULL) return false;
+        }
+        return n <= MAX_SIZE;
+    }
+
+    //! Read a length-prefixed byte string without copying it.
+    bool ReadBytes(CBlockView::Bytes& bytes)
+    {
+        uint64_t size;
+        if (!ReadCompactSize(size)) return false;
+        const unsigned char* begin = Here();
+        if (!Skip(size)) return false;
+        bytes = CBlockView::Bytes(begin, size);
+        return true;
+    }
+};
+
+size_t AlignUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+COutPoint CBlockView::TxIn::GetPrevout() const
+{
+    uint256 hash;
+    memcpy(hash.begin(), prevout, 32);
+    return COutPoint(hash, ReadLE32(prevout + 32));
+}
+
+/**
+ * Walk the transactions of the block. The first pass only counts the records
+ * and checks the data; the second one writes them to the arena, which was
+ * sized from those counts.
+ */
+template <bool fill>
+bool CBlockView::Parse(size_t pos, Counts& counts)
+{
+    Cursor cursor(m_data, pos);
+
+    uint64_t tx_count;
+    if (!cursor.ReadCompactSize(tx_count)) return false;
+    for (uint64_t i = 0; i < tx_count; ++i) {
+        Tx tx;
+        tx.offset = cursor.m_pos;
+        uint32_t version;
+        if (!cursor.Read32(version)) return false;
+        tx.version = version;
+        tx.vin_begin = counts.inputs;
+        tx.vout_begin = counts.outputs;
+
+        // Same layout rules as UnserializeTransaction: an empty input vector
+        // is either a transaction without inputs or the segwit marker.
+        unsigned char flags = 0;
+        size_t stripped_begin = cursor.m_pos;
+        uint64_t vin_count;
+        uint64_t vout_count = 0;
+        if (!cursor.ReadCompactSize(vin_count)) return false;
+        bool read_outputs = true;
+        if (vin_count == 0) {
+            if (!cursor.ReadByte(flags)) return false;
+            if (flags != 0) {
+                stripped_begin = cursor.m_pos;
+                if (!cursor.ReadCompactSize(vin_count)) return false;
+            } else {
+                read_outputs = false;
+            }
+        }
+        for (uint64_t j = 0; j < vin_count; ++j) {
+            TxIn txin;
+            txin.prevout = cursor.Here();
+            if (!cursor.Skip(36)) return false;
+            if (!cursor.ReadBytes(txin.script_sig)) return false;
+            if (!cursor.Read32(txin.sequence)) return false;
+            txin.witness_begin = counts.witness;
+            txin.witness_count = 0;
+            if (fill) new (&m_inputs[counts.inputs]) TxIn(txin);
+            ++counts.inputs;
+        }
+        if (read_outputs) {
+            if (!cursor.ReadCompactSize(vout_count)) return false;
+            for (uint64_t j = 0; j < vout_count; ++j) {
+                TxOut txout;
+                uint64_t value;
+                if (!cursor.Read64(value)) return false;
+                txout.value = (CAmount)value;
+                if (!cursor.ReadBytes(txout.script_pubkey)) return false;
+                if (fill) new (&m_outputs[counts.outputs]) TxOut(txout);
+                ++counts.outputs;
+            }
+        }
+        tx.stripped_offset = stripped_begin;
+        tx.stripped_size = cursor.m_pos - stripped_begin;
+        tx.vin_count = vin_count;
+        tx.vout_count = vout_count;
+
+        tx.has_witness = false;
+        if (flags & 1) {
+            flags ^= 1;
+            for (uint64_t j = 0; j < vin_count; ++j) {
+                uint64_t stack_size;
+                if (!cursor.ReadCompactSize(stack_size)) return false;
+                if (fill) {
+                    m_inputs[tx.vin_begin + j].witness_begin = counts.witness;
+                    m_inputs[tx.vin_begin + j].witness_count = stack_size;
+                }
+                for (uint64_t k = 0; k < stack_size; ++k) {
+                    Bytes item;
+                    if (!cursor.ReadBytes(item)) return false;
+                    if (fill) new (&m_witness[counts.witness]) Bytes(item);
+                    ++counts.witness;
+                }
+                tx.has_witness |= stack_size > 0;
+            }
+            // It's illegal to encode witnesses when all witness stacks are empty.
+            if (!tx.has_witness) return false;
+        }
+        if (flags) return false;
+        if (!cursor.Read32(tx.locktime)) return false;
+        tx.size = cursor.m_pos - tx.offset;
+
+        if (fill) new (&m_txs[counts.txs]) Tx(tx);
+        ++counts.txs;
+    }
+    return cursor.m_pos == m_data.size();
+}
+
+bool CBlockView::Decode(std::vector<unsigned char> data)
+{
+    m_data = std::move(data);
+    m_arena.reset();
+    m_arena_size = 0;
+    m_txs = nullptr;
+    m_inputs = nullptr;
+    m_outputs = nullptr;
+    m_witness = nullptr;
+    m_tx_count = 0;
+    if (m_data.size() > std::numeric_limits<uint32_t>::max()) return false;
+
+    try {
+        VectorReader reader(SER_NETWORK, PROTOCOL_VERSION, m_data, 0);
+        reader >> m_header;
+        m_header_size = m_data.size() - reader.size();
+    } catch (const std::ios_base::failure&) {
+        return false;
+    }
+
+    Counts counts;
+    if (!Parse<false>(m_header_size, counts)) return false;
+
+    const size_t inputs_offset = AlignUp(counts.txs * sizeof(Tx), alignof(TxIn));
+    const size_t outputs_offset = AlignUp(inputs_offset + counts.inputs * sizeof(TxIn), alignof(TxOut));
+    const size_t witness_offset = AlignUp(outputs_offset + counts.outputs * sizeof(TxOut), alignof(Bytes));
+    m_arena_size = witness_offset + counts.witness * sizeof(Bytes);
+    m_arena.reset(new unsigned char[m_arena_size]);
+    m_txs = reinterpret_cast<Tx*>(m_arena.get());
+    m_inputs = reinterpret_cast<TxIn*>(m_arena.get() + inputs_offset);
+    m_outputs = reinterpret_cast<TxOut*>(m_arena.get() + outputs_offset);
+    m_witness = reinterpret_cast<Bytes*>(m_arena.get() + witness_offset);
+
+    Counts filled;
+    bool parsed = Parse<true>(m_header_size, filled);
+    assert(parsed && filled.txs == counts.txs && filled.inputs == counts.inputs &&
+           filled.outputs == counts.outputs && filled.witness == counts.witness);
+    m_tx_count = counts.txs;
+    return true;
+}
+
+uint256 CBlockView::GetTxHash(const Tx& tx) const
+{
+    const char* begin = reinterpret_cast<const char*>(m_data.data());
+    CHashWriter ss(SER_GETHASH, 0);
+    ss.write(begin + tx.offset, 4);
+    ss.write(begin + tx.stripped_offset, tx.stripped_size);
+    ss.write(begin + tx.offset + tx.size - 4, 4);
+    return ss.GetHash();
+}
+
+uint256 CBlockView::GetWitnessHash(const Tx& tx) const
+{
+    if (!tx.has_witness) return GetTxHash(tx);
+    CHashWriter ss(SER_GETHASH, 0);
+    ss.write(reinterpret_cast<const char*>(m_data.data()) + tx.offset, tx.size);
+    return ss.GetHash();
+}
+
+CBlock CBlockView::ToBlock() const
+{
+    CBlock block(m_header);
+    block.vtx.reserve(m_tx_count);
+    for (const Tx& tx : Transactions()) {
+        block.vtx.push_back(ToTransaction(tx));
+    }
+    return block;
+}
+
+CTransactionRef CBlockView::ToTransaction(const Tx& tx) const
+{
+    VectorReader reader(SER_NETWORK, PROTOCOL_VERSION, m_data, tx.offset);
+    CMutableTransaction mtx;
+    reader >> mtx;
+    return MakeTransactionRef(std::move(mtx));
+}
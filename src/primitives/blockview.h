@@ -0,0 +1,116 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ELCASH_PRIMITIVES_BLOCKVIEW_H
+#define ELCASH_PRIMITIVES_BLOCKVIEW_H
+
+#include <amount.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Read-only view of a serialized block.
+ *
+ * Decoding keeps the serialized block and describes its transactions,
+ * inputs, outputs and witness items with fixed-size records that point into
+ * it, all held in a single allocation sized in a first pass over the data.
+ * Scripts and witness items are never copied, which makes the view much
+ * cheaper to build than a CBlock when only the layout, the hashes or the
+ * scripts of the transactions are needed. ToTransaction() builds a full
+ * CTransaction for the code that needs one.
+ */
+class CBlockView
+{
+public:
+    typedef Span<const unsigned char> Bytes;
+
+    struct TxIn {
+        //! Start of the serialized prevout (txid, then index).
+        const unsigned char* prevout;
+        Bytes script_sig;
+        uint32_t sequence;
+        //! Range of this input's witness stack in the witness items.
+        uint32_t witness_begin;
+        uint32_t witness_count;
+
+        COutPoint GetPrevout() const;
+    };
+
+    struct TxOut {
+        CAmount value;
+        Bytes script_pubkey;
+    };
+
+    struct Tx {
+        int32_t version;
+        uint32_t locktime;
+        //! Position and size of the transaction in Raw().
+        uint32_t offset;
+        uint32_t size;
+        //! Position and size of the inputs and outputs in Raw(), which is what
+        //! the txid commits to besides the version and the locktime.
+        uint32_t stripped_offset;
+        uint32_t stripped_size;
+        uint32_t vin_begin;
+        uint32_t vin_count;
+        uint32_t vout_begin;
+        uint32_t vout_count;
+        bool has_witness;
+    };
+
+    CBlockView() = default;
+    CBlockView(const CBlockView&) = delete;
+    CBlockView& operator=(const CBlockView&) = delete;
+
+    /**
+     * Decode a block serialized with witness data. Returns false if the
+     * data is truncated, malformed or followed by extra bytes.
+     */
+    bool Decode(std::vector<unsigned char> data);
+
+    const CBlockHeader& GetHeader() const { return m_header; }
+    uint256 GetHash() const { return m_header.GetHash(); }
+    //! Size of the serialized header, auxpow included.
+    uint32_t HeaderSize() const { return m_header_size; }
+    Bytes Raw() const { return Bytes(m_data.data(), m_data.size()); }
+
+    Span<const Tx> Transactions() const { return Span<const Tx>(m_txs, m_tx_count); }
+    Span<const TxIn> Inputs(const Tx& tx) const { return Span<const TxIn>(m_inputs + tx.vin_begin, tx.vin_count); }
+    Span<const TxOut> Outputs(const Tx& tx) const { return Span<const TxOut>(m_outputs + tx.vout_begin, tx.vout_count); }
+    Span<const Bytes> Witness(const TxIn& txin) const { return Span<const Bytes>(m_witness + txin.witness_begin, txin.witness_count); }
+
+    uint256 GetTxHash(const Tx& tx) const;
+    uint256 GetWitnessHash(const Tx& tx) const;
+    CTransactionRef ToTransaction(const Tx& tx) const;
+    CBlock ToBlock() const;
+
+    //! Bytes used by the records, all in a single allocation.
+    size_t ArenaBytes() const { return m_arena_size; }
+
+private:
+    struct Counts;
+
+    template <bool fill>
+    bool Parse(size_t pos, Counts& counts);
+
+    std::vector<unsigned char> m_data;
+    CBlockHeader m_header;
+    uint32_t m_header_size{0};
+
+    std::unique_ptr<unsigned char[]> m_arena;
+    size_t m_arena_size{0};
+    Tx* m_txs{nullptr};
+    TxIn* m_inputs{nullptr};
+    TxOut* m_outputs{nullptr};
+    Bytes* m_witness{nullptr};
+    size_t m_tx_count{0};
+};
+
+#endif // ELCASH_PRIMITIVES_BLOCKVIEW_H
@@ -7,15 +7,21 @@
 #include <arith_uint256.h>
 #include <auxpow.h>
 #include <chainparams.h>
+#include <core_memusage.h>
 #include <net.h>
 #include <rpc/blockchain.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <util/strencodings.h>
+#include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <functional>
+#include <set>
 
 namespace {
 	void auxMiningCheck(const JSONRPCRequest& request) {
@@ -33,46 +39,47 @@ namespace {
 	}
 }  // anonymous namespace
 
+AuxpowMiner::AuxpowMiner()
+	: maxTemplatesUsage(std::max<int64_t>(0, gArgs.GetArg("-auxpowtemplatecache", DEFAULT_AUXPOW_TEMPLATE_CACHE_SIZE)) << 20) {
+}
+
+AuxpowMiner::~AuxpowMiner() {
+	stopBuilder();
+}
+
 const CBlock* AuxpowMiner::getCurrentBlock(const CTxMemPool& mempool, const CScript& scriptPubKey,
 		uint256& target) {
 	AssertLockHeld(cs);
 	const CBlock* pblockCur = nullptr;
 
-	{
-		LOCK(cs_main);
-		CScriptID scriptID(scriptPubKey);
-		auto iter = curBlocks.find(scriptID);
-		if (iter != curBlocks.end())
-			pblockCur = iter->second;
+	const CScriptID scriptID(scriptPubKey);
+	auto iter = curBlocks.find(scriptID);
+	if (iter != curBlocks.end()) {
+		/* Mark the block as the most recently used one.  */
+		templates.splice(templates.begin(), templates, iter->second);
+		pblockCur = iter->second->block.get();
+	}
+
+	/* While the builder is running, it replaces the current blocks as soon as
+	 the tip or the mempool changes.  A block building on the last notified
+	 tip can then be handed out without looking at the chain.  */
+	bool fPrebuilt = false;
+	if (pblockCur != nullptr) {
+		LOCK(csNotify);
+		fPrebuilt = fBuilderRunning && pindexPrev == notifiedTip;
+	}
 
+	if (!fPrebuilt) {
+		LOCK(cs_main);
 		if (pblockCur == nullptr || pindexPrev != ::ChainActive().Tip()
 		|| (mempool.GetTransactionsUpdated() != txUpdatedLast && GetTime() - startTime > 60)) {
-			if (pindexPrev != ::ChainActive().Tip()) {
-				/* Clear old blocks since they're obsolete now. */
-				blocks.clear();
-				templates.clear();
-				curBlocks.clear();
-			}
-
 			/* Create new block with nonce = 0 and extraNonce = 1. */
+			const unsigned txUpdated = mempool.GetTransactionsUpdated();
 			std::unique_ptr<CBlockTemplate> newBlock = BlockAssembler(EnsureMemPool(), Params()).CreateNewBlock(scriptPubKey);
 			if (newBlock == nullptr)
 				throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
 
-			/* Update state only when CreateNewBlock succeeded.  */
-			txUpdatedLast = mempool.GetTransactionsUpdated();
-			pindexPrev = ::ChainActive().Tip();
-			startTime = GetTime();
-
-			/* Finalise it by setting the version and building the merkle root.  */
-			IncrementExtraNonce(&newBlock->block, pindexPrev, extraNonce);
-			newBlock->block.SetBlockHeaderVersion(true);
-
-			/* Save in our map of constructed blocks.  */
-			pblockCur = &newBlock->block;
-			curBlocks[scriptID] = pblockCur;
-			blocks[pblockCur->GetHash()] = pblockCur;
-			templates.push_back(std::move(newBlock));
+			pblockCur = addBlock(std::move(newBlock), scriptID, txUpdated);
 		}
 	}
 
@@ -93,6 +100,175 @@ const CBlock* AuxpowMiner::getCurrentBlock(const CTxMemPool& mempool, const CScr
 	return pblockCur;
 }
 
+const CBlock* AuxpowMiner::addBlock(std::unique_ptr<CBlockTemplate> newBlock, const CScriptID& scriptID,
+		unsigned txUpdated) {
+	AssertLockHeld(cs);
+	AssertLockHeld(cs_main);
+
+	const CBlockIndex* tip = ::ChainActive().Tip();
+	if (newBlock->block.hashPrevBlock != tip->GetBlockHash())
+		return nullptr;
+
+	if (pindexPrev != tip) {
+		/* Clear old blocks since they're obsolete now. */
+		blocks.clear();
+		curBlocks.clear();
+		templates.clear();
+		templatesUsage = 0;
+	}
+
+	txUpdatedLast = txUpdated;
+	pindexPrev = tip;
+	startTime = GetTime();
+
+	/* Finalise it by setting the version and building the merkle root.  */
+	IncrementExtraNonce(&newBlock->block, pindexPrev, extraNonce);
+	newBlock->block.SetBlockHeaderVersion(true);
+
+	/* Save in our map of constructed blocks.  Only the block itself is
+	 kept, its transactions are shared with the mempool and with the
+	 other blocks.  The usage counts them for each block nevertheless,
+	 since they stay alive here after leaving the mempool.  */
+	std::shared_ptr<CBlock> block = std::make_shared<CBlock>(std::move(newBlock->block));
+	const size_t usage = RecursiveDynamicUsage(*block);
+	templates.push_front(CachedBlock{block, scriptID, usage});
+	templatesUsage += usage;
+	curBlocks[scriptID] = templates.begin();
+	blocks[block->GetHash()] = templates.begin();
+
+	evictTemplates();
+
+	{
+		LOCK(csNotify);
+		++nNotifications;
+	}
+	cvNotify.notify_all();
+
+	return block.get();
+}
+
+void AuxpowMiner::startBuilder(CTxMemPool& pool) {
+	const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+	{
+		LOCK(csNotify);
+		if (fBuilderRunning)
+			return;
+		builderPool = &pool;
+		notifiedTip = tip;
+		fBuilderRunning = true;
+		fStopBuilder = false;
+	}
+
+	RegisterValidationInterface(this);
+	builderThread = std::thread(&TraceThread<std::function<void()>>, "auxpowbuild",
+			std::function<void()>(std::bind(&AuxpowMiner::threadBuilder, this)));
+}
+
+void AuxpowMiner::stopBuilder() {
+	{
+		LOCK(csNotify);
+		if (!fBuilderRunning)
+			return;
+		fStopBuilder = true;
+	}
+	cvNotify.notify_all();
+
+	UnregisterValidationInterface(this);
+	if (builderThread.joinable())
+		builderThread.join();
+
+	LOCK(csNotify);
+	fBuilderRunning = false;
+}
+
+void AuxpowMiner::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) {
+	{
+		LOCK(csNotify);
+		notifiedTip = pindexNew;
+		/* During initial download, blocks are built on demand only.  */
+		if (!fInitialDownload)
+			fTipChanged = true;
+		++nNotifications;
+	}
+	cvNotify.notify_all();
+}
+
+void AuxpowMiner::TransactionAddedToMempool(const CTransactionRef& tx) {
+	LOCK(csNotify);
+	fMempoolChanged = true;
+}
+
+void AuxpowMiner::threadBuilder() {
+	while (true) {
+		bool fTip, fMempool;
+		{
+			WAIT_LOCK(csNotify, lock);
+			cvNotify.wait_for(lock, std::chrono::seconds(1), [this]() EXCLUSIVE_LOCKS_REQUIRED(csNotify) {
+				return fStopBuilder || fTipChanged;
+			});
+			if (fStopBuilder)
+				return;
+			fTip = fTipChanged;
+			fMempool = fMempoolChanged;
+		}
+
+		/* New transactions are picked up with the same delay as for blocks
+		 that are constructed on demand.  */
+		std::vector<std::pair<CScriptID, CScript>> scripts;
+		{
+			LOCK(cs);
+			if (!fTip && !(fMempool && GetTime() - startTime > 60))
+				continue;
+
+			const int64_t now = GetTime();
+			for (auto it = activeScripts.begin(); it != activeScripts.end(); ) {
+				if (now - it->second.lastRequest > AUXPOW_PREBUILD_SCRIPT_EXPIRY) {
+					it = activeScripts.erase(it);
+				} else {
+					scripts.emplace_back(it->first, it->second.script);
+					++it;
+				}
+			}
+		}
+
+		{
+			LOCK(csNotify);
+			fTipChanged = false;
+			fMempoolChanged = false;
+		}
+
+		for (const auto& entry : scripts) {
+			if (WITH_LOCK(csNotify, return fStopBuilder))
+				return;
+
+			/* Skip scripts for which a block on the new tip was already
+			 constructed on demand in the meantime.  */
+			if (!fMempool) {
+				LOCK2(cs, cs_main);
+				const auto cur = curBlocks.find(entry.first);
+				if (cur != curBlocks.end() && cur->second->block->hashPrevBlock == ::ChainActive().Tip()->GetBlockHash())
+					continue;
+			}
+
+			/* The block is constructed without holding cs, so that
+			 createauxblock calls can still be answered from the cache.  */
+			const unsigned txUpdated = builderPool->GetTransactionsUpdated();
+			std::unique_ptr<CBlockTemplate> newBlock;
+			try {
+				newBlock = BlockAssembler(*builderPool, Params()).CreateNewBlock(entry.second);
+			} catch (const std::runtime_error& e) {
+				LogPrintf("%s: failed to construct block: %s\n", __func__, e.what());
+				continue;
+			}
+			if (newBlock == nullptr)
+				continue;
+
+			LOCK2(cs, cs_main);
+			addBlock(std::move(newBlock), entry.first, txUpdated);
+		}
+	}
+}
+
 const CBlock* AuxpowMiner::lookupSavedBlock(const std::string& hashHex) const {
 	AssertLockHeld(cs);
 
@@ -103,27 +279,107 @@ const CBlock* AuxpowMiner::lookupSavedBlock(const std::string& hashHex) const {
 	if (iter == blocks.end())
 		throw JSONRPCError(RPC_INVALID_PARAMETER, "block hash unknown");
 
-	return iter->second;
+	return iter->second->block.get();
 }
 
-UniValue AuxpowMiner::createAuxBlock(const JSONRPCRequest& request, const CScript& scriptPubKey) {
-	auxMiningCheck(request);
-	LOCK(cs);
+void AuxpowMiner::evictTemplates() {
+	AssertLockHeld(cs);
+
+	for (const bool evictCurrent : {false, true}) {
+		auto it = templates.end();
+		while (templatesUsage > maxTemplatesUsage && it != templates.begin()) {
+			--it;
+			if (it == templates.begin())
+				break;
+
+			const auto cur = curBlocks.find(it->scriptID);
+			if (!evictCurrent && cur != curBlocks.end() && cur->second == it)
+				continue;
+
+			CachedBlockIter victim = it++;
+			eraseTemplate(victim);
+			++evictedTemplates;
+		}
+	}
+}
+
+void AuxpowMiner::eraseTemplate(CachedBlockIter it) {
+	AssertLockHeld(cs);
+
+	blocks.erase(it->block->GetHash());
+	const auto cur = curBlocks.find(it->scriptID);
+	if (cur != curBlocks.end() && cur->second == it)
+		curBlocks.erase(cur);
+	templatesUsage -= it->usage;
+	templates.erase(it);
+}
 
-	uint256 target;
-	const CBlock* pblock = getCurrentBlock(mempool, scriptPubKey, target);
+UniValue AuxpowMiner::getTemplateCacheInfo() const {
+	LOCK(cs);
 
 	UniValue result(UniValue::VOBJ);
-	result.pushKV("hash", pblock->GetHash().GetHex());
-	result.pushKV("chainid", pblock->GetChainId());
-	result.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
-	result.pushKV("coinbasevalue", static_cast<int64_t>(pblock->vtx[0]->vout[0].nValue));
-	result.pushKV("bits", strprintf("%08x", pblock->nBits));
-	result.pushKV("height", static_cast<int64_t>(pindexPrev->nHeight + 1));
+	result.pushKV("blocks", static_cast<uint64_t>(templates.size()));
+	result.pushKV("scripts", static_cast<uint64_t>(curBlocks.size()));
+	result.pushKV("usage", static_cast<uint64_t>(templatesUsage));
+	result.pushKV("maxusage", static_cast<uint64_t>(maxTemplatesUsage));
+	result.pushKV("evicted", evictedTemplates);
 
 	return result;
 }
 
+UniValue AuxpowMiner::createAuxBlock(const JSONRPCRequest& request, const CScript& scriptPubKey,
+		const std::string& longpollid) {
+	auxMiningCheck(request);
+
+	const CScriptID scriptID(scriptPubKey);
+	while (true) {
+		uint64_t nNotificationsStart;
+		bool fRegister;
+		{
+			LOCK(csNotify);
+			nNotificationsStart = nNotifications;
+			fRegister = fBuilderRunning;
+		}
+
+		{
+			LOCK(cs);
+			if (fRegister)
+				activeScripts[scriptID] = ActiveScript{scriptPubKey, GetTime()};
+
+			uint256 target;
+			const CBlock* pblock = getCurrentBlock(mempool, scriptPubKey, target);
+			const std::string hashHex = pblock->GetHash().GetHex();
+
+			if (longpollid.empty() || hashHex != longpollid) {
+				UniValue result(UniValue::VOBJ);
+				result.pushKV("hash", hashHex);
+				result.pushKV("chainid", pblock->GetChainId());
+				result.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
+				result.pushKV("coinbasevalue", static_cast<int64_t>(pblock->vtx[0]->vout[0].nValue));
+				result.pushKV("bits", strprintf("%08x", pblock->nBits));
+				result.pushKV("height", static_cast<int64_t>(pindexPrev->nHeight + 1));
+				result.pushKV("longpollid", hashHex);
+
+				return result;
+			}
+		}
+
+		/* Wait for a new block or tip.  Time out now and then to check for
+		 shutdown and to let on-demand blocks pick up new transactions.  */
+		{
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+			WAIT_LOCK(csNotify, lock);
+			while (nNotifications == nNotificationsStart && IsRPCRunning()
+			&& std::chrono::steady_clock::now() < deadline) {
+				cvNotify.wait_for(lock, std::chrono::seconds(1));
+			}
+		}
+
+		if (!IsRPCRunning())
+			throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+	}
+}
+
 bool AuxpowMiner::submitAuxBlock (const JSONRPCRequest& request, const std::string& hashHex,
 		const std::string& auxheaderHex) const {
 	auxMiningCheck(request);
@@ -145,6 +401,82 @@ bool AuxpowMiner::submitAuxBlock (const JSONRPCRequest& request, const std::stri
 	return ProcessNewBlock(Params(), shared_block, true, nullptr);
 }
 
+UniValue AuxpowMiner::submitAuxBlocks(const JSONRPCRequest& request,
+		const std::vector<std::pair<uint256, std::vector<unsigned char>>>& proofs) {
+	auxMiningCheck(request);
+	const Consensus::Params& params = Params().GetConsensus();
+
+	/* Attach each proof to a copy of the header of its block.  Only the
+	 headers are checked, so the transactions are not needed for that.  */
+	std::vector<std::string> results(proofs.size());
+	std::vector<CBlockHeader> headers;
+	std::vector<size_t> indices;
+	{
+		LOCK(cs);
+		for (size_t i = 0; i < proofs.size(); ++i) {
+			const auto iter = blocks.find(proofs[i].first);
+			if (iter == blocks.end()) {
+				results[i] = "unknown";
+				continue;
+			}
+
+			std::unique_ptr<CAuxBlockHeader> auxHeader(new CAuxBlockHeader());
+			try {
+				CDataStream ss(proofs[i].second, SER_GETHASH, PROTOCOL_VERSION);
+				ss >> *auxHeader;
+			} catch (const std::exception&) {
+				results[i] = "invalid";
+				continue;
+			}
+
+			headers.push_back(iter->second->block->GetBlockHeader());
+			headers.back().SetAuxBlockHeader(std::move(auxHeader));
+			indices.push_back(i);
+		}
+	}
+
+	const std::vector<bool> valid = CheckProofOfWorkBatch(headers, params);
+
+	/* Take the block for the first valid proof out of the cache.  It is no
+	 longer needed there, so the auxpow can be attached to it directly.  */
+	std::vector<std::pair<size_t, std::shared_ptr<CBlock>>> toSubmit;
+	{
+		LOCK(cs);
+		std::set<uint256> taken;
+		for (size_t j = 0; j < headers.size(); ++j) {
+			const size_t i = indices[j];
+			if (!valid[j]) {
+				results[i] = "invalid";
+				continue;
+			}
+
+			const uint256 hash = headers[j].GetHash();
+			const auto iter = blocks.find(hash);
+			if (iter == blocks.end()) {
+				results[i] = taken.count(hash) ? "duplicate" : "unknown";
+				continue;
+			}
+
+			std::shared_ptr<CBlock> block = iter->second->block;
+			eraseTemplate(iter->second);
+			block->auxHeader = headers[j].auxHeader;
+			assert(block->GetHash() == hash);
+
+			taken.insert(hash);
+			toSubmit.emplace_back(i, std::move(block));
+		}
+	}
+
+	for (const auto& entry : toSubmit)
+		results[entry.first] = ProcessNewBlock(Params(), entry.second, true, nullptr) ? "accepted" : "rejected";
+
+	UniValue result(UniValue::VARR);
+	for (const std::string& res : results)
+		result.push_back(res);
+
+	return result;
+}
+
 AuxpowMiner& AuxpowMiner::get() {
 	static AuxpowMiner* instance = nullptr;
 	static RecursiveMutex lock;
@@ -12,14 +12,25 @@
 #include <txmempool.h>
 #include <uint256.h>
 #include <univalue.h>
+#include <validationinterface.h>
 
+#include <condition_variable>
+#include <list>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 class JSONRPCRequest;
 
+/** Default for -auxpowtemplatecache, the memory budget for cached auxpow blocks in MiB */
+static const int64_t DEFAULT_AUXPOW_TEMPLATE_CACHE_SIZE = 256;
+/** Default for -auxpowprebuild, whether blocks are constructed in the background */
+static const bool DEFAULT_AUXPOW_PREBUILD = true;
+/** Seconds after the last createauxblock call until a script is no longer prebuilt */
+static const int64_t AUXPOW_PREBUILD_SCRIPT_EXPIRY = 10 * 60;
+
 namespace auxpow_tests {
 	class AuxpowMinerForTest;
 }
@@ -31,18 +42,27 @@ namespace auxpow_tests {
  *
  * It is used as a singleton that is initialised during startup, taking the
  * place of the previously real global and static variables.
+ *
+ * When the builder is started, new blocks for all recently requested scripts
+ * are constructed on a background thread as soon as the tip or the mempool
+ * changes, so that createauxblock can return them without waiting for
+ * CreateNewBlock.
  */
-class AuxpowMiner
+class AuxpowMiner : public CValidationInterface
 {
 public:
-  AuxpowMiner () = default;
+  AuxpowMiner ();
+  ~AuxpowMiner ();
 
   /**
    * Performs the main work for the "createauxblock" RPC:  Construct a new block
    * to work on with the given address for the block reward and return the
    * necessary information for the miner to construct an auxpow for it.
+   * If longpollid is given, waits until a block with a different hash is
+   * available for the script.
    */
-  UniValue createAuxBlock(const JSONRPCRequest& request, const CScript& scriptPubKey);
+  UniValue createAuxBlock(const JSONRPCRequest& request, const CScript& scriptPubKey,
+		  const std::string& longpollid = "");
 
   /**
    * Performs the main work for the "submitauxblock" RPC:  Look up the block
@@ -53,20 +73,64 @@ public:
   bool submitAuxBlock(const JSONRPCRequest& request, const std::string& hashHex,
 		  const std::string& auxheaderHex) const;
 
+  /**
+   * Performs the main work for the "submitauxblocks" RPC:  Checks all given
+   * proofs in parallel and submits, for each block, the first one that is
+   * valid.  The submitted block is taken out of the cache instead of being
+   * copied.  Returns one result string per proof.
+   */
+  UniValue submitAuxBlocks(const JSONRPCRequest& request,
+		  const std::vector<std::pair<uint256, std::vector<unsigned char>>>& proofs);
+
+  /**
+   * Returns the size and memory usage of the cached blocks for the
+   * "getmininginfo" RPC.
+   */
+  UniValue getTemplateCacheInfo() const;
+
+  /**
+   * Starts the background thread that constructs blocks for the scripts
+   * requested through createauxblock.
+   */
+  void startBuilder(CTxMemPool& pool);
+
+  /** Stops the background thread, if it is running.  */
+  void stopBuilder();
+
   /**
    * Returns the singleton instance of AuxpowMiner that is used for RPCs.
    */
   static AuxpowMiner& get();
 
+protected:
+  void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+  void TransactionAddedToMempool(const CTransactionRef& tx) override;
+
 private:
+  /** A constructed block, together with the script it pays to.  */
+  struct CachedBlock {
+    /** The block.  Its transactions are shared with the mempool.  */
+    std::shared_ptr<CBlock> block;
+    CScriptID scriptID;
+    /** Memory usage of the block, as counted against the budget.  */
+    size_t usage;
+  };
+  typedef std::list<CachedBlock>::iterator CachedBlockIter;
+
   /** The lock used for state in this object.  */
   mutable RecursiveMutex cs;
-  /** All currently "active" block templates.  */
-  std::vector<std::unique_ptr<CBlockTemplate>> templates;
-  /** Maps block hashes to pointers in vTemplates.  Does not own the memory.  */
-  std::map<uint256, const CBlock*> blocks;
-  /** Maps coinbase script hashes to pointers in vTemplates.  Does not own the memory.  */
-  std::map<CScriptID, const CBlock*> curBlocks;
+  /** All currently "active" blocks, most recently handed out first.  */
+  std::list<CachedBlock> templates;
+  /** Maps block hashes to entries in templates.  */
+  std::map<uint256, CachedBlockIter> blocks;
+  /** Maps coinbase script hashes to their current entry in templates.  */
+  std::map<CScriptID, CachedBlockIter> curBlocks;
+
+  /** Memory usage of all blocks in templates, and the budget for it.  */
+  size_t templatesUsage = 0;
+  size_t maxTemplatesUsage;
+  /** Number of blocks dropped to stay within the budget.  */
+  uint64_t evictedTemplates = 0;
 
   /** The current extra nonce for block creation.  */
   unsigned extraNonce = 0;
@@ -74,7 +138,46 @@ private:
   /* Some data about when the current block (pblock) was constructed.  */
   unsigned txUpdatedLast;
   const CBlockIndex* pindexPrev = nullptr;
-  uint64_t startTime;
+  uint64_t startTime = 0;
+
+  /** A script that blocks are prebuilt for, and when it was last requested.  */
+  struct ActiveScript {
+    CScript script;
+    int64_t lastRequest;
+  };
+  /** Scripts for which the builder constructs blocks.  */
+  std::map<CScriptID, ActiveScript> activeScripts;
+
+  /** The mempool used by the builder, and its thread.  */
+  CTxMemPool* builderPool = nullptr;
+  std::thread builderThread;
+
+  /**
+   * Lock for the notification state below, taken after cs and cs_main.
+   * cvNotify is signalled when the tip or the mempool changes, when a new
+   * block has been added and when the builder should stop.
+   */
+  Mutex csNotify;
+  std::condition_variable cvNotify;
+  const CBlockIndex* notifiedTip GUARDED_BY(csNotify) = nullptr;
+  bool fTipChanged GUARDED_BY(csNotify) = false;
+  bool fMempoolChanged GUARDED_BY(csNotify) = false;
+  bool fBuilderRunning GUARDED_BY(csNotify) = false;
+  bool fStopBuilder GUARDED_BY(csNotify) = false;
+  /** Bumped whenever a block is added or the tip changes, so that
+   long-polling calls know when to look again.  */
+  uint64_t nNotifications GUARDED_BY(csNotify) = 0;
+
+  /** Main loop of the builder thread.  */
+  void threadBuilder();
+
+  /**
+   * Finalises a newly created block and adds it to the cache as the current
+   * block for its script.  Returns nullptr if the block does not build on
+   * the current tip any more.
+   */
+  const CBlock* addBlock(std::unique_ptr<CBlockTemplate> newBlock, const CScriptID& scriptID,
+		  unsigned txUpdated);
 
   /**
    * Constructs a new current block if necessary (checking the current state to
@@ -91,6 +194,16 @@ private:
    */
   const CBlock* lookupSavedBlock(const std::string& hashHex) const;
 
+  /**
+   * Drops blocks until the memory usage fits the budget again.  Blocks that
+   * are no longer current for their script go first, then the current ones of
+   * the least recently used scripts.  The most recent block is always kept.
+   */
+  void evictTemplates();
+
+  /** Removes a block from templates and the maps pointing to it.  */
+  void eraseTemplate(CachedBlockIter it);
+
   friend class auxpow_tests::AuxpowMinerForTest;
 };
 
@@ -10,10 +10,14 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <coins.h>
+#include <consensus/block_rewards.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/siphash.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
+#include <index/txindex.h>
 #include <node/coinstats.h>
 #include <node/context.h>
 #include <node/utxo_snapshot.h>
@@ -21,10 +25,12 @@
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <random.h>
 #include <rpc/rawtransaction.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <shutdown.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -35,6 +41,7 @@
 #include <validation.h>
 #include <validationinterface.h>
 #include <warnings.h>
+#include <workerpool.h>
 
 #include <stdint.h>
 
@@ -43,6 +50,7 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <unordered_set>
 
 struct CUpdatedBlock
 {
@@ -742,6 +750,46 @@ static UniValue getblockhash(const JSONRPCRequest& request)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+static UniValue getissuedsupply(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getissuedsupply",
+                "\nReturns the sum of the block rewards scheduled for all blocks up to and including the given height.\n"
+                "The value follows from the reward schedule alone, so it includes rewards not claimed by miners and\n"
+                "excludes transaction fees. The height may be above the current tip.\n",
+                {
+                    {"height", RPCArg::Type::NUM, /* default */ "current tip height", "The height index"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "height", "The height index"},
+                        {RPCResult::Type::STR_AMOUNT, "supply", "The issued supply in " + CURRENCY_UNIT},
+                        {RPCResult::Type::STR_AMOUNT, "blockreward", "The block reward at the height in " + CURRENCY_UNIT},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getissuedsupply", "")
+            + HelpExampleCli("getissuedsupply", "1000")
+            + HelpExampleRpc("getissuedsupply", "1000")
+                },
+            }.Check(request);
+
+    int nHeight;
+    if (request.params[0].isNull()) {
+        LOCK(cs_main);
+        nHeight = ::ChainActive().Height();
+    } else {
+        nHeight = request.params[0].get_int();
+        if (nHeight < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("height", nHeight);
+    ret.pushKV("supply", ValueFromAmount(GetRewardSupplyBeforeHeight(uint32_t(nHeight) + 1)));
+    ret.pushKV("blockreward", ValueFromAmount(GetBlockRewardForHeight(nHeight)));
+    return ret;
+}
+
 static UniValue getblockheader(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getblockheader",
@@ -1001,46 +1049,127 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(block->nHeight);
 }
 
+static CBlockIndex* ParseHashOrHeight(const UniValue& param) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (param.isNum()) {
+        const int height = param.get_int();
+        const int current_tip = ::ChainActive().Height();
+        if (height < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+        }
+        if (height > current_tip) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+        }
+
+        return ::ChainActive()[height];
+    } else {
+        const uint256 hash(ParseHashV(param, "hash_or_height"));
+        CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        if (!::ChainActive().Contains(pindex)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
+        }
+        return pindex;
+    }
+}
+
+static CoinStatsHashType ParseHashType(const UniValue& param)
+{
+    const std::string hash_type_input = param.isNull() ? "hash_serialized_2" : param.get_str();
+    if (hash_type_input == "hash_serialized_2") {
+        return CoinStatsHashType::HASH_SERIALIZED;
+    } else if (hash_type_input == "muhash") {
+        return CoinStatsHashType::MUHASH;
+    } else if (hash_type_input == "none") {
+        return CoinStatsHashType::NONE;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+}
+
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {},
+                "Note this call may take some time, unless -coinstatsindex is enabled and hash_type is not hash_serialized_2.\n",
+                {
+                    {"hash_type", RPCArg::Type::STR, /* default */ "hash_serialized_2", "Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'."},
+                    {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The block hash or height of the target block, only available with coinstatsindex", "", {"", "string or numeric"}},
+                },
                 RPCResult{
                     RPCResult::Type::OBJ, "", "",
                     {
-                        {RPCResult::Type::NUM, "height", "The current block height (index)"},
-                        {RPCResult::Type::STR_HEX, "bestblock", "The hash of the block at the tip of the chain"},
-                        {RPCResult::Type::NUM, "transactions", "The number of transactions with unspent outputs"},
+                        {RPCResult::Type::NUM, "height", "The block height (index) of the returned statistics"},
+                        {RPCResult::Type::STR_HEX, "bestblock", "The hash of the block at which these statistics are calculated"},
+                        {RPCResult::Type::NUM, "transactions", /* optional */ true, "The number of transactions with unspent outputs (not available when coinstatsindex is used)"},
                         {RPCResult::Type::NUM, "txouts", "The number of unspent transaction outputs"},
                         {RPCResult::Type::NUM, "bogosize", "A meaningless metric for UTXO set size"},
-                        {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash"},
-                        {RPCResult::Type::NUM, "disk_size", "The estimated size of the chainstate on disk"},
+                        {RPCResult::Type::STR_HEX, "hash_serialized_2", /* optional */ true, "The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)"},
+                        {RPCResult::Type::STR_HEX, "muhash", /* optional */ true, "The serialized hash (only present if 'muhash' hash_type is chosen)"},
+                        {RPCResult::Type::NUM, "disk_size", /* optional */ true, "The estimated size of the chainstate on disk (not available when coinstatsindex is used)"},
                         {RPCResult::Type::STR_AMOUNT, "total_amount", "The total amount"},
                     }},
                 RPCExamples{
-                    HelpExampleCli("gettxoutsetinfo", "")
-            + HelpExampleRpc("gettxoutsetinfo", "")
+                    HelpExampleCli("gettxoutsetinfo", "") +
+                    HelpExampleCli("gettxoutsetinfo", R"("none")") +
+                    HelpExampleCli("gettxoutsetinfo", R"("muhash" 1000)") +
+                    HelpExampleRpc("gettxoutsetinfo", "") +
+                    HelpExampleRpc("gettxoutsetinfo", R"("muhash", 1000)")
                 },
             }.Check(request);
 
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    ::ChainstateActive().ForceFlushStateToDisk();
+    const CoinStatsHashType hash_type = ParseHashType(request.params[0]);
+    const bool use_index = g_coin_stats_index && hash_type != CoinStatsHashType::HASH_SERIALIZED;
 
-    CCoinsView* coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsDB());
-    if (GetUTXOStats(coins_view, stats)) {
+    CBlockIndex* pindex = nullptr;
+    if (!request.params[1].isNull()) {
+        if (!use_index) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires coinstatsindex and a hash_type other than hash_serialized_2");
+        }
+        pindex = WITH_LOCK(cs_main, return ParseHashOrHeight(request.params[1]));
+    }
+
+    CCoinsView* coins_view;
+    std::unique_ptr<CCoinsViewCursor> cursor;
+    if (use_index) {
+        // Let the index catch up with the blocks connected so far.
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+        coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsTip());
+    } else {
+        // Create the cursor under the same cs_main hold as the flush, so
+        // that the background flush cannot leave the database between two
+        // blocks first.
+        LOCK(cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        coins_view = &ChainstateActive().CoinsDB();
+        cursor.reset(coins_view->Cursor());
+    }
+
+    if (GetUTXOStats(coins_view, stats, hash_type, pindex, std::move(cursor))) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        if (!stats.index_used) {
+            ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        }
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
-        ret.pushKV("disk_size", stats.nDiskSize);
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.hashSerialized.GetHex());
+        }
+        if (!stats.index_used) {
+            ret.pushKV("disk_size", stats.nDiskSize);
+        }
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
+        if (stats.index_used) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set statistics from coinstatsindex, which may still be syncing");
+        }
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
     return ret;
@@ -1262,6 +1391,14 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::BOOL, "active", "true if the rules are enforced for the mempool and the next block"},
                             }},
                         }},
+                        {RPCResult::Type::OBJ, "snapshot", "the UTXO snapshot the chainstate was loaded from (only present while its history is being validated)",
+                        {
+                            {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
+                            {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                            {RPCResult::Type::NUM, "background_blocks", "the height the blocks below the base have been validated to"},
+                            {RPCResult::Type::NUM, "background_progress", "estimate of the progress of the validation below the base [0..1]"},
+                            {RPCResult::Type::BOOL, "validated", "whether the blocks below the base produced the coins of the snapshot"},
+                        }},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }},
                 RPCExamples{
@@ -1312,6 +1449,18 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     BIP9SoftForkDescPushBack(softforks, "testdummy", consensusParams, Consensus::DEPLOYMENT_TESTDUMMY);
     obj.pushKV("softforks",             softforks);
 
+    if (g_background_chainstate) {
+        const CBlockIndex* base = LookupBlockIndex(::ChainstateActive().m_from_snapshot_blockhash);
+        const CBlockIndex* background_tip = g_background_chainstate->m_chain.Tip();
+        UniValue snapshot(UniValue::VOBJ);
+        snapshot.pushKV("base_hash",           base->GetBlockHash().GetHex());
+        snapshot.pushKV("base_height",         base->nHeight);
+        snapshot.pushKV("background_blocks",   g_background_chainstate->m_chain.Height());
+        snapshot.pushKV("background_progress", background_tip ? (double)background_tip->nChainTx / base->nChainTx : 0.0);
+        snapshot.pushKV("validated",           ChainstateBackground() == nullptr);
+        obj.pushKV("snapshot",                 snapshot);
+    }
+
     obj.pushKV("warnings", GetWarnings(false));
     return obj;
 }
@@ -1470,6 +1619,47 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return MempoolInfoToJSON(EnsureMemPool());
 }
 
+static UniValue getcoinsflushinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getcoinsflushinfo",
+                "\nReturns the backlog of modified coins in the coins cache of the active chainstate, and the activity of the flushes writing them to the coins database.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "cache_coins", "Number of coins in the cache"},
+                        {RPCResult::Type::NUM, "cache_usage", "Memory usage of the cache in bytes"},
+                        {RPCResult::Type::NUM, "dirty_coins", "Number of modified coins not written to the database yet"},
+                        {RPCResult::Type::BOOL, "partial_write", "Whether the database holds a part of the modified coins, written in the background"},
+                        {RPCResult::Type::NUM, "incremental_batches", "Number of batches written in the background since startup"},
+                        {RPCResult::Type::NUM, "incremental_coins", "Number of coins written by them"},
+                        {RPCResult::Type::NUM, "full_flushes", "Number of flushes that wrote all the modified coins since startup"},
+                        {RPCResult::Type::NUM, "full_flush_coins", "Number of coins written by them"},
+                        {RPCResult::Type::NUM, "last_full_flush_ms", "Duration of the last of them in milliseconds"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getcoinsflushinfo", "")
+            + HelpExampleRpc("getcoinsflushinfo", "")
+                },
+            }.Check(request);
+
+    LOCK(cs_main);
+    CChainState& chainstate = ::ChainstateActive();
+    const CCoinsViewCache& coins = chainstate.CoinsTip();
+    const CChainState::CoinsFlushStats& stats = chainstate.m_coins_flush_stats;
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("cache_coins", (uint64_t)coins.GetCacheSize());
+    ret.pushKV("cache_usage", (uint64_t)coins.DynamicMemoryUsage());
+    ret.pushKV("dirty_coins", (uint64_t)coins.GetDirtyCount());
+    ret.pushKV("partial_write", coins.HasPartialWrite());
+    ret.pushKV("incremental_batches", stats.incremental_batches);
+    ret.pushKV("incremental_coins", stats.incremental_coins);
+    ret.pushKV("full_flushes", stats.full_flushes);
+    ret.pushKV("full_flush_coins", stats.full_flush_coins);
+    ret.pushKV("last_full_flush_ms", stats.last_full_flush_micros / 1000);
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
             RPCHelpMan{"preciousblock",
@@ -1777,28 +1967,7 @@ static UniValue getblockstats(const JSONRPCRequest& request)
 
     LOCK(cs_main);
 
-    CBlockIndex* pindex;
-    if (request.params[0].isNum()) {
-        const int height = request.params[0].get_int();
-        const int current_tip = ::ChainActive().Height();
-        if (height < 0) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
-        }
-        if (height > current_tip) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
-        }
-
-        pindex = ::ChainActive()[height];
-    } else {
-        const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
-        pindex = LookupBlockIndex(hash);
-        if (!pindex) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
-        if (!::ChainActive().Contains(pindex)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
-        }
-    }
+    CBlockIndex* pindex = ParseHashOrHeight(request.params[0]);
 
     CHECK_NONFATAL(pindex != nullptr);
 
@@ -1997,32 +2166,122 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
-//! Search for a given set of pubkey scripts
-bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
+//! Maximum number of ranges scantxoutset scans the coins database in, in parallel on the worker pool
+static const int MAX_SCAN_THREADS = 16;
+
+namespace {
+
+class SaltedScriptHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const CScript& script) const {
+        return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
+//! The first two bytes of a txid, which order the coins database
+uint32_t TxidPrefix(const uint256& txid)
+{
+    return 0x100 * *txid.begin() + *(txid.begin() + 1);
+}
+
+} // namespace
+
+uint256 ScanRangeStart(size_t i, size_t n)
+{
+    const uint32_t prefix = 0x10000 * i / n;
+    uint256 start;
+    *start.begin() = prefix >> 8;
+    *(start.begin() + 1) = prefix & 0xff;
+    return start;
+}
+
+bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, const std::vector<std::unique_ptr<CCoinsViewCursor>>& cursors, const std::set<CScript>& needles, std::vector<std::pair<COutPoint, Coin>>& out_results)
+{
+    const size_t n = cursors.size();
+    const std::unordered_set<CScript, SaltedScriptHasher> lookup(needles.begin(), needles.end());
+    std::vector<std::vector<std::pair<COutPoint, Coin>>> results(n);
+    std::vector<int64_t> counts(n, 0);
+    // Part of the txid space each thread is done with, in units of TxidPrefix
+    std::unique_ptr<std::atomic<uint32_t>[]> scanned(new std::atomic<uint32_t>[n]);
+    for (size_t i = 0; i < n; ++i) scanned[i] = 0;
+    std::atomic<bool> failed{false};
     scan_progress = 0;
-    count = 0;
-    while (cursor->Valid()) {
-        COutPoint key;
-        Coin coin;
-        if (!cursor->GetKey(key) || !cursor->GetValue(coin)) return false;
-        if (++count % 8192 == 0) {
-            if (should_abort) {
-                // allow to abort the scan via the abort reference
-                return false;
+
+    auto update_progress = [&] {
+        uint32_t total = 0;
+        for (size_t i = 0; i < n; ++i) total += scanned[i];
+        scan_progress = (int)(total * 100.0 / 65536.0 + 0.5);
+    };
+    auto scan = [&](size_t i) {
+        CCoinsViewCursor* cursor = cursors[i].get();
+        const uint32_t begin = TxidPrefix(ScanRangeStart(i, n));
+        const uint32_t end = i + 1 < n ? TxidPrefix(ScanRangeStart(i + 1, n)) : 0x10000;
+        bool complete = false;
+        try {
+            while (true) {
+                if (!cursor->Valid()) {
+                    complete = true;
+                    break;
+                }
+                COutPoint key;
+                if (!cursor->GetKey(key)) break;
+                const uint32_t prefix = TxidPrefix(key.hash);
+                if (prefix >= end) {
+                    complete = true;
+                    break;
+                }
+                Coin coin;
+                if (!cursor->GetValue(coin)) break;
+                if (++counts[i] % 8192 == 0) {
+                    // allow to abort the scan via the abort reference, and
+                    // stop all threads as soon as one of them fails
+                    if (should_abort || failed || ShutdownRequested()) {
+                        failed = true;
+                        return;
+                    }
+                }
+                if (counts[i] % 256 == 0) {
+                    // update progress reference every 256 item
+                    scanned[i] = prefix - begin;
+                    update_progress();
+                }
+                if (lookup.count(coin.out.scriptPubKey)) {
+                    results[i].emplace_back(key, coin);
+                }
+                cursor->Next();
             }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
         }
-        if (count % 256 == 0) {
-            // update progress reference every 256 item
-            uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
-            scan_progress = (int)(high * 100.0 / 65536.0 + 0.5);
+        if (!complete) {
+            failed = true;
+            return;
         }
-        if (needles.count(coin.out.scriptPubKey)) {
-            out_results.emplace(key, coin);
-        }
-        cursor->Next();
-    }
-    scan_progress = 100;
-    return true;
+        scanned[i] = end - begin;
+        update_progress();
+    };
+
+    // A scan can take minutes, so leave a pool thread to the block reads
+    // and coins database accesses of validation.
+    g_worker_pool.RunParallel(n, scan, std::max(g_worker_pool.NumThreads() - 1, 0));
+
+    count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        count += counts[i];
+        out_results.insert(out_results.end(), results[i].begin(), results[i].end());
+    }
+    std::sort(out_results.begin(), out_results.end(), [](const std::pair<COutPoint, Coin>& a, const std::pair<COutPoint, Coin>& b) {
+        if (a.second.nHeight != b.second.nHeight) return a.second.nHeight < b.second.nHeight;
+        return a.first < b.first;
+    });
+    return !failed;
 }
 
 /** RAII object to prevent concurrency issue when scanning the txout set */
@@ -2071,7 +2330,8 @@ UniValue scantxoutset(const JSONRPCRequest& request)
                 "or more path elements separated by \"/\", and optionally ending in \"/*\" (unhardened), or \"/*'\" or \"/*h\" (hardened) to specify all\n"
                 "unhardened or hardened child keys.\n"
                 "In the latter case, a range needs to be specified by below if different from 1000.\n"
-                "For more information on output descriptors, see the documentation in the doc/descriptors.md file.\n",
+                "For more information on output descriptors, see the documentation in the doc/descriptors.md file.\n"
+                "The unspent transaction output set is scanned on several threads, and the matching outputs are sorted by height.\n",
                 {
                     {"action", RPCArg::Type::STR, RPCArg::Optional::NO, "The action to execute\n"
             "                                      \"start\" for starting a scan\n"
@@ -2162,21 +2422,27 @@ UniValue scantxoutset(const JSONRPCRequest& request)
         // Scan the unspent transaction output set for inputs
         UniValue unspents(UniValue::VARR);
         std::vector<CTxOut> input_txos;
-        std::map<COutPoint, Coin> coins;
+        std::vector<std::pair<COutPoint, Coin>> coins;
         g_should_abort_scan = false;
         g_scan_progress = 0;
         int64_t count = 0;
-        std::unique_ptr<CCoinsViewCursor> pcursor;
+        // One cursor per range of txids, all created at the same state of the
+        // coins database.
+        const int n_threads = std::max(1, std::min(GetNumCores(), MAX_SCAN_THREADS));
+        std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
         CBlockIndex* tip;
         {
             LOCK(cs_main);
             ::ChainstateActive().ForceFlushStateToDisk();
-            pcursor = std::unique_ptr<CCoinsViewCursor>(::ChainstateActive().CoinsDB().Cursor());
-            CHECK_NONFATAL(pcursor);
+            const CCoinsViewDB& coins_db = ::ChainstateActive().CoinsDB();
+            for (int i = 0; i < n_threads; ++i) {
+                cursors.emplace_back(coins_db.Cursor(ScanRangeStart(i, n_threads)));
+                CHECK_NONFATAL(cursors.back());
+            }
             tip = ::ChainActive().Tip();
             CHECK_NONFATAL(tip);
         }
-        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, pcursor.get(), needles, coins);
+        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, cursors, needles, coins);
         result.pushKV("success", res);
         result.pushKV("txouts", count);
         result.pushKV("height", tip->nHeight);
@@ -2306,6 +2572,7 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
                     {RPCResult::Type::NUM, "coins_written", "the number of coins written in the snapshot"},
                     {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
                     {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR_HEX, "txoutset_hash", "the hash_serialized_2 of the coins, to be passed to loadtxoutset"},
                     {RPCResult::Type::STR, "path", "the absolute path that the snapshot was written to"},
                 }
         },
@@ -2386,6 +2653,82 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
     result.pushKV("coins_written", stats.coins_count);
     result.pushKV("base_hash", tip->GetBlockHash().ToString());
     result.pushKV("base_height", tip->nHeight);
+    result.pushKV("txoutset_hash", stats.hashSerialized.GetHex());
+    result.pushKV("path", path.string());
+    return result;
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    RPCHelpMan{
+        "loadtxoutset",
+        "\nLoad a UTXO set written by dumptxoutset and make it the active chainstate.\n"
+        "The node continues from the base of the snapshot right away, while the blocks below it are\n"
+        "downloaded and validated in the background. The snapshot is discarded if they do not produce\n"
+        "the same UTXO set. The header of the snapshot base must be known. Pruning and indexes are not supported.\n",
+        {
+            {"path",
+                RPCArg::Type::STR,
+                RPCArg::Optional::NO,
+                /* default_val */ "",
+                "path to the snapshot file. If relative, will be prefixed by datadir."},
+            {"txoutset_hash",
+                RPCArg::Type::STR_HEX,
+                RPCArg::Optional::NO,
+                /* default_val */ "",
+                "the hash_serialized_2 of the UTXO set at the snapshot base, obtained from a trusted source"},
+        },
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::NUM, "coins_loaded", "the number of coins loaded from the snapshot"},
+                    {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
+                    {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR, "path", "the absolute path that the snapshot was read from"},
+                }
+        },
+        RPCExamples{
+            HelpExampleCli("loadtxoutset", "utxo.dat \"hash\"")
+        }
+    }.Check(request);
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    const uint256 txoutset_hash = ParseHashV(request.params[1], "txoutset_hash");
+
+    if (fPruneMode) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Loading a UTXO snapshot is not supported in prune mode");
+    }
+    bool have_index = g_txindex != nullptr;
+    ForEachBlockFilterIndex([&have_index](BlockFilterIndex&) { have_index = true; });
+    if (g_coin_stats_index) have_index = true;
+    if (have_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Loading a UTXO snapshot is not supported with -txindex, -blockfilterindex or -coinstatsindex");
+    }
+
+    FILE* file{fsbridge::fopen(path, "rb")};
+    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Couldn't open file " + path.string() + " for reading");
+    }
+
+    SnapshotMetadata metadata;
+    try {
+        afile >> metadata;
+    } catch (const std::ios_base::failure&) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Unable to read the snapshot metadata");
+    }
+
+    std::string error;
+    if (!ActivateSnapshot(afile, metadata, txoutset_hash, Params(), error)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to load UTXO snapshot: " + error);
+    }
+
+    LOCK(cs_main);
+    const CBlockIndex* base = LookupBlockIndex(metadata.m_base_blockhash);
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_loaded", metadata.m_coins_count);
+    result.pushKV("base_hash", base->GetBlockHash().ToString());
+    result.pushKV("base_height", base->nHeight);
     result.pushKV("path", path.string());
     return result;
 }
@@ -2401,10 +2744,12 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
+    { "blockchain",         "getissuedsupply",        &getissuedsupply,        {"height"} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getcoinsflushinfo",      &getcoinsflushinfo,      {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
@@ -2412,7 +2757,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type", "hash_or_height"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -2429,6 +2774,7 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitforblockheight",     &waitforblockheight,     {"height","timeout"} },
     { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, {} },
     { "hidden",             "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "hidden",             "loadtxoutset",           &loadtxoutset,           {"path", "txoutset_hash"} },
 };
 // clang-format on
 
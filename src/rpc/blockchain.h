@@ -8,14 +8,23 @@
 #include <amount.h>
 #include <sync.h>
 
+#include <atomic>
+#include <memory>
+#include <set>
 #include <stdint.h>
+#include <utility>
 #include <vector>
 
 extern RecursiveMutex cs_main;
 
 class CBlock;
 class CBlockIndex;
+class CCoinsViewCursor;
+class CScript;
 class CTxMemPool;
+class Coin;
+class COutPoint;
+class uint256;
 class UniValue;
 struct NodeContext;
 
@@ -47,6 +56,19 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
 /** Used by getblockstats to get feerates at different percentiles by weight  */
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
 
+/** First txid of range i of the n ranges of equal size scantxoutset splits the coins database into. */
+uint256 ScanRangeStart(size_t i, size_t n);
+
+/**
+ * Search the coins database for a set of scripts, with the cursors read in parallel on the worker pool,
+ * leaving one of its threads to validation.
+ * Cursor i of n must start at ScanRangeStart(i, n) and is read up to the
+ * next range. The results are sorted by height.
+ *
+ * @return false if the scan was aborted or failed.
+ */
+bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, const std::vector<std::unique_ptr<CCoinsViewCursor>>& cursors, const std::set<CScript>& needles, std::vector<std::pair<COutPoint, Coin>>& out_results);
+
 //! Pointer to node state that needs to be declared as a global to be accessible
 //! RPC methods. Due to limitations of the RPC framework, there's currently no
 //! direct way to pass in state to RPC methods without globals.
@@ -247,6 +247,14 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "networkhashps", "The network hashes per second"},
                         {RPCResult::Type::NUM, "pooledtx", "The size of the mempool"},
                         {RPCResult::Type::STR, "chain", "current network name (main, test, regtest)"},
+                        {RPCResult::Type::OBJ, "auxpowtemplates", "the blocks cached for createauxblock and submitauxblock",
+                        {
+                            {RPCResult::Type::NUM, "blocks", "The number of cached blocks"},
+                            {RPCResult::Type::NUM, "scripts", "The number of payout scripts with a current block"},
+                            {RPCResult::Type::NUM, "usage", "The memory usage of the cached blocks in bytes"},
+                            {RPCResult::Type::NUM, "maxusage", "The memory budget for the cached blocks in bytes (see -auxpowtemplatecache)"},
+                            {RPCResult::Type::NUM, "evicted", "The number of blocks dropped to stay within the budget"},
+                        }},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }},
                 RPCExamples{
@@ -255,6 +263,9 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
+    // Taken before cs_main, which AuxpowMiner locks after its own lock
+    const UniValue auxpowTemplates = AuxpowMiner::get().getTemplateCacheInfo();
+
     LOCK(cs_main);
     const CTxMemPool& mempool = EnsureMemPool();
 
@@ -266,6 +277,7 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     obj.pushKV("networkhashps",    getnetworkhashps(request));
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
+    obj.pushKV("auxpowtemplates",  auxpowTemplates);
     obj.pushKV("warnings",         GetWarnings(false));
     return obj;
 }
@@ -1036,6 +1048,7 @@ static UniValue createauxblock(const JSONRPCRequest& request) {
 	        " merge-mine it.\n",
 	        {
 	            {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "Payout address for the coinbase transaction"},
+	            {"longpollid", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED_NAMED_ARG, "Wait until a block different from this one is available"},
 	        },
 	        RPCResult{
 	            RPCResult::Type::OBJ, "", "",
@@ -1047,6 +1060,7 @@ static UniValue createauxblock(const JSONRPCRequest& request) {
 	                {RPCResult::Type::STR_HEX, "bits", "compressed target of the block"},
 	                {RPCResult::Type::NUM, "height", "height of the block"},
 	                {RPCResult::Type::STR_HEX, "_target", "target in reversed byte order, deprecated"},
+	                {RPCResult::Type::STR_HEX, "longpollid", "id to wait for a newer block with"},
 	            },
 	        },
 	        RPCExamples{
@@ -1063,7 +1077,12 @@ static UniValue createauxblock(const JSONRPCRequest& request) {
 				}
 				const CScript scriptPubKey = GetScriptForDestination(coinbaseScript);
 
-				return AuxpowMiner::get ().createAuxBlock(request, scriptPubKey);
+				std::string longpollid;
+				if (!request.params[1].isNull()) {
+					longpollid = request.params[1].get_str();
+				}
+
+				return AuxpowMiner::get ().createAuxBlock(request, scriptPubKey, longpollid);
 			},
 	    };
 
@@ -1096,6 +1115,57 @@ static UniValue submitauxblock(const JSONRPCRequest& request) {
 	return rpcHelp.HandleRequest(request);
 }
 
+static UniValue submitauxblocks(const JSONRPCRequest& request) {
+	RPCHelpMan rpcHelp{"submitauxblocks",
+	        "\nSubmits several solved auxpows for blocks that were previously"
+	        " created by 'createauxblock'.  The proofs are checked in parallel"
+	        " and for each block, only the first valid one is submitted.\n",
+	        {
+	            {"proofs", RPCArg::Type::ARR, RPCArg::Optional::NO, "The proofs to submit",
+	                {
+	                    {"", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
+	                        {
+	                            {"hash", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "Hash of the block to submit"},
+	                            {"auxpow", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "Serialised auxpow found"},
+	                        },
+	                    },
+	                },
+	            },
+	        },
+	        RPCResult{
+	            RPCResult::Type::ARR, "", "one result per proof, in the given order",
+	            {
+	                {RPCResult::Type::STR, "", "\"accepted\", \"rejected\" if the block was not accepted, \"invalid\" if the auxpow is not valid, "
+	                    "\"duplicate\" if an earlier proof for the block was submitted or \"unknown\" if the block hash is unknown"},
+	            },
+	        },
+	        RPCExamples{
+	            HelpExampleCli("submitauxblocks", "'[{\"hash\":\"hash\",\"auxpow\":\"serialised auxpow\"}]'")
+	            + HelpExampleRpc("submitauxblocks", "[{\"hash\":\"hash\",\"auxpow\":\"serialised auxpow\"}]")
+	        },
+	        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+			{
+				const UniValue& proofsIn = request.params[0].get_array();
+
+				std::vector<std::pair<uint256, std::vector<unsigned char>>> proofs;
+				proofs.reserve(proofsIn.size());
+				for (size_t i = 0; i < proofsIn.size(); ++i) {
+					const UniValue& proof = proofsIn[i].get_obj();
+					RPCTypeCheckObj(proof,
+						{
+							{"hash", UniValueType(UniValue::VSTR)},
+							{"auxpow", UniValueType(UniValue::VSTR)},
+						});
+					proofs.emplace_back(ParseHashO(proof, "hash"), ParseHexO(proof, "auxpow"));
+				}
+
+				return AuxpowMiner::get ().submitAuxBlocks(request, proofs);
+			},
+	    };
+
+	return rpcHelp.HandleRequest(request);
+}
+
 void RegisterMiningRPCCommands(CRPCTable &t)
 {
 // clang-format off
@@ -1108,8 +1178,9 @@ static const CRPCCommand commands[] =
     { "mining",             "getblocktemplate",       &getblocktemplate,       {"template_request"} },
     { "mining",             "submitblock",            &submitblock,            {"hexdata","dummy"} },
     { "mining",             "submitheader",           &submitheader,           {"hexdata"} },
-	{ "mining",				"createauxblock",		  &createauxblock,		   {"address"} },
+	{ "mining",				"createauxblock",		  &createauxblock,		   {"address", "longpollid"} },
 	{ "mining",				"submitauxblock",		  &submitauxblock,		   {"hash", "auxpow"} },
+	{ "mining",				"submitauxblocks",		  &submitauxblocks,		   {"proofs"} },
 
 
     { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries"} },
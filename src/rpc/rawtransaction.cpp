@@ -303,14 +303,18 @@ static UniValue gettxoutproof(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     unsigned int ntxFound = 0;
-    for (const auto& tx : block.vtx)
+    std::vector<uint256> leaves;
+    leaves.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
         if (setTxids.count(tx->GetHash()))
             ntxFound++;
+        leaves.push_back(tx->GetHash());
+    }
     if (ntxFound != setTxids.size())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Not all transactions found in specified or retrieved block");
 
     CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
-    CMerkleBlock mb(block, setTxids);
+    CMerkleBlock mb(block, setTxids, ComputeMerkleLevelsParallel(std::move(leaves)));
     ssMB << mb;
     std::string strHex = HexStr(ssMB.begin(), ssMB.end());
     return strHex;
@@ -56,6 +56,22 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    void Snapshot(uint256& nonceOut, std::vector<uint256>& entries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonceOut = nonce;
+        entries = setValid.live_elements();
+    }
+
+    void Restore(const uint256& nonceIn, const std::vector<uint256>& entries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (const uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -79,6 +95,16 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void GetSignatureCacheSnapshot(uint256& nonce, std::vector<uint256>& entries)
+{
+    signatureCache.Snapshot(nonce, entries);
+}
+
+void RestoreSignatureCacheSnapshot(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.Restore(nonce, entries);
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
@@ -53,4 +53,12 @@ public:
 
 void InitSignatureCache();
 
+/** Copy the nonce and the live entries of the signature cache, to persist them */
+void GetSignatureCacheSnapshot(uint256& nonce, std::vector<uint256>& entries);
+/**
+ * Adopt a nonce and insert the entries computed with it. Must be
+ * called before the cache is first used, as existing entries become stale.
+ */
+void RestoreSignatureCacheSnapshot(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // ELCASH_SCRIPT_SIGCACHE_H
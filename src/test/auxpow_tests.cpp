@@ -3,12 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <arith_uint256.h>
 #include <auxpow.h>
 #include <chainparams.h>
 #include <coins.h>
 #include <consensus/merkle.h>
+#include <consensus/validation.h>
 #include <validation.h>
 #include <pow.h>
 #include <primitives/block.h>
@@ -16,9 +18,12 @@
 #include <script/script.h>
 #include <test/util/setup_common.h>
 #include <util/strencodings.h>
+#include <util/system.h>
 #include <util/time.h>
 #include <uint256.h>
 #include <univalue.h>
+#include <validationinterface.h>
+#include <workerpool.h>
 
 
 #include <algorithm>
@@ -446,6 +451,182 @@ BOOST_FIXTURE_TEST_CASE(auxpow_pow, BasicTestingSetup) {
 	BOOST_CHECK(!CheckProofOfWork(block, params));
 }
 
+BOOST_FIXTURE_TEST_CASE(auxpow_merkle_branches, BasicTestingSetup) {
+	/* Branches of different lengths, including empty ones and index -1.  */
+	std::vector<uint256> hashes;
+	std::vector<std::vector<uint256>> branchData;
+	std::vector<int> indices;
+	for (int i = 0; i < 20; ++i) {
+		hashes.push_back(InsecureRand256());
+		branchData.emplace_back();
+		for (int j = 0; j < i % 7; ++j)
+			branchData.back().push_back(InsecureRand256());
+		indices.push_back(i == 5 ? -1 : InsecureRandBits(6));
+	}
+
+	std::vector<const std::vector<uint256>*> branches;
+	for (const auto& branch : branchData)
+		branches.push_back(&branch);
+
+	std::vector<uint256> roots(hashes);
+	CAuxPow::checkMerkleBranches(roots, branches, indices);
+	for (size_t i = 0; i < hashes.size(); ++i)
+		BOOST_CHECK(roots[i] == CAuxPow::checkMerkleBranch(hashes[i], branchData[i], indices[i]));
+	BOOST_CHECK(roots[5].IsNull());
+}
+
+BOOST_FIXTURE_TEST_CASE(auxpow_pow_batch, BasicTestingSetup) {
+	SelectParams(CBaseChainParams::REGTEST);
+	const Consensus::Params& params = Params().GetConsensus();
+
+	const arith_uint256 target = (~arith_uint256(0) >> 1);
+	CBlockHeader block;
+	block.nBits = target.GetCompact();
+	block.SetBaseVersion(2, params.nAuxpowChainId);
+
+	std::vector<CBlockHeader> headers;
+	mineBlock(block, true);
+	headers.push_back(block);
+	mineBlock(block, false);
+	headers.push_back(block);
+
+	CAuxpowBuilder builder(5, 42);
+	const unsigned height = 3;
+	const int nonce = 7;
+	const int index = CAuxPow::getExpectedIndex(nonce, params.nAuxpowChainId, height);
+	block.SetBlockHeaderVersion(true);
+	const valtype auxRoot = builder.buildAuxpowChain(block.GetHash(), height, index);
+	builder.setCoinbase(CScript() << CAuxpowBuilder::buildCoinbaseData(true, auxRoot, height, nonce));
+	mineBlock(builder.parentBlock, true, block.nBits);
+	block.SetAuxBlockHeader(builder.getUnique());
+	headers.push_back(block);
+	tamperWith(block.hashMerkleRoot);
+	headers.push_back(block);
+
+	const std::vector<bool> expected{true, false, true, false};
+	for (size_t i = 0; i < headers.size(); ++i)
+		BOOST_CHECK_EQUAL(CheckProofOfWork(headers[i], params), expected[i]);
+	BOOST_CHECK(CheckProofOfWorkBatch(headers, params) == expected);
+
+	/* The same results are found on the worker pool threads, which get
+	 the headers in several ranges.  */
+	std::vector<CBlockHeader> manyHeaders;
+	std::vector<bool> manyExpected;
+	for (int i = 0; i < 25; ++i) {
+		manyHeaders.insert(manyHeaders.end(), headers.begin(), headers.end());
+		manyExpected.insert(manyExpected.end(), expected.begin(), expected.end());
+	}
+	boost::thread_group threads;
+	for (int i = 0; i < 2; ++i)
+		threads.create_thread([] { g_worker_pool.Thread(); });
+	g_parallel_script_checks = true;
+	BOOST_CHECK(CheckProofOfWorkBatch(headers, params) == expected);
+	BOOST_CHECK(CheckProofOfWorkBatch(manyHeaders, params) == manyExpected);
+	g_parallel_script_checks = false;
+	threads.interrupt_all();
+	threads.join_all();
+
+	BOOST_CHECK(CheckProofOfWorkBatch({}, params).empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(auxpow_process_headers_batch, TestChain100Setup) {
+	const Consensus::Params& params = Params().GetConsensus();
+	const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+
+	/* Build a chain of headers on the tip, the third one with bad PoW.  */
+	std::vector<CBlockHeader> headers;
+	uint256 hashPrev = tip->GetBlockHash();
+	for (int i = 0; i < 4; ++i) {
+		CBlockHeader header;
+		header.nVersion = ComputeBlockVersion(tip, params);
+		header.hashPrevBlock = hashPrev;
+		header.hashMerkleRoot = ArithToUint256(arith_uint256(i + 1));
+		header.nTime = tip->nTime + i + 1;
+		header.nBits = tip->nBits;
+		mineBlock(header, i != 2);
+		hashPrev = header.GetHash();
+		headers.push_back(header);
+	}
+
+	/* The headers before the bad one are accepted.  */
+	BlockValidationState state;
+	const CBlockIndex* pindex = nullptr;
+	BOOST_CHECK(!ProcessNewBlockHeaders(headers, state, Params(), &pindex));
+	BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+	BOOST_CHECK(pindex != nullptr && pindex->GetBlockHash() == headers[1].GetHash());
+	{
+		LOCK(cs_main);
+		BOOST_CHECK(LookupBlockIndex(headers[1].GetHash()) != nullptr);
+		BOOST_CHECK(LookupBlockIndex(headers[2].GetHash()) == nullptr);
+		BOOST_CHECK(LookupBlockIndex(headers[3].GetHash()) == nullptr);
+	}
+
+	/* With the bad header fixed, the whole batch is accepted.  */
+	mineBlock(headers[2], true);
+	headers[3].hashPrevBlock = headers[2].GetHash();
+	mineBlock(headers[3], true);
+	BlockValidationState state2;
+	BOOST_CHECK(ProcessNewBlockHeaders(headers, state2, Params(), &pindex));
+	BOOST_CHECK(pindex->GetBlockHash() == headers[3].GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(auxpow_header_store, TestingSetup) {
+	const arith_uint256 target = (~arith_uint256(0) >> 1);
+	CBlockHeader block;
+	block.nBits = target.GetCompact();
+	block.nTime = 1234567;
+	CAuxPow::initBlockHeader(block);
+	const uint256 hash = block.GetHash();
+
+	/* The block index alone does not carry the auxpow and the block was
+	 never written to a block file.  */
+	CBlockIndex index(block);
+	index.phashBlock = &hash;
+	BOOST_CHECK(!pblocktree->HaveAuxBlockHeader(hash));
+	BOOST_CHECK(index.GetBlockHeader().auxHeader == nullptr);
+
+	/* Once stored, the full header is served from the block tree DB.  */
+	BOOST_CHECK(pblocktree->WriteAuxBlockHeader(hash, *block.auxHeader));
+	BOOST_CHECK(pblocktree->HaveAuxBlockHeader(hash));
+	const CBlockHeader header = index.GetBlockHeader();
+	BOOST_CHECK(header.GetHash() == hash);
+	BOOST_CHECK(header.auxHeader != nullptr);
+	BOOST_CHECK(header.auxHeader->getParentBlockHash() == block.auxHeader->getParentBlockHash());
+	BOOST_CHECK(header.auxHeader->coinbaseTx->GetHash() == block.auxHeader->coinbaseTx->GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(auxpow_read_header_from_disk, TestChain100Setup) {
+	const Consensus::Params& params = Params().GetConsensus();
+
+	/* Extend the chain with an auxpow block.  */
+	CScript scriptPubKey = CScript() << OP_TRUE;
+	std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(*m_node.mempool, Params()).CreateNewBlock(scriptPubKey);
+	CBlock& block = pblocktemplate->block;
+	{
+		LOCK(cs_main);
+		unsigned int extraNonce = 0;
+		IncrementExtraNonce(&block, ::ChainActive().Tip(), extraNonce);
+	}
+	CAuxPow::initBlockHeader(block);
+	BOOST_CHECK(ProcessNewBlock(Params(), std::make_shared<const CBlock>(block), true, nullptr));
+
+	const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+	BOOST_CHECK(tip->GetBlockHash() == block.GetHash());
+	BOOST_CHECK(pblocktree->HaveAuxBlockHeader(block.GetHash()));
+
+	/* Only the header is read back, but it carries the full auxpow.  */
+	CBlockHeader header;
+	BOOST_CHECK(ReadBlockHeaderFromDisk(header, tip, params));
+	BOOST_CHECK(header.GetHash() == block.GetHash());
+	BOOST_CHECK(header.auxHeader != nullptr);
+	BOOST_CHECK(header.auxHeader->getParentBlockHash() == block.auxHeader->getParentBlockHash());
+
+	/* Plain headers are read the same way.  */
+	BOOST_CHECK(ReadBlockHeaderFromDisk(header, tip->pprev, params));
+	BOOST_CHECK(header.GetHash() == tip->pprev->GetBlockHash());
+	BOOST_CHECK(header.auxHeader == nullptr);
+}
+
 /* ************************************************************************** */
 
 /**
@@ -455,6 +636,8 @@ BOOST_FIXTURE_TEST_CASE(auxpow_pow, BasicTestingSetup) {
 class AuxpowMinerForTest : public AuxpowMiner {
 public:
 	using AuxpowMiner::cs;
+	using AuxpowMiner::activeScripts;
+	using AuxpowMiner::curBlocks;
 
 	using AuxpowMiner::getCurrentBlock;
 	using AuxpowMiner::lookupSavedBlock;
@@ -536,6 +719,99 @@ BOOST_FIXTURE_TEST_CASE(auxpow_miner_createAndLookupBlock, TestChain100Setup) {
 	BOOST_CHECK_THROW(miner.lookupSavedBlock("foobar"), UniValue);
 }
 
+BOOST_FIXTURE_TEST_CASE(auxpow_miner_templateEviction, TestChain100Setup) {
+	CTxMemPool mempool;
+
+	/* With no memory budget, only the most recent block is kept.  */
+	gArgs.ForceSetArg("-auxpowtemplatecache", "0");
+	AuxpowMinerForTest miner;
+	gArgs.ForceSetArg("-auxpowtemplatecache", strprintf("%d", DEFAULT_AUXPOW_TEMPLATE_CACHE_SIZE));
+	LOCK(miner.cs);
+
+	const CScript scriptPubKey1 = CScript() << OP_TRUE;
+	const CScript scriptPubKey2 = CScript() << OP_2;
+	uint256 target;
+	const uint256 hash1 = miner.getCurrentBlock(mempool, scriptPubKey1, target)->GetHash();
+	BOOST_CHECK(miner.lookupSavedBlock(hash1.GetHex())->GetHash() == hash1);
+
+	const uint256 hash2 = miner.getCurrentBlock(mempool, scriptPubKey2, target)->GetHash();
+	BOOST_CHECK(miner.lookupSavedBlock(hash2.GetHex())->GetHash() == hash2);
+	BOOST_CHECK_THROW(miner.lookupSavedBlock(hash1.GetHex()), UniValue);
+
+	UniValue info = miner.getTemplateCacheInfo();
+	BOOST_CHECK_EQUAL(find_value(info, "blocks").get_int(), 1);
+	BOOST_CHECK_EQUAL(find_value(info, "scripts").get_int(), 1);
+	BOOST_CHECK_EQUAL(find_value(info, "evicted").get_int(), 1);
+	BOOST_CHECK_EQUAL(find_value(info, "maxusage").get_int(), 0);
+	BOOST_CHECK(find_value(info, "usage").get_int() > 0);
+
+	/* The evicted script gets a fresh block.  */
+	const uint256 hash3 = miner.getCurrentBlock(mempool, scriptPubKey1, target)->GetHash();
+	BOOST_CHECK(hash3 != hash1);
+	BOOST_CHECK_THROW(miner.lookupSavedBlock(hash2.GetHex()), UniValue);
+}
+
+BOOST_FIXTURE_TEST_CASE(auxpow_miner_templateCacheInfo, TestChain100Setup) {
+	CTxMemPool mempool;
+	AuxpowMinerForTest miner;
+	LOCK(miner.cs);
+
+	/* Within the default budget, blocks for all scripts are kept.  */
+	uint256 target;
+	const uint256 hash1 = miner.getCurrentBlock(mempool, CScript() << OP_TRUE, target)->GetHash();
+	const uint256 hash2 = miner.getCurrentBlock(mempool, CScript() << OP_2, target)->GetHash();
+	BOOST_CHECK(miner.lookupSavedBlock(hash1.GetHex())->GetHash() == hash1);
+	BOOST_CHECK(miner.lookupSavedBlock(hash2.GetHex())->GetHash() == hash2);
+
+	UniValue info = miner.getTemplateCacheInfo();
+	BOOST_CHECK_EQUAL(find_value(info, "blocks").get_int(), 2);
+	BOOST_CHECK_EQUAL(find_value(info, "scripts").get_int(), 2);
+	BOOST_CHECK_EQUAL(find_value(info, "evicted").get_int(), 0);
+	BOOST_CHECK_EQUAL(find_value(info, "maxusage").get_int64(), DEFAULT_AUXPOW_TEMPLATE_CACHE_SIZE << 20);
+}
+
+BOOST_FIXTURE_TEST_CASE(auxpow_miner_prebuild, TestChain100Setup) {
+	CTxMemPool mempool;
+	AuxpowMinerForTest miner;
+	miner.startBuilder(mempool);
+
+	const CScript scriptPubKey = CScript() << OP_TRUE;
+	const CScriptID scriptID(scriptPubKey);
+	uint256 target;
+	uint256 hash1;
+	{
+		LOCK(miner.cs);
+		miner.activeScripts[scriptID] = {scriptPubKey, GetTime()};
+		hash1 = miner.getCurrentBlock(mempool, scriptPubKey, target)->GetHash();
+	}
+
+	/* After a new tip, the builder constructs the next block by itself.  */
+	CreateAndProcessBlock({}, scriptPubKey);
+	SyncWithValidationInterfaceQueue();
+	const uint256 tipHash = WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash());
+
+	uint256 hash2;
+	for (int i = 0; i < 1000 && hash2.IsNull(); ++i) {
+		{
+			LOCK(miner.cs);
+			const auto cur = miner.curBlocks.find(scriptID);
+			if (cur != miner.curBlocks.end() && cur->second->block->hashPrevBlock == tipHash)
+				hash2 = cur->second->block->GetHash();
+		}
+		if (hash2.IsNull())
+			UninterruptibleSleep(std::chrono::milliseconds(10));
+	}
+	BOOST_CHECK(!hash2.IsNull() && hash2 != hash1);
+
+	/* The prebuilt block is what we get handed out.  */
+	{
+		LOCK(miner.cs);
+		BOOST_CHECK(miner.getCurrentBlock(mempool, scriptPubKey, target)->GetHash() == hash2);
+	}
+
+	miner.stopBuilder();
+}
+
 /* ************************************************************************** */
 
 BOOST_AUTO_TEST_SUITE_END()
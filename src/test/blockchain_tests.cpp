@@ -7,7 +7,9 @@
 #include <stdlib.h>
 
 #include <chain.h>
+#include <coins.h>
 #include <rpc/blockchain.h>
+#include <txdb.h>
 #include <util/string.h>
 #include <test/util/setup_common.h>
 
@@ -74,4 +76,67 @@ BOOST_AUTO_TEST_CASE(get_difficulty_for_very_high_target)
     TestDifficulty(0x12345678, 5913134931067755359633408.0);
 }
 
+BOOST_AUTO_TEST_CASE(find_script_pub_key_ranges)
+{
+    const std::vector<CScript> scripts{CScript() << OP_1, CScript() << OP_2, CScript() << OP_3};
+    const std::set<CScript> needles{scripts[0], scripts[2]};
+    const int n_coins = 10000;
+
+    CCoinsViewDB single("", 1 << 20, true, false);
+    CCoinsViewDB sharded("", 1 << 20, true, false, 4);
+    CCoinsViewCache single_cache(&single);
+    CCoinsViewCache sharded_cache(&sharded);
+    std::vector<std::pair<COutPoint, Coin>> expected;
+    for (int i = 0; i < n_coins; ++i) {
+        const COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+        const Coin coin(CTxOut(i + 1, scripts[i % scripts.size()]), InsecureRandRange(1000), false);
+        if (needles.count(coin.out.scriptPubKey)) expected.emplace_back(outpoint, coin);
+        for (CCoinsViewCache* cache : {&single_cache, &sharded_cache}) {
+            cache->AddCoin(outpoint, Coin(coin), false);
+        }
+    }
+    const uint256 best_block = InsecureRand256();
+    for (CCoinsViewCache* cache : {&single_cache, &sharded_cache}) {
+        cache->SetBestBlock(best_block);
+        BOOST_CHECK(cache->Flush());
+    }
+    std::sort(expected.begin(), expected.end(), [](const std::pair<COutPoint, Coin>& a, const std::pair<COutPoint, Coin>& b) {
+        if (a.second.nHeight != b.second.nHeight) return a.second.nHeight < b.second.nHeight;
+        return a.first < b.first;
+    });
+
+    for (CCoinsViewDB* db : {&single, &sharded}) {
+        for (size_t n : {1, 3, 16}) {
+            std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+            for (size_t i = 0; i < n; ++i) {
+                cursors.emplace_back(db->Cursor(ScanRangeStart(i, n)));
+            }
+            std::atomic<int> progress{0};
+            std::atomic<bool> should_abort{false};
+            int64_t count = 0;
+            std::vector<std::pair<COutPoint, Coin>> results;
+            BOOST_CHECK(FindScriptPubKey(progress, should_abort, count, cursors, needles, results));
+            BOOST_CHECK_EQUAL(count, n_coins);
+            BOOST_CHECK_EQUAL(progress, 100);
+            BOOST_REQUIRE_EQUAL(results.size(), expected.size());
+            for (size_t i = 0; i < results.size(); ++i) {
+                BOOST_CHECK(results[i].first == expected[i].first);
+                BOOST_CHECK(results[i].second.out == expected[i].second.out);
+                BOOST_CHECK_EQUAL(results[i].second.nHeight, expected[i].second.nHeight);
+            }
+        }
+    }
+
+    // An aborted scan stops at the next check.
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    cursors.emplace_back(single.Cursor(ScanRangeStart(0, 1)));
+    std::atomic<int> progress{0};
+    std::atomic<bool> should_abort{true};
+    int64_t count = 0;
+    std::vector<std::pair<COutPoint, Coin>> results;
+    BOOST_CHECK(!FindScriptPubKey(progress, should_abort, count, cursors, needles, results));
+    BOOST_CHECK_EQUAL(count, 8192);
+    BOOST_CHECK(progress < 100);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
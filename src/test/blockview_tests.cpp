@@ -0,0 +1,188 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/blockview.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>
+
+BOOST_FIXTURE_TEST_SUITE(blockview_tests, BasicTestingSetup)
+
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(32, 0));
+    coinbase.vout.resize(2);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    coinbase.vout[1].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(36, 0xaa);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    for (int i = 0; i < 4; ++i) {
+        CMutableTransaction tx;
+        tx.nVersion = 2;
+        tx.nLockTime = i;
+        tx.vin.resize(i + 1);
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            tx.vin[j].prevout = COutPoint(InsecureRand256(), j);
+            tx.vin[j].nSequence = 0xfffffffe - j;
+            // Odd transactions spend segwit outputs, the even ones legacy outputs.
+            if (i % 2) {
+                tx.vin[j].scriptWitness.stack.push_back(std::vector<unsigned char>(71, j));
+                tx.vin[j].scriptWitness.stack.push_back(std::vector<unsigned char>(33, i));
+            } else {
+                tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(71, j);
+            }
+        }
+        tx.vout.resize(2);
+        tx.vout[0].nValue = 1000 * (i + 1);
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[1].nValue = 0;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return block;
+}
+
+static std::vector<unsigned char> Serialize(const CBlock& block)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0) << block;
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(blockview_matches_block)
+{
+    const CBlock block = BuildBlockTestCase();
+    const std::vector<unsigned char> data = Serialize(block);
+
+    CBlockView view;
+    BOOST_REQUIRE(view.Decode(data));
+    BOOST_CHECK(view.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(view.HeaderSize(), ::GetSerializeSize(block.GetBlockHeader(), PROTOCOL_VERSION));
+    BOOST_CHECK(std::equal(view.Raw().begin(), view.Raw().end(), data.begin()));
+    BOOST_REQUIRE_EQUAL(view.Transactions().size(), block.vtx.size());
+
+    uint32_t offset = view.HeaderSize() + 1;
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        const CBlockView::Tx& vtx = view.Transactions()[i];
+        BOOST_CHECK_EQUAL(vtx.version, tx.nVersion);
+        BOOST_CHECK_EQUAL(vtx.locktime, tx.nLockTime);
+        BOOST_CHECK_EQUAL(vtx.has_witness, tx.HasWitness());
+        BOOST_CHECK_EQUAL(vtx.offset, offset);
+        BOOST_CHECK_EQUAL(vtx.size, ::GetSerializeSize(tx, PROTOCOL_VERSION));
+        offset += vtx.size;
+        BOOST_CHECK(view.GetTxHash(vtx) == tx.GetHash());
+        BOOST_CHECK(view.GetWitnessHash(vtx) == tx.GetWitnessHash());
+        BOOST_CHECK(*view.ToTransaction(vtx) == tx);
+
+        BOOST_REQUIRE_EQUAL(view.Inputs(vtx).size(), tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            const CBlockView::TxIn& txin = view.Inputs(vtx)[j];
+            BOOST_CHECK(txin.GetPrevout() == tx.vin[j].prevout);
+            BOOST_CHECK(CScript(txin.script_sig.begin(), txin.script_sig.end()) == tx.vin[j].scriptSig);
+            BOOST_CHECK_EQUAL(txin.sequence, tx.vin[j].nSequence);
+            const std::vector<std::vector<unsigned char>>& stack = tx.vin[j].scriptWitness.stack;
+            BOOST_REQUIRE_EQUAL(view.Witness(txin).size(), stack.size());
+            for (size_t k = 0; k < stack.size(); ++k) {
+                CBlockView::Bytes item = view.Witness(txin)[k];
+                BOOST_CHECK(std::vector<unsigned char>(item.begin(), item.end()) == stack[k]);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(view.Outputs(vtx).size(), tx.vout.size());
+        for (size_t j = 0; j < tx.vout.size(); ++j) {
+            const CBlockView::TxOut& txout = view.Outputs(vtx)[j];
+            BOOST_CHECK_EQUAL(txout.value, tx.vout[j].nValue);
+            BOOST_CHECK(CScript(txout.script_pubkey.begin(), txout.script_pubkey.end()) == tx.vout[j].scriptPubKey);
+        }
+    }
+    BOOST_CHECK_EQUAL(offset, data.size());
+
+    const CBlock copy = view.ToBlock();
+    BOOST_CHECK(copy.GetHash() == block.GetHash());
+    BOOST_CHECK(Serialize(copy) == data);
+}
+
+static bool Contains(CBlockView::Bytes outer, CBlockView::Bytes inner)
+{
+    return inner.begin() >= outer.begin() && inner.end() <= outer.end();
+}
+
+BOOST_AUTO_TEST_CASE(blockview_single_allocation)
+{
+    const CBlock block = BuildBlockTestCase();
+    std::vector<unsigned char> data = Serialize(block);
+    const unsigned char* raw = data.data();
+
+    CBlockView view;
+    BOOST_REQUIRE(view.Decode(std::move(data)));
+    // The serialized block is moved in, not copied.
+    BOOST_CHECK(view.Raw().data() == raw);
+
+    // All the records fit in the arena, with at most some alignment padding
+    // between the arrays.
+    size_t records = block.vtx.size() * sizeof(CBlockView::Tx);
+    for (const CTransactionRef& tx : block.vtx) {
+        records += tx->vin.size() * sizeof(CBlockView::TxIn) + tx->vout.size() * sizeof(CBlockView::TxOut);
+        for (const CTxIn& txin : tx->vin) records += txin.scriptWitness.stack.size() * sizeof(CBlockView::Bytes);
+    }
+    BOOST_CHECK_GE(view.ArenaBytes(), records);
+    BOOST_CHECK_LE(view.ArenaBytes(), records + 3 * alignof(std::max_align_t));
+
+    // Scripts and witness items point into the serialized block.
+    for (const CBlockView::Tx& tx : view.Transactions()) {
+        for (const CBlockView::TxIn& txin : view.Inputs(tx)) {
+            BOOST_CHECK(Contains(view.Raw(), txin.script_sig));
+            for (CBlockView::Bytes item : view.Witness(txin)) BOOST_CHECK(Contains(view.Raw(), item));
+        }
+        for (const CBlockView::TxOut& txout : view.Outputs(tx)) BOOST_CHECK(Contains(view.Raw(), txout.script_pubkey));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockview_rejects_bad_data)
+{
+    const std::vector<unsigned char> data = Serialize(BuildBlockTestCase());
+    CBlockView view;
+
+    // Every truncation fails, whether it cuts the header, a length or a script.
+    for (size_t size = 0; size < data.size(); size += 7) {
+        BOOST_CHECK(!view.Decode(std::vector<unsigned char>(data.begin(), data.begin() + size)));
+        BOOST_CHECK_EQUAL(view.Transactions().size(), 0U);
+    }
+
+    std::vector<unsigned char> extra = data;
+    extra.push_back(0);
+    BOOST_CHECK(!view.Decode(extra));
+
+    // A witness flag with only empty witness stacks is not a valid encoding.
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(tx));
+    std::vector<unsigned char> bad = Serialize(block);
+    const size_t tx_offset = ::GetSerializeSize(block.GetBlockHeader(), PROTOCOL_VERSION) + 1;
+    bad.insert(bad.begin() + tx_offset + 4, {0x00, 0x01});
+    bad.insert(bad.end() - 4, 0x00);
+    BOOST_CHECK(!view.Decode(bad));
+    bad.erase(bad.end() - 5);
+    bad.insert(bad.end() - 4, {0x01, 0x00});
+    BOOST_CHECK(view.Decode(bad));
+
+    BOOST_CHECK(view.Decode(data));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
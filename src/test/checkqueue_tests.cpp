@@ -207,6 +207,73 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
 }
 
 
+/** Test that more threads than there are deques all take part, and that the
+ * utilisation counters account for every check.
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_WorkerStats)
+{
+    auto queue = MakeUnique<Correct_Queue>(QUEUE_BATCH_SIZE);
+    boost::thread_group tg;
+    for (auto x = 0; x < MAX_CHECKQUEUE_WORKERS + 2; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+    size_t total_checks = 0;
+    FakeCheckCheckCompletion::n_calls = 0;
+    for (size_t i = 0; i < 100; ++i) {
+        CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+        std::vector<FakeCheckCheckCompletion> vChecks(InsecureRandRange(2000));
+        total_checks += vChecks.size();
+        control.Add(vChecks);
+        BOOST_REQUIRE(control.Wait());
+    }
+    tg.interrupt_all();
+    tg.join_all();
+    BOOST_CHECK_EQUAL(FakeCheckCheckCompletion::n_calls, total_checks);
+
+    const std::vector<CCheckQueueWorkerStats> stats = queue->GetWorkerStats();
+    BOOST_CHECK_EQUAL(stats.size(), (size_t)MAX_CHECKQUEUE_WORKERS);
+    uint64_t counted = 0;
+    for (const CCheckQueueWorkerStats& worker : stats) {
+        counted += worker.nChecks;
+        BOOST_CHECK(worker.nStolen <= worker.nChecks);
+        BOOST_CHECK(worker.nBatches <= worker.nChecks);
+    }
+    // Threads beyond the last deque only steal and are not counted.
+    BOOST_CHECK(counted <= total_checks);
+}
+
+/** Test that threads started after others stopped reuse their deques. */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_RestartThreads)
+{
+    auto queue = MakeUnique<Correct_Queue>(QUEUE_BATCH_SIZE);
+    size_t total_checks = 0;
+    FakeCheckCheckCompletion::n_calls = 0;
+    for (int round = 0; round < 5; ++round) {
+        boost::thread_group tg;
+        for (auto x = 0; x < SCRIPT_CHECK_THREADS; ++x) {
+           tg.create_thread([&]{queue->Thread();});
+        }
+        for (size_t i = 0; i < 10; ++i) {
+            CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+            std::vector<FakeCheckCheckCompletion> vChecks(InsecureRandRange(1000));
+            total_checks += vChecks.size();
+            control.Add(vChecks);
+            BOOST_REQUIRE(control.Wait());
+        }
+        tg.interrupt_all();
+        tg.join_all();
+        BOOST_CHECK(queue->GetWorkerStats().size() <= (size_t)SCRIPT_CHECK_THREADS + 1);
+    }
+    BOOST_CHECK_EQUAL(FakeCheckCheckCompletion::n_calls, total_checks);
+
+    // Checks added while no thread runs are all done by the master.
+    CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+    std::vector<FakeCheckCheckCompletion> vChecks(100);
+    control.Add(vChecks);
+    BOOST_REQUIRE(control.Wait());
+    BOOST_CHECK_EQUAL(FakeCheckCheckCompletion::n_calls, total_checks + 100);
+}
+
 /** Test that failing checks are caught */
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
 {
@@ -8,10 +8,12 @@
 #include <script/standard.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
 
+#include <limits>
 #include <map>
 #include <vector>
 
@@ -58,13 +60,13 @@ public:
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
-                map_[it->first] = it->second.coin;
-                if (it->second.coin.IsSpent() && InsecureRandRange(3) == 0) {
+                map_[it->first] = it->second.GetCoin();
+                if (it->second.IsSpent() && InsecureRandRange(3) == 0) {
                     // Randomly delete empty entries on write.
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            it = mapCoins.erase(it);
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -80,10 +82,10 @@ public:
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t ret = cacheCoins.DynamicMemoryUsage() + memusage::DynamicUsage(m_dirty_queue);
         size_t count = 0;
         for (const auto& entry : cacheCoins) {
-            ret += entry.second.coin.DynamicMemoryUsage();
+            ret += entry.second.DynamicMemoryUsage();
             ++count;
         }
         BOOST_CHECK_EQUAL(GetCacheSize(), count);
@@ -565,12 +567,12 @@ static size_t InsertCoinsMapEntry(CCoinsMap& map, CAmount value, char flags)
         return 0;
     }
     assert(flags != NO_ENTRY);
-    CCoinsCacheEntry entry;
-    entry.flags = flags;
-    SetCoinsValue(value, entry.coin);
-    auto inserted = map.emplace(OUTPOINT, std::move(entry));
+    Coin coin;
+    SetCoinsValue(value, coin);
+    auto inserted = map.emplace(OUTPOINT, std::move(coin));
     assert(inserted.second);
-    return inserted.first->second.coin.DynamicMemoryUsage();
+    inserted.first->second.flags = flags;
+    return inserted.first->second.DynamicMemoryUsage();
 }
 
 void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
@@ -580,10 +582,10 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
         value = ABSENT;
         flags = NO_ENTRY;
     } else {
-        if (it->second.coin.IsSpent()) {
+        if (it->second.IsSpent()) {
             value = PRUNED;
         } else {
-            value = it->second.coin.out.nValue;
+            value = it->second.GetValue();
         }
         flags = it->second.flags;
         assert(flags != NO_ENTRY);
@@ -861,4 +863,427 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    CCoinsViewDB db("", 1 << 20, true, false);
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 200; ++i) {
+            outpoints.emplace_back(InsecureRand256(), i);
+            CTxOut txout(i + 1, CScript() << OP_TRUE);
+            cache.AddCoin(outpoints.back(), Coin(txout, i, false), false);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    const COutPoint missing(InsecureRand256(), 0);
+    outpoints.push_back(missing);
+
+    // The database reads the coins on several threads, in order.
+    std::vector<Coin> coins;
+    db.GetCoins(outpoints, coins);
+    BOOST_CHECK_EQUAL(coins.size(), outpoints.size());
+    for (int i = 0; i < 200; ++i) {
+        BOOST_CHECK_EQUAL(coins[i].out.nValue, i + 1);
+        BOOST_CHECK_EQUAL(coins[i].nHeight, (uint32_t)i);
+    }
+    BOOST_CHECK(coins.back().IsSpent());
+
+    // Coins that are cached already, including spent ones, are left alone.
+    CCoinsViewCache base(&db);
+    CCoinsViewCache cache(&base);
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    BOOST_CHECK_EQUAL(cache.PrefetchCoins(outpoints), outpoints.size() - 1);
+    BOOST_CHECK(cache.AccessCoin(outpoints[0]).IsSpent());
+    for (int i = 1; i < 200; ++i) {
+        BOOST_CHECK(base.HaveCoinInCache(outpoints[i]));
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, i + 1);
+    }
+    BOOST_CHECK(!cache.HaveCoinInCache(missing));
+    BOOST_CHECK(!base.HaveCoinInCache(missing));
+    BOOST_CHECK_EQUAL(cache.PrefetchCoins(outpoints), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_write_dirty)
+{
+    CCoinsViewDB db("", 1 << 20, true, false);
+    const uint256 old_tip = InsecureRand256();
+    const uint256 new_tip = InsecureRand256();
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 10; ++i) {
+            outpoints.emplace_back(InsecureRand256(), 0);
+            cache.AddCoin(outpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+        }
+        cache.SetBestBlock(old_tip);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    BOOST_CHECK(cache.SpendCoin(outpoints[1]));
+    for (int i = 0; i < 10; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i + 11, CScript() << OP_TRUE), 2, false), false);
+    }
+    // A coin added and spent again is never written.
+    const COutPoint transient(InsecureRand256(), 0);
+    cache.AddCoin(transient, Coin(CTxOut(1, CScript() << OP_TRUE), 2, false), false);
+    BOOST_CHECK(cache.SpendCoin(transient));
+    cache.SetBestBlock(new_tip);
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 12U);
+
+    // A part of the changes leaves the database between both tips.
+    const size_t cache_size = cache.GetCacheSize();
+    BOOST_CHECK(cache.WriteDirty(5));
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 7U);
+    BOOST_CHECK(cache.HasPartialWrite());
+    BOOST_CHECK(db.GetBestBlock().IsNull());
+    BOOST_CHECK(db.GetHeadBlocks() == std::vector<uint256>({new_tip, old_tip}));
+    size_t written = 0;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (i < 2 && !db.HaveCoin(outpoints[i])) ++written;
+        if (i >= 10 && db.HaveCoin(outpoints[i])) ++written;
+    }
+    BOOST_CHECK_EQUAL(written, 5U);
+
+    // Later parts keep the transition going, and the last one completes it.
+    BOOST_CHECK(cache.WriteDirty(5));
+    BOOST_CHECK(cache.HasPartialWrite());
+    BOOST_CHECK(cache.WriteDirty(5));
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+    BOOST_CHECK(!cache.HasPartialWrite());
+    BOOST_CHECK(db.GetBestBlock() == new_tip);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(db.HaveCoin(outpoints[i]), i >= 2);
+    }
+    BOOST_CHECK(!db.HaveCoin(transient));
+
+    // The written coins stay cached, except the spent ones.
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), cache_size - 2);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[0]));
+    for (size_t i = 10; i < outpoints.size(); ++i) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+    }
+    BOOST_CHECK(cache.WriteDirty(5));
+    BOOST_CHECK(db.GetBestBlock() == new_tip);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_take_dirty)
+{
+    CCoinsViewDB db("", 1 << 20, true, false);
+    const uint256 old_tip = InsecureRand256();
+    const uint256 new_tip = InsecureRand256();
+    const COutPoint spent(InsecureRand256(), 0);
+    {
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(spent, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+        cache.SetBestBlock(old_tip);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK(cache.SpendCoin(spent));
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 4; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 2, false), false);
+    }
+    cache.SetBestBlock(new_tip);
+
+    // The first batch is only a part of the transition.
+    CCoinsMap batch;
+    BOOST_CHECK(!cache.TakeDirty(3, batch));
+    BOOST_CHECK_EQUAL(batch.size(), 3U);
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 2U);
+    BOOST_CHECK(cache.HasPartialWrite());
+
+    // Until the batch is written, the spent coin shadows the database and
+    // nothing is uncached.
+    BOOST_CHECK(!cache.HaveCoin(spent));
+    cache.Uncache(spent);
+    cache.Uncache(outpoints[0]);
+    cache.Trim(0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 5U);
+    BOOST_CHECK(!cache.HaveCoin(spent));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[0]));
+    BOOST_CHECK(db.BatchWritePartial(batch, new_tip));
+    // Once the database has it, the spent coin is dropped.
+    cache.EndWrite(false);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 4U);
+    BOOST_CHECK(!cache.HaveCoin(spent));
+    BOOST_CHECK(cache.HasPartialWrite());
+
+    // The last batch completes it, and the coins stay cached.
+    CCoinsMap rest;
+    BOOST_CHECK(cache.TakeDirty(10, rest));
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+    BOOST_CHECK(db.BatchWrite(rest, new_tip));
+    cache.EndWrite(true);
+    BOOST_CHECK(!cache.HasPartialWrite());
+    BOOST_CHECK(db.GetBestBlock() == new_tip);
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(db.HaveCoin(outpoint));
+        BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    }
+    cache.Uncache(outpoints[0]);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[0]));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_trim)
+{
+    CCoinsViewDB db("", 1 << 20, true, false);
+    CCoinsViewCache cache(&db);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 20000; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.WriteDirty(std::numeric_limits<size_t>::max()));
+    // Modify a few coins again, which have to stay cached.
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i * 7]));
+    }
+    const size_t usage = cache.DynamicMemoryUsage();
+
+    // The coins stored first are dropped, and their memory released.
+    cache.Trim(usage / 4);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= usage / 4);
+    BOOST_CHECK(cache.GetCacheSize() < outpoints.size() / 4);
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 10U);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[1]));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints.back()));
+    for (size_t i = outpoints.size() - cache.GetCacheSize() + 10; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, (CAmount)i + 1);
+    }
+
+    // The modified coins are still written.
+    BOOST_CHECK(cache.WriteDirty(std::numeric_limits<size_t>::max()));
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(!db.HaveCoin(outpoints[i * 7]));
+    }
+    BOOST_CHECK(db.HaveCoin(outpoints[1]));
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+}
+
+static std::vector<std::pair<COutPoint, Coin>> ReadCoins(const CCoinsView& view)
+{
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    std::unique_ptr<CCoinsViewCursor> cursor(view.Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        coins.emplace_back();
+        BOOST_CHECK(cursor->GetKey(coins.back().first));
+        BOOST_CHECK(cursor->GetValue(coins.back().second));
+    }
+    return coins;
+}
+
+static void CheckSameCoins(const CCoinsView& a, const CCoinsView& b)
+{
+    const std::vector<std::pair<COutPoint, Coin>> coins = ReadCoins(a);
+    const std::vector<std::pair<COutPoint, Coin>> other = ReadCoins(b);
+    BOOST_REQUIRE_EQUAL(coins.size(), other.size());
+    for (size_t i = 0; i < coins.size(); ++i) {
+        BOOST_CHECK(coins[i].first == other[i].first);
+        BOOST_CHECK(coins[i].second.out == other[i].second.out);
+        BOOST_CHECK_EQUAL(coins[i].second.nHeight, other[i].second.nHeight);
+        Coin coin;
+        BOOST_CHECK(b.GetCoin(coins[i].first, coin));
+        BOOST_CHECK(coin.out == coins[i].second.out);
+    }
+    BOOST_CHECK(a.GetBestBlock() == b.GetBestBlock());
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_shards)
+{
+    CCoinsViewDB single("", 1 << 20, true, false);
+    CCoinsViewDB sharded("", 1 << 20, true, false, 4);
+    BOOST_CHECK_EQUAL(single.GetShardCount(), 0U);
+    BOOST_CHECK_EQUAL(sharded.GetShardCount(), 4U);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; ++i) {
+        const uint256 txid = InsecureRand256();
+        for (uint32_t n = 0; n < 3; ++n) {
+            outpoints.emplace_back(txid, n);
+        }
+    }
+    for (int round = 0; round < 2; ++round) {
+        const uint256 best_block = InsecureRand256();
+        for (CCoinsViewDB* db : {&single, &sharded}) {
+            CCoinsViewCache cache(db);
+            for (size_t i = 0; i < outpoints.size(); ++i) {
+                if (round == 0) {
+                    cache.AddCoin(outpoints[i], Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+                } else if (i % 4 == 0) {
+                    BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+                }
+            }
+            cache.SetBestBlock(best_block);
+            BOOST_CHECK(cache.Flush());
+        }
+        // Merging the shards gives the order of a single database.
+        CheckSameCoins(single, sharded);
+    }
+    BOOST_CHECK_EQUAL(ReadCoins(sharded).size(), 225U);
+
+    std::vector<Coin> coins;
+    sharded.GetCoins(outpoints, coins);
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(coins[i].IsSpent(), i % 4 == 0);
+        BOOST_CHECK_EQUAL(sharded.HaveCoin(outpoints[i]), i % 4 != 0);
+    }
+
+    // Conversions keep the coins, whatever the layouts.
+    BOOST_CHECK(sharded.Reshard(0));
+    BOOST_CHECK_EQUAL(sharded.GetShardCount(), 0U);
+    CheckSameCoins(single, sharded);
+    BOOST_CHECK(single.Reshard(3));
+    BOOST_CHECK_EQUAL(single.GetShardCount(), 3U);
+    CheckSameCoins(sharded, single);
+    BOOST_CHECK(single.Reshard(5));
+    CheckSameCoins(sharded, single);
+}
+
+static uint160 InsecureRand160()
+{
+    const uint256 rand = InsecureRand256();
+    return uint160(std::vector<unsigned char>(rand.begin(), rand.begin() + 20));
+}
+
+static CScript LongScript()
+{
+    const std::vector<unsigned char> data(100, OP_RETURN);
+    return CScript(data.begin(), data.end());
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_map_scripts)
+{
+    // Scripts stored inline, and scripts that have to go to the pool,
+    // including near misses of the inline templates.
+    const uint160 hash = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    std::vector<CScript> scripts{
+        GetScriptForDestination(PKHash(hash)),
+        GetScriptForDestination(ScriptHash(hash)),
+        GetScriptForDestination(WitnessV0KeyHash(hash)),
+        GetScriptForDestination(WitnessV0ScriptHash(uint256S("0102"))),
+        CScript(),
+        CScript() << OP_TRUE,
+        LongScript(),
+    };
+    CScript near_p2pkh = GetScriptForDestination(PKHash(hash));
+    near_p2pkh.back() = OP_CHECKSIGVERIFY;
+    scripts.push_back(near_p2pkh);
+
+    CCoinsMap map;
+    for (size_t i = 0; i < scripts.size(); ++i) {
+        const Coin coin(CTxOut(i + 1, scripts[i]), i * 1000, i % 2);
+        Coin copy = coin;
+        const auto inserted = map.emplace(COutPoint(InsecureRand256(), i), std::move(copy));
+        BOOST_CHECK(inserted.second);
+        const CCoinsCacheEntry& entry = inserted.first->second;
+        BOOST_CHECK(entry.GetCoin() == coin);
+        BOOST_CHECK(entry.GetCoin().out.scriptPubKey == scripts[i]);
+        BOOST_CHECK_EQUAL(entry.GetValue(), CAmount(i + 1));
+        BOOST_CHECK_EQUAL(entry.DynamicMemoryUsage(), coin.DynamicMemoryUsage());
+    }
+
+    // Clearing and overwriting coins returns their pool nodes.
+    const size_t usage = map.DynamicMemoryUsage();
+    for (auto& entry : map) {
+        map.ClearCoin(entry.second);
+        BOOST_CHECK(entry.second.IsSpent());
+        BOOST_CHECK(entry.second.GetCoin().IsSpent());
+        BOOST_CHECK_EQUAL(entry.second.DynamicMemoryUsage(), 0U);
+        map.SetCoin(entry.second, Coin(CTxOut(1, LongScript()), 1, false));
+    }
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), usage);
+    map.clear();
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_map_random)
+{
+    // Compare the map against std::map under random insertions, updates and
+    // erasures, including erasures while iterating.
+    CCoinsMap map;
+    std::map<COutPoint, CAmount> expected;
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 2000; ++i) outpoints.emplace_back(InsecureRand256(), InsecureRandRange(4));
+
+    for (int i = 0; i < 100000; ++i) {
+        const COutPoint& outpoint = outpoints[InsecureRandRange(outpoints.size())];
+        const uint32_t op = InsecureRandRange(100);
+        if (op < 50) {
+            const CAmount value = InsecureRandRange(1000);
+            const CScript script = InsecureRandBool() ? GetScriptForDestination(PKHash(InsecureRand160())) : CScript() << OP_TRUE;
+            const auto inserted = map.emplace(outpoint);
+            BOOST_CHECK_EQUAL(inserted.second, expected.count(outpoint) == 0);
+            map.SetCoin(inserted.first->second, Coin(CTxOut(value, script), 1, false));
+            expected[outpoint] = value;
+        } else if (op < 90) {
+            const auto it = map.find(outpoint);
+            BOOST_CHECK_EQUAL(it != map.end(), expected.count(outpoint) == 1);
+            if (it != map.end()) {
+                BOOST_CHECK(it->first == outpoint);
+                BOOST_CHECK_EQUAL(it->second.GetValue(), expected[outpoint]);
+                map.erase(it);
+                expected.erase(outpoint);
+            }
+        } else if (op < 99) {
+            BOOST_CHECK_EQUAL(map.count(outpoint), expected.count(outpoint));
+        } else {
+            const size_t size = map.size();
+            size_t count = 0;
+            for (auto it = map.begin(); it != map.end(); ++count) {
+                BOOST_CHECK_EQUAL(it->second.GetValue(), expected[it->first]);
+                if (InsecureRandBool()) {
+                    expected.erase(it->first);
+                    it = map.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            BOOST_CHECK_EQUAL(count, size);
+        }
+        BOOST_CHECK_EQUAL(map.size(), expected.size());
+    }
+    size_t count = 0;
+    for (const auto& entry : map) {
+        BOOST_CHECK_EQUAL(entry.second.GetValue(), expected.at(entry.first));
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_map_memory)
+{
+    // The compact map must keep the coins of a typical UTXO set in much less
+    // memory than a node-based map of full coins.
+    struct NodeEntry {
+        Coin coin;
+        unsigned char flags;
+    };
+    std::unordered_map<COutPoint, NodeEntry, SaltedOutpointHasher> node_map;
+    CCoinsMap map;
+    size_t script_usage = 0;
+    for (int i = 0; i < 100000; ++i) {
+        const COutPoint outpoint(InsecureRand256(), 0);
+        const CScript script = i % 10 ? GetScriptForDestination(PKHash(InsecureRand160())) : GetScriptForDestination(WitnessV0ScriptHash(InsecureRand256()));
+        Coin coin(CTxOut(InsecureRandRange(MAX_MONEY), script), i, false);
+        script_usage += coin.DynamicMemoryUsage();
+        node_map.emplace(outpoint, NodeEntry{coin, 0});
+        map.emplace(outpoint, std::move(coin));
+    }
+    const size_t node_usage = memusage::DynamicUsage(node_map) + script_usage;
+    const size_t usage = map.DynamicMemoryUsage() + script_usage;
+    BOOST_TEST_MESSAGE("Coins map memory per coin: " << usage / map.size() << " bytes, against " << node_usage / node_map.size());
+    BOOST_CHECK(usage * 3 < node_usage * 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -363,4 +363,38 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/** Test that live_elements returns exactly the entries that were not erased,
+ * and that inserting them into a fresh cache restores it.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_live_elements)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        h = InsecureRand256();
+        cc.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2) {
+        BOOST_CHECK(cc.contains(hashes[i], true));
+    }
+
+    std::vector<uint256> live = cc.live_elements();
+    BOOST_CHECK_EQUAL(live.size(), hashes.size() / 2);
+    std::sort(live.begin(), live.end());
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        BOOST_CHECK_EQUAL(std::binary_search(live.begin(), live.end(), hashes[i]), i % 2 == 1);
+    }
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> restored{};
+    restored.setup_bytes(1 << 20);
+    for (const uint256& h : live) {
+        restored.insert(h);
+    }
+    for (size_t i = 1; i < hashes.size(); i += 2) {
+        BOOST_CHECK(restored.contains(hashes[i], false));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,39 @@
+// Copyright (c) 2020 Electric Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/ddms.h>
+#include <script/script.h>
+#include <test/fuzz/FuzzedDataProvider.h>
+#include <test/fuzz/fuzz.h>
+#include <test/fuzz/util.h>
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+void test_one_input(const std::vector<uint8_t>& buffer)
+{
+    FuzzedDataProvider fuzzed_data_provider(buffer.data(), buffer.size());
+
+    CScript script;
+    if (fuzzed_data_provider.ConsumeBool()) {
+        // Start from an allowed script, possibly with one byte changed
+        const unsigned int n = fuzzed_data_provider.ConsumeIntegralInRange<unsigned int>(0, DDMS_ALLOWED_SCRIPTS_NUMBER - 1);
+        script = CScript(ddmsAllowedScriptsRaw[n], ddmsAllowedScriptsRaw[n] + DDMS_SCRIPT_LENGTH);
+        if (fuzzed_data_provider.ConsumeBool()) {
+            const size_t pos = fuzzed_data_provider.ConsumeIntegralInRange<size_t>(0, DDMS_SCRIPT_LENGTH - 1);
+            script[pos] = fuzzed_data_provider.ConsumeIntegral<uint8_t>();
+        }
+    } else {
+        script = ConsumeScript(fuzzed_data_provider);
+    }
+
+    bool expected = false;
+    for (unsigned int i = 0; i < DDMS_ALLOWED_SCRIPTS_NUMBER; i++) {
+        if (script == CScript(ddmsAllowedScriptsRaw[i], ddmsAllowedScriptsRaw[i] + DDMS_SCRIPT_LENGTH)) {
+            expected = true;
+        }
+    }
+    assert(IsDdmsAllowedScript(script) == expected);
+}
@@ -4,6 +4,7 @@
 
 #include <consensus/merkle.h>
 #include <test/util/setup_common.h>
+#include <validation.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -349,4 +350,34 @@ BOOST_AUTO_TEST_CASE(merkle_test_BlockWitness)
 
     BOOST_CHECK_EQUAL(merkleRootofHashes, blockWitness);
 }
+BOOST_AUTO_TEST_CASE(merkle_test_levels)
+{
+    for (size_t ntx : std::vector<size_t>{0, 1, 2, 3, 5, 2 * MERKLE_HASH_RANGE_SIZE + 1, 4 * MERKLE_HASH_RANGE_SIZE + 3, 9001}) {
+        std::vector<uint256> leaves(ntx);
+        for (uint256& leaf : leaves) {
+            leaf = InsecureRand256();
+        }
+        for (bool mutate : {false, true}) {
+            if (mutate && ntx < 4) break;
+            // Make a pair in the second half of the leaves equal.
+            if (mutate) leaves[(ntx / 2) & ~size_t{1}] = leaves[((ntx / 2) & ~size_t{1}) + 1];
+            bool rootMutated = false;
+            const uint256 root = ComputeMerkleRoot(leaves, &rootMutated);
+            BOOST_CHECK_EQUAL(rootMutated, mutate);
+            for (bool parallel : {false, true}) {
+                g_parallel_script_checks = parallel;
+                bool mutated = !mutate;
+                const std::vector<std::vector<uint256>> levels = ComputeMerkleLevelsParallel(leaves, &mutated);
+                BOOST_CHECK(levels == ComputeMerkleLevels(leaves));
+                BOOST_CHECK_EQUAL(mutated, mutate);
+                BOOST_CHECK_EQUAL(levels.back().empty() ? uint256() : levels.back()[0], root);
+                for (size_t h = 0; h < levels.size(); h++) {
+                    BOOST_CHECK_EQUAL(levels[h].size(), (ntx + (size_t{1} << h) - 1) >> h);
+                }
+            }
+            g_parallel_script_checks = false;
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <pow.h>
@@ -171,5 +172,36 @@ BOOST_AUTO_TEST_CASE(LwmaCalculateNextWorkRequired_test)
 }
 
 
+BOOST_AUTO_TEST_CASE(LwmaCalculateNextWorkRequired_incremental_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const int nBlocks = 3000;
+    std::vector<uint256> hashes(nBlocks);
+    std::vector<CBlockIndex> blocks(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        hashes[i] = ArithToUint256(arith_uint256(i + 1));
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        // Mostly increasing timestamps, with runs of out-of-order ones
+        int64_t nDelta = InsecureRandRange(params.nPowTargetSpacing * 3);
+        if (i % 97 < 5) nDelta -= params.nPowTargetSpacing * 2;
+        blocks[i].nTime = i ? blocks[i - 1].nTime + nDelta : 1269211443;
+        blocks[i].nBits = 0x1c387f6f + (int)InsecureRandRange(0x100000);
+        blocks[i].BuildSkip();
+    }
+
+    // Walking the chain forwards slides the cached window
+    for (int i = 0; i < nBlocks; i++) {
+        BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(&blocks[i], params), LwmaCalculateNextWorkRequiredFull(&blocks[i], params));
+    }
+
+    // Random access and repeated queries, e.g. for block templates
+    for (int j = 0; j < 1000; j++) {
+        CBlockIndex* pindex = &blocks[InsecureRandRange(nBlocks)];
+        BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(pindex, params), LwmaCalculateNextWorkRequiredFull(pindex, params));
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -29,6 +29,7 @@
 #include <util/translation.h>
 #include <validation.h>
 #include <validationinterface.h>
+#include <workerpool.h>
 
 #include <functional>
 
@@ -134,6 +135,12 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
     }
     g_parallel_script_checks = true;
 
+    // Start worker pool threads, so that disk and database work is split over them.
+    constexpr int worker_pool_threads = 2;
+    for (int i = 0; i < worker_pool_threads; ++i) {
+        threadGroup.create_thread([] { g_worker_pool.Thread(); });
+    }
+
     m_node.mempool = &::mempool;
     m_node.mempool->setSanityCheck(1.0);
     m_node.banman = MakeUnique<BanMan>(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
@@ -4,11 +4,16 @@
 
 #include <chainparams.h>
 #include <consensus/block_rewards.h>
+#include <consensus/validation.h>
 #include <net.h>
 #include <validation.h>
 
 #include <test/util/setup_common.h>
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -45,6 +50,61 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, CAmount{2100000000000000});
 }
 
+/** The reward lookup as it was before the schedule could be evaluated directly */
+static CAmount GetBlockRewardForHeightLoop(uint32_t height)
+{
+    for (uint32_t i = 0; i < NUMBER_OF_REWARD_REDUCTIONS; i++) {
+        if (height < BOOTSTRAP_PERIOD + i * REWARD_REDUCTION_PERIOD) {
+            return REWARD_AMOUNTS[i];
+        }
+    }
+    return 0;
+}
+
+/** The supply issued before a height, summed era by era with the previous loop */
+static CAmount GetRewardSupplyBeforeHeightLoop(uint32_t height)
+{
+    CAmount supply = 0;
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < NUMBER_OF_REWARD_REDUCTIONS && start < height; i++) {
+        const uint32_t end = BOOTSTRAP_PERIOD + i * REWARD_REDUCTION_PERIOD;
+        supply += CAmount{std::min(height, end) - start} * GetBlockRewardForHeightLoop(start);
+        start = end;
+    }
+    return supply;
+}
+
+BOOST_AUTO_TEST_CASE(reward_schedule_test)
+{
+    static_assert(GetBlockRewardForHeight(0) == 500 * COIN, "initial reward");
+    static_assert(MAX_REWARD_SUPPLY == CAmount{2100000000000000}, "total supply");
+
+    // The boundaries of every reward era, and a sample of the heights in between.
+    const uint32_t nEndHeight = GetRewardEraStart(NUMBER_OF_REWARD_REDUCTIONS) + REWARD_REDUCTION_PERIOD;
+    std::vector<uint32_t> heights;
+    for (uint32_t i = 0; i <= NUMBER_OF_REWARD_REDUCTIONS; i++) {
+        const uint32_t nStart = BOOTSTRAP_PERIOD + i * REWARD_REDUCTION_PERIOD;
+        heights.insert(heights.end(), {nStart - 1, nStart, nStart + 1});
+    }
+    for (uint32_t nHeight = 0; nHeight < nEndHeight + 1000; nHeight += 997) {
+        heights.push_back(nHeight);
+    }
+    for (const uint32_t nHeight : heights) {
+        BOOST_CHECK_EQUAL(GetBlockRewardForHeight(nHeight), GetBlockRewardForHeightLoop(nHeight));
+        BOOST_CHECK_EQUAL(GetRewardSupplyBeforeHeight(nHeight), GetRewardSupplyBeforeHeightLoop(nHeight));
+    }
+    BOOST_CHECK_EQUAL(GetRewardSupplyBeforeHeightLoop(nEndHeight), MAX_REWARD_SUPPLY);
+    BOOST_CHECK_EQUAL(GetRewardSupplyBeforeHeight(std::numeric_limits<uint32_t>::max()), MAX_REWARD_SUPPLY);
+    BOOST_CHECK_EQUAL(GetBlockRewardForHeight(std::numeric_limits<uint32_t>::max()), 0);
+
+    // Ranges within an era, across eras and empty ones.
+    BOOST_CHECK_EQUAL(GetBlockRewardsInRange(10, 20), 10 * REWARD_AMOUNTS[0]);
+    BOOST_CHECK_EQUAL(GetBlockRewardsInRange(BOOTSTRAP_PERIOD - 1, BOOTSTRAP_PERIOD + 1), REWARD_AMOUNTS[0] + REWARD_AMOUNTS[1]);
+    BOOST_CHECK_EQUAL(GetBlockRewardsInRange(0, nEndHeight), MAX_REWARD_SUPPLY);
+    BOOST_CHECK_EQUAL(GetBlockRewardsInRange(20, 10), 0);
+    BOOST_CHECK_EQUAL(GetBlockRewardsInRange(nEndHeight, nEndHeight + 1), 0);
+}
+
 static bool ReturnFalse() { return false; }
 static bool ReturnTrue() { return true; }
 
@@ -61,4 +121,49 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+static CBlock BlockWithInvalidTransactions(const std::vector<std::string>& reasons)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+    coinbase.vout.emplace_back(500 * COIN, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (const std::string& reason : reasons) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(InsecureRand256(), 0);
+        tx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+        if (reason == "bad-txns-inputs-duplicate") tx.vin.push_back(tx.vin[0]);
+        if (reason == "bad-txns-vout-negative") tx.vout[0].nValue = -1;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_parallel_precheck)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    std::vector<std::string> reasons(300);
+    const CBlock valid = BlockWithInvalidTransactions(reasons);
+    reasons[250] = "bad-txns-vout-negative";
+    reasons[50] = "bad-txns-inputs-duplicate";
+    reasons[51] = "bad-txns-vout-negative";
+    const CBlock invalid = BlockWithInvalidTransactions(reasons);
+
+    // The worker pool threads of the fixture report the same first failure
+    // as the serial loop.
+    for (bool parallel : {false, true}) {
+        g_parallel_script_checks = parallel;
+        BlockValidationState state;
+        BOOST_CHECK(CheckBlock(valid, state, params, false, false));
+        for (int i = 0; i < 10; ++i) {
+            BlockValidationState invalid_state;
+            BOOST_CHECK(!CheckBlock(invalid, invalid_state, params, false, false));
+            BOOST_CHECK_EQUAL(invalid_state.GetRejectReason(), "bad-txns-inputs-duplicate");
+            BOOST_CHECK(invalid_state.GetDebugMessage().find(invalid.vtx[51]->GetHash().ToString()) != std::string::npos);
+        }
+    }
+    g_parallel_script_checks = false;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
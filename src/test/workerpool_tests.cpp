@@ -0,0 +1,88 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <workerpool.h>
+
+#include <test/util/setup_common.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(workerpool_tests, BasicTestingSetup)
+
+/** Run every part exactly once, on the pool threads or the calling thread. */
+static void CheckRunParallel(CWorkerPool& pool)
+{
+    for (size_t count : {0, 1, 2, 7, 100}) {
+        std::vector<std::atomic<int>> runs(count);
+        for (auto& run : runs) run = 0;
+        pool.RunParallel(count, [&](size_t i) { ++runs[i]; });
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(runs[i], 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(workerpool_run)
+{
+    CWorkerPool pool;
+
+    // Without threads the caller runs all the parts.
+    BOOST_CHECK_EQUAL(pool.NumThreads(), 0);
+    CheckRunParallel(pool);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.create_thread([&pool] { pool.Thread(); });
+    }
+    while (pool.NumThreads() < 4) boost::this_thread::yield();
+    CheckRunParallel(pool);
+
+    // A started job runs while the caller does something else.
+    std::atomic<bool> ran{false};
+    std::shared_ptr<CWorkerPool::Job> job = pool.Start(1, [&](size_t) { ran = true; });
+    pool.Wait(*job);
+    BOOST_CHECK(ran);
+
+    // The first error is rethrown once all the parts are done.
+    std::atomic<int> done{0};
+    BOOST_CHECK_THROW(pool.RunParallel(10, [&](size_t i) {
+        ++done;
+        if (i % 3 == 1) throw std::runtime_error("part failed");
+    }), std::runtime_error);
+    BOOST_CHECK_EQUAL(done, 10);
+
+    // A job limited to some of the threads leaves the others to later jobs.
+    std::atomic<bool> release{false};
+    std::atomic<int> started{0};
+    std::shared_ptr<CWorkerPool::Job> slow = pool.Start(4, [&](size_t) {
+        ++started;
+        while (!release) boost::this_thread::yield();
+    }, 3);
+    while (started < 3) boost::this_thread::yield();
+    std::shared_ptr<CWorkerPool::Job> fast = pool.Start(1, [&](size_t) { ran = false; });
+    while (ran) boost::this_thread::yield();
+    release = true;
+    pool.Wait(*slow);
+    pool.Wait(*fast);
+    BOOST_CHECK_EQUAL(started, 4);
+
+    // Jobs started from pool threads complete even when all the threads are busy.
+    std::atomic<int> inner{0};
+    pool.RunParallel(8, [&](size_t) {
+        pool.RunParallel(8, [&](size_t) { ++inner; });
+    });
+    BOOST_CHECK_EQUAL(inner, 64);
+
+    threads.interrupt_all();
+    threads.join_all();
+    BOOST_CHECK_EQUAL(pool.NumThreads(), 0);
+    CheckRunParallel(pool);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,8 @@
 
 #include <txdb.h>
 
+#include <crypto/siphash.h>
+#include <node/utxo_snapshot.h>
 #include <pow.h>
 #include <random.h>
 #include <shutdown.h>
@@ -13,7 +15,11 @@
 #include <util/system.h>
 #include <util/translation.h>
 #include <util/vector.h>
+#include <workerpool.h>
 
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -28,6 +34,10 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_AUX_HEADER = 'a';
+static const char DB_SNAPSHOT_BASE = 'S';
+static const char DB_SNAPSHOT_VALIDATION = 'V';
+static const char DB_SHARD_LAYOUT = 'N';
 
 namespace {
 
@@ -51,18 +61,148 @@ struct CoinEntry {
     }
 };
 
+/** One batch per shard, written in parallel on the worker pool. */
+class ShardBatches
+{
+    const std::vector<std::unique_ptr<CDBWrapper>>& m_dbs;
+    std::vector<std::unique_ptr<CDBBatch>> m_batches;
+
+public:
+    explicit ShardBatches(const std::vector<std::unique_ptr<CDBWrapper>>& dbs) : m_dbs(dbs)
+    {
+        for (const auto& db : m_dbs) {
+            m_batches.emplace_back(new CDBBatch(*db));
+        }
+    }
+
+    CDBBatch& operator[](size_t i) { return *m_batches[i]; }
+
+    size_t SizeEstimate() const
+    {
+        size_t size = 0;
+        for (const auto& batch : m_batches) size += batch->SizeEstimate();
+        return size;
+    }
+
+    void Write(bool fSync)
+    {
+        g_worker_pool.RunParallel(m_batches.size(), [&](size_t i) {
+            m_dbs[i]->WriteBatch(*m_batches[i], fSync);
+            m_batches[i]->Clear();
+        });
+    }
+};
+
+bool HasCoins(const CDBWrapper& db)
+{
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    pcursor->Seek(DB_COIN);
+    char key;
+    return pcursor->Valid() && pcursor->GetKey(key) && key == DB_COIN;
 }
 
-CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) : db(ldb_path, nCacheSize, fMemory, fWipe, true)
+/** Remove the coins of a database, after they were moved to shards. */
+void EraseCoins(CDBWrapper& db)
 {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    CDBBatch batch(db);
+    COutPoint outpoint;
+    for (pcursor->Seek(DB_COIN); pcursor->Valid(); pcursor->Next()) {
+        CoinEntry entry(&outpoint);
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN) break;
+        batch.Erase(entry);
+        if (batch.SizeEstimate() > (size_t)nDefaultDbBatchSize) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+    db.WriteBatch(batch, true);
+    db.CompactRange(DB_COIN, (char)(DB_COIN+1));
+}
+
+}
+
+size_t CoinsShardLayout::Index(const uint256& txid) const
+{
+    return SipHashUint256(k0, k1, txid) % count;
+}
+
+CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe, unsigned int shards) :
+    db(ldb_path, nCacheSize, fMemory, fWipe, true), m_path(ldb_path), m_cache_size(nCacheSize), m_memory(fMemory)
+{
+    bool fNew = false;
+    if (!db.Read(DB_SHARD_LAYOUT, m_layout) && shards > 0 &&
+        !db.Exists(DB_BEST_BLOCK) && !db.Exists(DB_HEAD_BLOCKS) && !HasCoins(db)) {
+        m_layout.count = shards;
+        m_layout.generation = 1;
+        m_layout.k0 = GetRand(std::numeric_limits<uint64_t>::max());
+        m_layout.k1 = GetRand(std::numeric_limits<uint64_t>::max());
+        db.Write(DB_SHARD_LAYOUT, m_layout, true);
+        fNew = true;
+    }
+    RemoveStaleShards();
+    // Shards left over from a wiped database may share the directory.
+    m_shards = OpenShards(m_layout, fWipe || fNew);
+    if (!m_shards.empty() && HasCoins(db)) {
+        LogPrintf("Removing the coins left in the main coin database by an interrupted conversion\n");
+        EraseCoins(db);
+    }
+}
+
+fs::path CCoinsViewDB::ShardsDir(const CoinsShardLayout& layout) const
+{
+    return m_path / strprintf("shards%u", layout.generation);
+}
+
+std::vector<std::unique_ptr<CDBWrapper>> CCoinsViewDB::OpenShards(const CoinsShardLayout& layout, bool fWipe) const
+{
+    std::vector<std::unique_ptr<CDBWrapper>> shards;
+    if (layout.count == 0) return shards;
+    // The shards hold the coins, so they split the cache of the database
+    // between them, rather than each using all of it.
+    const size_t cache_size = std::max<size_t>(m_cache_size / layout.count, nMinCoinsDBShardCache << 20);
+    for (uint32_t i = 0; i < layout.count; ++i) {
+        shards.emplace_back(new CDBWrapper(ShardsDir(layout) / strprintf("%03u", i), cache_size, m_memory, fWipe, true));
+    }
+    return shards;
+}
+
+void CCoinsViewDB::RemoveStaleShards()
+{
+    if (m_memory || !fs::is_directory(m_path)) return;
+    for (const fs::directory_entry& entry : fs::directory_iterator(m_path)) {
+        const std::string name = entry.path().filename().string();
+        if (name.compare(0, 6, "shards") == 0 && (m_layout.count == 0 || entry.path() != ShardsDir(m_layout))) {
+            LogPrintf("Removing stale coin database shards %s\n", entry.path().string());
+            fs::remove_all(entry.path());
+        }
+    }
+}
+
+CDBWrapper& CCoinsViewDB::ShardFor(const uint256& txid) const
+{
+    if (m_shards.empty()) return const_cast<CDBWrapper&>(db);
+    return *m_shards[m_layout.Index(txid)];
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
-    return db.Read(CoinEntry(&outpoint), coin);
+    return ShardFor(outpoint.hash).Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
-    return db.Exists(CoinEntry(&outpoint));
+    return ShardFor(outpoint.hash).Exists(CoinEntry(&outpoint));
+}
+
+void CCoinsViewDB::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    coins.assign(outpoints.size(), Coin());
+    const size_t nThreads = std::max<size_t>(1, std::min<size_t>(nCoinsDbReadThreads, outpoints.size() / nCoinsDbReadBatch));
+    const size_t nPerThread = (outpoints.size() + nThreads - 1) / nThreads;
+    g_worker_pool.RunParallel(nThreads, [&](size_t nThread) {
+        const size_t nEnd = std::min(outpoints.size(), (nThread + 1) * nPerThread);
+        for (size_t i = nThread * nPerThread; i < nEnd; ++i) {
+            if (!ShardFor(outpoints[i].hash).Read(CoinEntry(&outpoints[i]), coins[i])) coins[i].Clear();
+        }
+    });
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -81,7 +221,16 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, true);
+}
+
+bool CCoinsViewDB::BatchWritePartial(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, false);
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool complete) {
     CDBBatch batch(db);
+    ShardBatches shard_batches(m_shards);
     size_t count = 0;
     size_t changed = 0;
     size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
@@ -90,10 +239,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
 
     uint256 old_tip = GetBestBlock();
     if (old_tip.IsNull()) {
-        // We may be in the middle of replaying.
+        // We may be in the middle of replaying, or of a transition written
+        // in parts by BatchWritePartial. The blocks connected since the last
+        // part are replayed along with the others.
         std::vector<uint256> old_heads = GetHeadBlocks();
         if (old_heads.size() == 2) {
-            assert(old_heads[0] == hashBlock);
             old_tip = old_heads[1];
         }
     }
@@ -104,23 +254,35 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     // interrupting after partial writes from multiple independent reorgs.
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
+    if (!m_shards.empty()) {
+        // The shards are separate databases, which may be written in any
+        // order: the marker has to be on disk before any of them changes.
+        db.WriteBatch(batch, true);
+        batch.Clear();
+    }
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
+            CDBBatch& target = m_shards.empty() ? batch : shard_batches[m_layout.Index(it->first.hash)];
+            if (it->second.IsSpent())
+                target.Erase(entry);
             else
-                batch.Write(entry, it->second.coin);
+                target.Write(entry, it->second.GetCoin());
             changed++;
         }
         count++;
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
-        if (batch.SizeEstimate() > batch_size) {
-            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-            db.WriteBatch(batch);
-            batch.Clear();
+        const size_t size = batch.SizeEstimate() + shard_batches.SizeEstimate();
+        if (size > batch_size) {
+            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", size * (1.0 / 1048576.0));
+            if (m_shards.empty()) {
+                db.WriteBatch(batch);
+                batch.Clear();
+            } else {
+                shard_batches.Write(false);
+            }
             if (crash_simulate) {
                 static FastRandomContext rng;
                 if (rng.randrange(crash_simulate) == 0) {
@@ -131,11 +293,15 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
     }
 
-    // In the last batch, mark the database as consistent with hashBlock again.
-    batch.Erase(DB_HEAD_BLOCKS);
-    batch.Write(DB_BEST_BLOCK, hashBlock);
+    // In the last batch, mark the database as consistent with hashBlock again,
+    // once the shards are synced.
+    LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", (batch.SizeEstimate() + shard_batches.SizeEstimate()) * (1.0 / 1048576.0));
+    shard_batches.Write(complete);
+    if (complete) {
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+    }
 
-    LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
@@ -143,7 +309,39 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
 
 size_t CCoinsViewDB::EstimateSize() const
 {
-    return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    if (m_shards.empty()) return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    size_t size = 0;
+    for (const auto& shard : m_shards) {
+        size += shard->EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    }
+    return size;
+}
+
+bool CCoinsViewDB::WriteSnapshotBase(const SnapshotMetadata& metadata, const uint256& txoutset_hash)
+{
+    return db.Write(DB_SNAPSHOT_BASE, std::make_pair(metadata, txoutset_hash), true);
+}
+
+bool CCoinsViewDB::ReadSnapshotBase(SnapshotMetadata& metadata, uint256& txoutset_hash) const
+{
+    std::pair<SnapshotMetadata, uint256> base;
+    if (!db.Read(DB_SNAPSHOT_BASE, base)) return false;
+    metadata = base.first;
+    txoutset_hash = base.second;
+    return true;
+}
+
+bool CCoinsViewDB::WriteSnapshotValidation(bool valid)
+{
+    return db.Write(DB_SNAPSHOT_VALIDATION, valid ? '1' : '0', true);
+}
+
+bool CCoinsViewDB::ReadSnapshotValidation(bool& valid) const
+{
+    char flag;
+    if (!db.Read(DB_SNAPSHOT_VALIDATION, flag)) return false;
+    valid = flag == '1';
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -170,27 +368,63 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    return Cursor(uint256());
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(const uint256 &start) const
+{
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
-    // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    if (m_shards.empty()) {
+        i->AddSource(const_cast<CDBWrapper&>(db).NewIterator(), start);
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        for (const auto& shard : m_shards) {
+            i->AddSource(shard->NewIterator(), start);
+        }
     }
+    i->SelectSource();
     return i;
 }
 
+void CCoinsViewDBCursor::AddSource(CDBIterator* pcursorIn, const uint256& start)
+{
+    Source source;
+    source.pcursor.reset(pcursorIn);
+    const COutPoint first(start, 0);
+    source.pcursor->Seek(CoinEntry(&first));
+    // Cache key of first record
+    source.ReadKey();
+    sources.push_back(std::move(source));
+}
+
+void CCoinsViewDBCursor::Source::ReadKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
+        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else {
+        keyTmp.first = entry.key;
+    }
+}
+
+void CCoinsViewDBCursor::SelectSource()
+{
+    current = sources.size();
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i].keyTmp.first != DB_COIN) continue;
+        if (current == sources.size() || sources[i].keyTmp.second.hash < sources[current].keyTmp.second.hash) {
+            current = i;
+        }
+    }
+}
+
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COIN) {
-        key = keyTmp.second;
+    if (Valid()) {
+        key = sources[current].keyTmp.second;
         return true;
     }
     return false;
@@ -198,28 +432,24 @@ bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 
 bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coin);
+    return sources[current].pcursor->GetValue(coin);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
 {
-    return pcursor->GetValueSize();
+    return sources[current].pcursor->GetValueSize();
 }
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COIN;
+    return current < sources.size();
 }
 
 void CCoinsViewDBCursor::Next()
 {
-    pcursor->Next();
-    CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
-    } else {
-        keyTmp.first = entry.key;
-    }
+    sources[current].pcursor->Next();
+    sources[current].ReadKey();
+    SelectSource();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -234,6 +464,26 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::WriteAuxBlockHeader(const uint256& hash, const CAuxBlockHeader& auxHeader) {
+    return Write(std::make_pair(DB_AUX_HEADER, hash), auxHeader);
+}
+
+bool CBlockTreeDB::ReadAuxBlockHeader(const uint256& hash, CAuxBlockHeader& auxHeader) {
+    return Read(std::make_pair(DB_AUX_HEADER, hash), auxHeader);
+}
+
+bool CBlockTreeDB::HaveAuxBlockHeader(const uint256& hash) {
+    return Exists(std::make_pair(DB_AUX_HEADER, hash));
+}
+
+bool CBlockTreeDB::WriteAuxBlockHeaders(const std::vector<std::pair<uint256, std::shared_ptr<CAuxBlockHeader>>>& auxHeaders) {
+    CDBBatch batch(*this);
+    for (const auto& entry : auxHeaders) {
+        batch.Write(std::make_pair(DB_AUX_HEADER, entry.first), *entry.second);
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -414,3 +664,86 @@ bool CCoinsViewDB::Upgrade() {
     LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
     return !ShutdownRequested();
 }
+
+bool CCoinsViewDB::Reshard(unsigned int shards) {
+    if (shards == m_shards.size()) {
+        return true;
+    }
+
+    // Copy the coins to the new layout first, and only switch to it once
+    // it is complete. What an interruption leaves behind is removed when
+    // the database is opened again.
+    CoinsShardLayout layout;
+    std::vector<std::unique_ptr<CDBWrapper>> new_shards;
+    if (shards > 0) {
+        layout.count = shards;
+        layout.generation = m_layout.generation + 1;
+        layout.k0 = GetRand(std::numeric_limits<uint64_t>::max());
+        layout.k1 = GetRand(std::numeric_limits<uint64_t>::max());
+        new_shards = OpenShards(layout, true);
+    }
+
+    LogPrintf("Converting the coin database from %u to %u shards...\n", m_shards.size(), shards);
+    LogPrintf("[0%%]..."); /* Continued */
+    uiInterface.ShowProgress(_("Converting UTXO database").translated, 0, true);
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    CDBBatch batch(db);
+    ShardBatches shard_batches(new_shards);
+    int reportDone = 0;
+    int64_t count = 0;
+    std::unique_ptr<CCoinsViewCursor> pcursor(Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin)) {
+            return error("%s: unable to read coin", __func__);
+        }
+        if (count++ % 256 == 0) {
+            uint32_t high = 0x100 * *outpoint.hash.begin() + *(outpoint.hash.begin() + 1);
+            int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+            uiInterface.ShowProgress(_("Converting UTXO database").translated, percentageDone, true);
+            if (reportDone < percentageDone/10) {
+                // report max. every 10% step
+                LogPrintf("[%d%%]...", percentageDone); /* Continued */
+                reportDone = percentageDone/10;
+            }
+        }
+        CoinEntry entry(&outpoint);
+        (shards > 0 ? shard_batches[layout.Index(outpoint.hash)] : batch).Write(entry, coin);
+        if (batch.SizeEstimate() + shard_batches.SizeEstimate() > batch_size) {
+            db.WriteBatch(batch);
+            batch.Clear();
+            shard_batches.Write(false);
+        }
+    }
+    pcursor.reset();
+    uiInterface.ShowProgress("", 100, false);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    if (ShutdownRequested()) {
+        return false;
+    }
+    db.WriteBatch(batch, true);
+    shard_batches.Write(true);
+
+    // Switch to the new layout, then drop the old copy of the coins.
+    if (shards > 0) {
+        db.Write(DB_SHARD_LAYOUT, layout, true);
+    } else {
+        db.Erase(DB_SHARD_LAYOUT, true);
+    }
+    const CoinsShardLayout old_layout = m_layout;
+    m_layout = layout;
+    m_shards.swap(new_shards);
+    new_shards.clear();
+    if (old_layout.count == 0) {
+        EraseCoins(db);
+    } else if (!m_memory) {
+        fs::remove_all(ShardsDir(old_layout));
+    }
+    LogPrintf("Converted %d coins to %u shards\n", count, shards);
+    return true;
+}
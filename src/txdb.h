@@ -18,6 +18,7 @@
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class SnapshotMetadata;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -38,8 +39,40 @@ static const int64_t nMaxTxIndexCache = 1024;
 static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max number of parts a CCoinsViewDB::GetCoins call reads in parallel on the worker pool
+static const int nCoinsDbReadThreads = 8;
+//! Min number of coins read by each of those parts
+static const size_t nCoinsDbReadBatch = 16;
+//! Max number of LevelDB instances the coin database can be split into (-coinsdbshards)
+static const int MAX_COINS_DB_SHARDS = 64;
+//! Min cache of each of those instances (MiB)
+static const int64_t nMinCoinsDBShardCache = 1;
+
+/** How the coins of a CCoinsViewDB are split into shards. */
+struct CoinsShardLayout {
+    //! Number of shards, 0 if the coins are in the main database.
+    uint32_t count{0};
+    //! Shards are in the shards<generation>/ subdirectory, so that a
+    //! conversion can build the new ones next to the current ones.
+    uint32_t generation{0};
+    uint64_t k0{0};
+    uint64_t k1{0};
+
+    //! All the outputs of a transaction are in the same shard.
+    size_t Index(const uint256& txid) const;
+
+    SERIALIZE_METHODS(CoinsShardLayout, obj) { READWRITE(obj.count, obj.generation, obj.k0, obj.k1); }
+};
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * The coins are either kept in that database, or split by a salted hash of
+ * their txid into several LevelDB instances with their own share of the cache
+ * and write buffer, which are written in parallel and compacted
+ * independently. The main database then holds everything but the coins, the
+ * layout included.
+ */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
@@ -47,19 +80,56 @@ protected:
 public:
     /**
      * @param[in] ldb_path    Location in the filesystem where leveldb data will be stored.
+     * @param[in] nCacheSize  Cache size of the main database, shared by the shards (each gets at least nMinCoinsDBShardCache).
+     * @param[in] shards      Number of shards of a new database. An existing database keeps its layout.
      */
-    explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe);
+    explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe, unsigned int shards = 0);
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
+    //! Reads the coins on several threads, as LevelDB allows concurrent reads.
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWritePartial(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
+    //! Cursor over the coins whose txid is not lower than start.
+    CCoinsViewCursor *Cursor(const uint256 &start) const;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+    //! Copy the coins to a layout with the given number of shards (0 for a single database). Returns false on error or shutdown.
+    bool Reshard(unsigned int shards);
+    unsigned int GetShardCount() const { return m_shards.size(); }
     size_t EstimateSize() const override;
+
+    //! Record the UTXO snapshot this database was populated from, and the hash_serialized_2 of its coins.
+    bool WriteSnapshotBase(const SnapshotMetadata& metadata, const uint256& txoutset_hash);
+    //! Returns false for a database that was built by connecting blocks.
+    bool ReadSnapshotBase(SnapshotMetadata& metadata, uint256& txoutset_hash) const;
+    //! Record whether the history below the snapshot base produced the same coins.
+    bool WriteSnapshotValidation(bool valid);
+    //! Returns false while the history below the snapshot base has not been validated yet.
+    bool ReadSnapshotValidation(bool& valid) const;
+
+private:
+    const fs::path m_path;
+    const size_t m_cache_size;
+    const bool m_memory;
+    CoinsShardLayout m_layout;
+    std::vector<std::unique_ptr<CDBWrapper>> m_shards;
+
+    //! Open the shards of a layout, wiping them if requested.
+    std::vector<std::unique_ptr<CDBWrapper>> OpenShards(const CoinsShardLayout& layout, bool fWipe) const;
+    fs::path ShardsDir(const CoinsShardLayout& layout) const;
+    CDBWrapper& ShardFor(const uint256& txid) const;
+    //! Remove what an interrupted conversion left behind.
+    void RemoveStaleShards();
+
+    //! Write the entries of mapCoins as part of the transition to hashBlock,
+    //! and mark the transition as done if complete is set.
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool complete);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -76,10 +146,23 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
-    std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, COutPoint> keyTmp;
+    explicit CCoinsViewDBCursor(const uint256 &hashBlockIn): CCoinsViewCursor(hashBlockIn) {}
+
+    //! Coins of one LevelDB instance.
+    struct Source {
+        std::unique_ptr<CDBIterator> pcursor;
+        std::pair<char, COutPoint> keyTmp;
+
+        void ReadKey();
+    };
+    //! One source per shard. As a shard has all the outputs of a transaction,
+    //! merging them on the txid gives the order of a single database.
+    std::vector<Source> sources;
+    size_t current{0};
+
+    void AddSource(CDBIterator* pcursorIn, const uint256& start);
+    //! Point current at the source with the smallest key.
+    void SelectSource();
 
     friend class CCoinsViewDB;
 };
@@ -98,6 +181,11 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! Auxpow headers are kept apart from CDiskBlockIndex so that serving headers never needs the block files.
+    bool WriteAuxBlockHeader(const uint256& hash, const CAuxBlockHeader& auxHeader);
+    bool ReadAuxBlockHeader(const uint256& hash, CAuxBlockHeader& auxHeader);
+    bool HaveAuxBlockHeader(const uint256& hash);
+    bool WriteAuxBlockHeaders(const std::vector<std::pair<uint256, std::shared_ptr<CAuxBlockHeader>>>& auxHeaders);
 };
 
 #endif // ELCASH_TXDB_H
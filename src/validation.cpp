@@ -17,17 +17,21 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/hmac_sha256.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
 #include <index/txindex.h>
 #include <logging.h>
 #include <logging/timer.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
 #include <pow.h>
 #include <primitives/block.h>
+#include <primitives/blockview.h>
 #include <primitives/transaction.h>
 #include <random.h>
 #include <reverse_iterator.h>
@@ -48,8 +52,15 @@
 #include <util/translation.h>
 #include <validationinterface.h>
 #include <warnings.h>
+#include <workerpool.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <limits>
 #include <string>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -84,12 +95,20 @@ BlockManager g_blockman;
 } // anon namespace
 
 std::unique_ptr<CChainState> g_chainstate;
+std::unique_ptr<CChainState> g_background_chainstate;
+//! Set once g_background_chainstate reached the snapshot base with the same coins.
+static bool g_snapshot_validated GUARDED_BY(cs_main) = false;
 
 CChainState& ChainstateActive() {
     assert(g_chainstate);
     return *g_chainstate;
 }
 
+CChainState* ChainstateBackground() {
+    AssertLockHeld(cs_main);
+    return g_snapshot_validated ? nullptr : g_background_chainstate.get();
+}
+
 CChain& ChainActive() {
     assert(g_chainstate);
     return g_chainstate->m_chain;
@@ -1113,7 +1132,8 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
-bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params) {
+/** The checks of CheckProofOfWork that come before the auxpow itself is checked. */
+static bool CheckProofOfWorkParent(const CBlockHeader& block, const Consensus::Params& params) {
 	 if (block.IsAuxPow() && block.GetBaseVersion() == VERSIONBITS_BASE_BLOCK_VERSION
 	 && params.fStrictChainId && block.GetChainId() != params.nAuxpowChainId)
 		 return error("%s: block does not have our chain ID (got %d, expected %d, full nVersion %d)",
@@ -1130,18 +1150,68 @@ bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params
 		 return true;
 	 }
 
-	 /* We have auxpow. Check it. */
+	 /* We have auxpow. Check the parent block.  */
 	 if (!block.IsAuxPow())
 		 return error("%s : auxpow on block with non-auxpow version", __func__);
 
 	 if (!CheckProofOfWork(block.auxHeader->getParentBlockHash(), block.nBits, params))
 		 return error("%s : AUX proof of work failed", __func__);
-	 if (!CAuxPow::check(*block.auxHeader, block.GetHash(), block.GetChainId(), params))
+
+	 return true;
+}
+
+bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params) {
+	 if (!CheckProofOfWorkParent(block, params))
+		 return false;
+
+	 if (block.auxHeader && !CAuxPow::check(*block.auxHeader, block.GetHash(), block.GetChainId(), params))
 		 return error("%s : AUX POW is not valid", __func__);
 
 	 return true;
 }
 
+/** Same as CheckProofOfWork for each of the headers, with the auxpows checked together. */
+static void CheckProofOfWorkRange(const CBlockHeader* headers, size_t nCount, const Consensus::Params& params, bool* pfValid) {
+    std::vector<const CBlockHeader*> vAuxHeaders;
+    std::vector<size_t> vAuxPos;
+    for (size_t i = 0; i < nCount; ++i) {
+        pfValid[i] = CheckProofOfWorkParent(headers[i], params);
+        if (pfValid[i] && headers[i].auxHeader) {
+            vAuxHeaders.push_back(&headers[i]);
+            vAuxPos.push_back(i);
+        }
+    }
+
+    const std::vector<bool> vAuxValid = CAuxPow::checkBatch(vAuxHeaders, params);
+    for (size_t j = 0; j < vAuxPos.size(); ++j) {
+        if (!vAuxValid[j]) {
+            pfValid[vAuxPos[j]] = error("%s : AUX POW is not valid", "CheckProofOfWork");
+        }
+    }
+}
+
+std::vector<bool> CheckProofOfWorkBatch(const std::vector<CBlockHeader>& headers, const Consensus::Params& params)
+{
+    std::unique_ptr<bool[]> valid(new bool[headers.size()]());
+
+    // Hand out the headers in ranges, so that each range can walk the
+    // merkle branches of several auxpows at once. The ranges run on the
+    // worker pool: ConnectBlock holds the script-checking threads for a
+    // whole block, and headers must not wait for it.
+    if (g_parallel_script_checks && headers.size() > AUXPOW_CHECK_RANGE_SIZE) {
+        const size_t nRanges = (headers.size() + AUXPOW_CHECK_RANGE_SIZE - 1) / AUXPOW_CHECK_RANGE_SIZE;
+        g_worker_pool.RunParallel(nRanges, [&](size_t i) {
+            const size_t nPos = i * AUXPOW_CHECK_RANGE_SIZE;
+            const size_t nCount = std::min(AUXPOW_CHECK_RANGE_SIZE, headers.size() - nPos);
+            CheckProofOfWorkRange(&headers[nPos], nCount, params, &valid[nPos]);
+        });
+    } else if (!headers.empty()) {
+        CheckProofOfWorkRange(headers.data(), headers.size(), params, valid.get());
+    }
+
+    return std::vector<bool>(valid.get(), valid.get() + headers.size());
+}
+
 static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
@@ -1203,6 +1273,48 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const FlatFilePos& pos, const Consensus::Params& consensusParams)
+{
+    header.SetNull();
+
+    FILE* file = OpenBlockFile(pos, true);
+    if (file == nullptr)
+        return error("ReadBlockHeaderFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    // The header is at the front of the block record, so stop reading after
+    // it instead of pulling in (and deserializing) every transaction. The
+    // buffered file wraps around if an auxpow header exceeds the buffer.
+    CBufferedFile filein(file, BLOCK_HEADER_READ_BUFFER_SIZE, 0, SER_DISK, CLIENT_VERSION);
+    try {
+        filein >> header;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    // Check the header
+    if (!CheckProofOfWork(header, consensusParams))
+        return error("ReadBlockHeaderFromDisk: Errors in block header at %s", pos.ToString());
+
+    return true;
+}
+
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    FlatFilePos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    if (!ReadBlockHeaderFromDisk(header, blockPos, consensusParams))
+        return false;
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadBlockHeaderFromDisk(CBlockHeader&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
     FlatFilePos hpos = pos;
@@ -1249,6 +1361,25 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+bool ReadBlockViewFromDisk(CBlockView& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, const CMessageHeader::MessageStartChars& message_start)
+{
+    std::vector<uint8_t> data;
+    if (!ReadRawBlockFromDisk(data, pindex, message_start)) {
+        return false;
+    }
+    if (!block.Decode(std::move(data))) {
+        return error("%s: Deserialize error for %s", __func__, pindex->ToString());
+    }
+    // Check the header
+    if (!CheckProofOfWork(block.GetHeader(), consensusParams)) {
+        return error("%s: Errors in block header for %s", __func__, pindex->ToString());
+    }
+    if (block.GetHash() != pindex->GetBlockHash()) {
+        return error("%s: GetHash() doesn't match index for %s", __func__, pindex->ToString());
+    }
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight)
 {
     return GetBlockRewardForHeight(nHeight);
@@ -1259,7 +1390,7 @@ CoinsViews::CoinsViews(
     size_t cache_size_bytes,
     bool in_memory,
     bool should_wipe) : m_dbview(
-                            GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe),
+                            GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe, gArgs.GetArg("-coinsdbshards", 0)),
                         m_catcherview(&m_dbview) {}
 
 void CoinsViews::InitCache()
@@ -1271,6 +1402,11 @@ void CoinsViews::InitCache()
 // in a future commit.
 CChainState::CChainState() : m_blockman(g_blockman) {}
 
+bool CChainState::IsActive() const
+{
+    return this == g_chainstate.get();
+}
+
 
 void CChainState::InitCoinsDB(
     size_t cache_size_bytes,
@@ -1804,6 +1940,62 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+void LogScriptCheckStats() {
+    const std::vector<CCheckQueueWorkerStats> stats = scriptcheckqueue.GetWorkerStats();
+    for (size_t i = 0; i < stats.size(); i++) {
+        LogPrint(BCLog::BENCH, "Script check thread %u: %u checks in %u batches, %u stolen, busy %.2fs\n",
+            i, stats[i].nChecks, stats[i].nBatches, stats[i].nStolen, stats[i].nBusyMicros * MICRO);
+    }
+}
+
+std::vector<std::vector<uint256>> ComputeMerkleLevelsParallel(std::vector<uint256> leaves, bool* mutated)
+{
+    bool mutation = false;
+    std::vector<std::vector<uint256>> levels;
+    levels.push_back(std::move(leaves));
+    while (levels.back().size() > 1) {
+        const std::vector<uint256>& level = levels.back();
+        std::vector<uint256> next(level.size() / 2);
+        if (g_parallel_script_checks && next.size() > 2 * MERKLE_HASH_RANGE_SIZE) {
+            const size_t nRanges = (next.size() + MERKLE_HASH_RANGE_SIZE - 1) / MERKLE_HASH_RANGE_SIZE;
+            std::unique_ptr<bool[]> mutations(new bool[nRanges]());
+            g_worker_pool.RunParallel(nRanges, [&](size_t i) {
+                const size_t nPos = i * MERKLE_HASH_RANGE_SIZE;
+                const size_t nPairs = std::min(MERKLE_HASH_RANGE_SIZE, next.size() - nPos);
+                mutations[i] = ComputeMerklePairs(&next[nPos], &level[2 * nPos], nPairs);
+            });
+            if (std::any_of(mutations.get(), mutations.get() + nRanges, [](bool f) { return f; })) mutation = true;
+        } else if (ComputeMerklePairs(next.data(), level.data(), next.size())) {
+            mutation = true;
+        }
+        ComputeMerkleLevelEnd(next, level);
+        levels.push_back(std::move(next));
+    }
+    if (mutated) *mutated = mutation;
+    return levels;
+}
+
+uint256 BlockMerkleRootParallel(const CBlock& block, bool* mutated)
+{
+    std::vector<uint256> leaves(block.vtx.size());
+    for (size_t s = 0; s < block.vtx.size(); s++) {
+        leaves[s] = block.vtx[s]->GetHash();
+    }
+    const std::vector<std::vector<uint256>> levels = ComputeMerkleLevelsParallel(std::move(leaves), mutated);
+    return levels.back().empty() ? uint256() : levels.back()[0];
+}
+
+uint256 BlockWitnessMerkleRootParallel(const CBlock& block, bool* mutated)
+{
+    std::vector<uint256> leaves(block.vtx.size());
+    // The witness hash of the coinbase is 0.
+    for (size_t s = 1; s < block.vtx.size(); s++) {
+        leaves[s] = block.vtx[s]->GetWitnessHash();
+    }
+    const std::vector<std::vector<uint256>> levels = ComputeMerkleLevelsParallel(std::move(leaves), mutated);
+    return levels.back().empty() ? uint256() : levels.back()[0];
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -1908,6 +2100,7 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
+static int64_t nTimePrefetchInputs = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
@@ -2097,6 +2290,26 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
+    // Load the coins spent by this block that are not created by it in one
+    // batch, so that cache misses are read from the database in parallel
+    // rather than one at a time by the loop below.
+    {
+        std::vector<COutPoint> prevouts;
+        std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+        block_txids.reserve(block.vtx.size());
+        for (const auto& tx : block.vtx) {
+            if (!tx->IsCoinBase()) {
+                for (const CTxIn& txin : tx->vin) {
+                    if (!block_txids.count(txin.prevout.hash)) prevouts.push_back(txin.prevout);
+                }
+            }
+            block_txids.insert(tx->GetHash());
+        }
+        size_t nMissing = view.PrefetchCoins(prevouts);
+        int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetchInputs += nTimePrefetched - nTime2;
+        LogPrint(BCLog::BENCH, "      - Prefetch %u inputs (%u not cached): %.2fms [%.2fs (%.2fms/blk)]\n", prevouts.size(), nMissing, MILLI * (nTimePrefetched - nTime2), nTimePrefetchInputs * MICRO, nTimePrefetchInputs * MILLI / nBlocksTotal);
+    }
+
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && g_parallel_script_checks ? &scriptcheckqueue : nullptr);
@@ -2218,10 +2431,18 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
 
 CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(const CTxMemPool& tx_pool)
 {
+    size_t max_coins_cache_size_bytes = nCoinCacheUsage;
+    size_t max_mempool_size_bytes = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    if (ChainstateBackground()) {
+        // Both chainstates share -dbcache while the snapshot is being
+        // validated, and only the active one may use the unused mempool space.
+        max_coins_cache_size_bytes /= 2;
+        if (!IsActive()) max_mempool_size_bytes = 0;
+    }
     return this->GetCoinsCacheSizeState(
         tx_pool,
-        nCoinCacheUsage,
-        gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        max_coins_cache_size_bytes,
+        max_mempool_size_bytes);
 }
 
 CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
@@ -2257,7 +2478,6 @@ bool CChainState::FlushStateToDisk(
     LOCK(cs_main);
     assert(this->CanFlushToDisk());
     static int64_t nLastWrite = 0;
-    static int64_t nLastFlush = 0;
     std::set<int> setFilesToPrune;
     bool full_flush_completed = false;
 
@@ -2294,21 +2514,23 @@ bool CChainState::FlushStateToDisk(
         if (nLastWrite == 0) {
             nLastWrite = nNow;
         }
-        if (nLastFlush == 0) {
-            nLastFlush = nNow;
-        }
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FlushStateMode::PERIODIC && cache_state >= CoinsCacheSizeState::LARGE;
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FlushStateMode::IF_NEEDED && cache_state >= CoinsCacheSizeState::CRITICAL;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FlushStateMode::PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
-        // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
-        bool fPeriodicFlush = mode == FlushStateMode::PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
-        // Combine all conditions that result in a full cache flush.
-        fDoFullFlush = (mode == FlushStateMode::ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+        // Combine all conditions that result in a full cache flush. The
+        // periodic one is done by WriteCoinsInBackground.
+        fDoFullFlush = (mode == FlushStateMode::ALWAYS) || fCacheLarge || fCacheCritical || fFlushForPrune;
+        // Write the modified coins before a block is disconnected.
+        bool fSyncCoins = !fDoFullFlush && mode == FlushStateMode::SYNC;
+        // Coins written to the database must only refer to blocks whose data
+        // and index entry are on disk.
+        bool fBlocksDirty = !setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty();
+        bool fBlocksForCoins = (fSyncCoins || mode == FlushStateMode::INCREMENTAL) && fBlocksDirty;
         // Write blocks and block index to disk.
-        if (fDoFullFlush || fPeriodicWrite) {
+        if (fDoFullFlush || fPeriodicWrite || fBlocksForCoins) {
             // Depend on nMinDiskSpace to ensure we can write block index
             if (!CheckDiskSpace(GetBlocksDir())) {
                 return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
@@ -2349,26 +2571,45 @@ bool CChainState::FlushStateToDisk(
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
-        if (fDoFullFlush && !CoinsTip().GetBestBlock().IsNull()) {
-            LOG_TIME_SECONDS(strprintf("write coins cache to disk (%d coins, %.2fkB)",
-                coins_count, coins_mem_usage / 1000));
-
-            // Typical Coin structures on disk are around 48 bytes in size.
-            // Pushing a new one to the database can cause it to be written
-            // twice (once in the log, and once in the tables). This is already
-            // an overestimation, as most will delete an existing entry or
-            // overwrite one. Still, use a conservative safety factor of 2.
-            if (!CheckDiskSpace(GetDataDir(), 48 * 2 * 2 * CoinsTip().GetCacheSize())) {
-                return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
+        if ((fDoFullFlush || fSyncCoins) && !CoinsTip().GetBestBlock().IsNull()) {
+            // A batch of coins written by the background flusher has to be
+            // in the database before the others.
+            if (!WaitForCoinsWrite())
+                return AbortNode(state, "Failed to write to coin database");
+            if (fDoFullFlush) {
+                // Typical Coin structures on disk are around 48 bytes in size.
+                // Pushing a new one to the database can cause it to be written
+                // twice (once in the log, and once in the tables). This is already
+                // an overestimation, as most will delete an existing entry or
+                // overwrite one. Still, use a conservative safety factor of 2.
+                if (!CheckDiskSpace(GetDataDir(), 48 * 2 * 2 * CoinsTip().GetDirtyCount())) {
+                    return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
+                }
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // The written coins stay cached.
+            const size_t dirty_count = CoinsTip().GetDirtyCount();
+            const int64_t flush_start = GetTimeMicros();
+            if (!CoinsTip().WriteDirty(std::numeric_limits<size_t>::max()))
                 return AbortNode(state, "Failed to write to coin database");
-            nLastFlush = nNow;
+            if (fCacheLarge || fCacheCritical) {
+                // Make room for the next blocks by dropping the coins that
+                // were cached first, down to half of the budget.
+                size_t coins_budget = nCoinCacheUsage;
+                if (ChainstateBackground()) coins_budget /= 2;
+                CoinsTip().Trim(coins_budget / 2);
+            }
+            LogPrint(BCLog::BENCH, "write %u modified coins to disk (%d coins, %.2fkB cached before, %d coins, %.2fkB after): %.2fms\n",
+                dirty_count, coins_count, coins_mem_usage / 1000, CoinsTip().GetCacheSize(), CoinsTip().DynamicMemoryUsage() / 1000,
+                (GetTimeMicros() - flush_start) * MILLI);
+            m_last_coins_sync = nNow;
             full_flush_completed = true;
+            ++m_coins_flush_stats.full_flushes;
+            m_coins_flush_stats.full_flush_coins += dirty_count;
+            m_coins_flush_stats.last_full_flush_micros = GetTimeMicros() - flush_start;
         }
     }
-    if (full_flush_completed) {
+    if (full_flush_completed && IsActive()) {
         // Update best block in wallet (so we can detect restored wallets).
         GetMainSignals().ChainStateFlushed(m_chain.GetLocator());
     }
@@ -2386,6 +2627,110 @@ void CChainState::ForceFlushStateToDisk() {
     }
 }
 
+bool CChainState::WaitForCoinsWrite()
+{
+    WAIT_LOCK(m_coins_write_mutex, lock);
+    m_coins_write_cv.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(m_coins_write_mutex) { return !m_coins_write_in_flight; });
+    return !m_coins_write_failed;
+}
+
+bool CChainState::WriteCoinsInBackground(const CChainParams& chainparams, BlockValidationState& state, size_t batch_size)
+{
+    CCoinsViewDB* db;
+    CCoinsMap batch;
+    bool sync;
+    bool complete;
+    uint256 best_block;
+    CBlockLocator locator;
+    const int64_t now = GetTimeMicros();
+    {
+        LOCK(cs_main);
+        if (!CanFlushToDisk() || CoinsTip().GetBestBlock().IsNull()) return true;
+        if (m_last_coins_sync == 0) m_last_coins_sync = now;
+        // It's been very long since all the modified coins were written. Do
+        // this infrequently, to limit the blocks replayed after a crash.
+        sync = now > m_last_coins_sync + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+        // During the initial block download, wait until the cache is half
+        // full: coins that are spent soon after being created are then never
+        // written.
+        size_t coins_budget = nCoinCacheUsage;
+        if (ChainstateBackground()) coins_budget /= 2;
+        const bool incremental = batch_size > 0 &&
+            (CoinsTip().GetDirtyCount() > 0 || CoinsTip().HasPartialWrite()) &&
+            (!IsInitialBlockDownload() || CoinsTip().DynamicMemoryUsage() * 2 > coins_budget);
+        if (!sync && !incremental) return true;
+        if (!FlushStateToDisk(chainparams, state, FlushStateMode::INCREMENTAL)) return false;
+        {
+            LOCK(m_coins_write_mutex);
+            if (m_coins_write_failed) return AbortNode(state, "Failed to write to coin database");
+            // Only this function writes without cs_main, and the scheduler
+            // runs it on a single thread.
+            assert(!m_coins_write_in_flight);
+            m_coins_write_in_flight = true;
+        }
+        complete = CoinsTip().TakeDirty(sync ? std::numeric_limits<size_t>::max() : batch_size, batch);
+        best_block = CoinsTip().GetBestBlock();
+        db = &CoinsDB();
+        if (sync && IsActive()) locator = m_chain.GetLocator();
+    }
+
+    const size_t count = batch.size();
+    bool written = false;
+    try {
+        written = complete ? db->BatchWrite(batch, best_block) : db->BatchWritePartial(batch, best_block);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    {
+        LOCK(m_coins_write_mutex);
+        m_coins_write_in_flight = false;
+        // The batch is not cached as modified anymore, so a database that
+        // missed it must not be marked as consistent by a later write.
+        if (!written) m_coins_write_failed = true;
+    }
+    m_coins_write_cv.notify_all();
+    if (!written) return AbortNode(state, "Failed to write to coin database");
+
+    {
+        LOCK(cs_main);
+        CoinsTip().EndWrite(complete);
+        if (sync) {
+            LogPrint(BCLog::BENCH, "write %u modified coins to disk in the background: %.2fms\n", count, (GetTimeMicros() - now) * MILLI);
+            m_last_coins_sync = now;
+            ++m_coins_flush_stats.full_flushes;
+            m_coins_flush_stats.full_flush_coins += count;
+            m_coins_flush_stats.last_full_flush_micros = GetTimeMicros() - now;
+        } else {
+            ++m_coins_flush_stats.incremental_batches;
+            m_coins_flush_stats.incremental_coins += count;
+        }
+    }
+    if (sync && !locator.IsNull()) {
+        // Update best block in wallet (so we can detect restored wallets).
+        GetMainSignals().ChainStateFlushed(locator);
+    }
+    return true;
+}
+
+void FlushCoinsIncremental()
+{
+    const CChainParams& chainparams = Params();
+    const size_t batch_size = std::max<int64_t>(0, gArgs.GetArg("-coinsflushbatch", DEFAULT_COINS_FLUSH_BATCH));
+    std::vector<CChainState*> chainstates;
+    {
+        LOCK(cs_main);
+        for (CChainState* chainstate : {g_chainstate.get(), ChainstateBackground()}) {
+            if (chainstate) chainstates.push_back(chainstate);
+        }
+    }
+    for (CChainState* chainstate : chainstates) {
+        BlockValidationState state;
+        if (!chainstate->WriteCoinsInBackground(chainparams, state, batch_size)) {
+            LogPrintf("%s: failed to flush state (%s)\n", __func__, state.ToString());
+        }
+    }
+}
+
 void CChainState::PruneAndFlush() {
     BlockValidationState state;
     fCheckForPruning = true;
@@ -2414,9 +2759,18 @@ static void AppendWarning(std::string& res, const std::string& warn)
 }
 
 /** Check warning conditions and do some notifications on new chain tip set. */
-void static UpdateTip(const CBlockIndex* pindexNew, const CChainParams& chainParams)
+void static UpdateTip(CChainState& chainstate, const CBlockIndex* pindexNew, const CChainParams& chainParams)
     EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
 {
+    if (!chainstate.IsActive()) {
+        // The background chainstate only reports its way towards the snapshot base.
+        LogPrintf("%s: background best=%s height=%d tx=%lu date='%s' progress=%f cache=%.1fMiB(%utxo)\n", __func__,
+          pindexNew->GetBlockHash().ToString(), pindexNew->nHeight, (unsigned long)pindexNew->nChainTx,
+          FormatISO8601DateTime(pindexNew->GetBlockTime()),
+          GuessVerificationProgress(chainParams.TxData(), pindexNew), chainstate.CoinsTip().DynamicMemoryUsage() * (1.0 / (1<<20)), chainstate.CoinsTip().GetCacheSize());
+        return;
+    }
+
     // New best block
     mempool.AddTransactionsUpdated(1);
 
@@ -2466,6 +2820,11 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 {
     CBlockIndex *pindexDelete = m_chain.Tip();
     assert(pindexDelete);
+    // The coins database may hold coins written by the background flusher
+    // from any block up to the tip, which replaying the blocks after a crash
+    // only handles along a single chain. Complete that write first.
+    if (CoinsTip().HasPartialWrite() && !FlushStateToDisk(chainparams, state, FlushStateMode::SYNC))
+        return false;
     // Read block from disk.
     std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
     CBlock& block = *pblock;
@@ -2501,10 +2860,10 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 
     m_chain.SetTip(pindexDelete->pprev);
 
-    UpdateTip(pindexDelete->pprev, chainparams);
+    UpdateTip(*this, pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    GetMainSignals().BlockDisconnected(pblock, pindexDelete);
+    if (IsActive()) GetMainSignals().BlockDisconnected(pblock, pindexDelete);
     return true;
 }
 
@@ -2513,6 +2872,90 @@ static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
+static int64_t nTimePrefetchRead = 0;
+static int64_t nTimePrefetchWarm = 0;
+static int64_t nTimePrefetchWait = 0;
+
+/**
+ * Reads a block that is about to be connected on a worker pool thread, and looks
+ * up its inputs in the coins database so that they are in the database cache
+ * when the block is connected. This overlaps with connecting the block before
+ * it; the coins views themselves are not touched, so the order in which blocks
+ * are applied to the chain state does not change.
+ */
+class CBlockPrefetch
+{
+private:
+    std::shared_ptr<CBlock> m_block;
+    bool m_read{false};
+    int64_t m_time_read{0};
+    int64_t m_time_warm{0};
+    int64_t m_time_wait{0};
+    size_t m_inputs{0};
+    std::shared_ptr<CWorkerPool::Job> m_job;
+
+    void Prefetch(FlatFilePos pos, const CCoinsView& db, const Consensus::Params& params)
+    {
+        int64_t nTime1 = GetTimeMicros();
+        m_read = ReadBlockFromDisk(*m_block, pos, params);
+        int64_t nTime2 = GetTimeMicros();
+        m_time_read = nTime2 - nTime1;
+        if (!m_read) return;
+        try {
+            Coin coin;
+            for (const auto& tx : m_block->vtx) {
+                if (tx->IsCoinBase()) continue;
+                for (const CTxIn& txin : tx->vin) {
+                    db.GetCoin(txin.prevout, coin);
+                    m_inputs++;
+                }
+            }
+        } catch (const std::exception& e) {
+            // Errors are reported when the block is connected.
+            LogPrint(BCLog::BENCH, "%s: %s\n", __func__, e.what());
+        }
+        m_time_warm = GetTimeMicros() - nTime2;
+    }
+
+public:
+    const CBlockIndex* const m_pindex;
+
+    CBlockPrefetch(const CBlockIndex* pindex, const CCoinsView& db, const Consensus::Params& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+        : m_block(std::make_shared<CBlock>()), m_pindex(pindex)
+    {
+        const FlatFilePos pos = pindex->GetBlockPos();
+        m_job = g_worker_pool.Start(1, [this, pos, &db, &params](size_t) { Prefetch(pos, db, params); });
+    }
+
+    ~CBlockPrefetch()
+    {
+        Wait();
+    }
+
+    /** Wait for the prefetch to finish, or run it if no pool thread started it yet. */
+    void Wait()
+    {
+        if (!m_job) return;
+        int64_t nTime1 = GetTimeMicros();
+        g_worker_pool.Wait(*m_job);
+        m_job.reset();
+        m_time_wait = GetTimeMicros() - nTime1;
+    }
+
+    /** Wait for the prefetch. Returns null if the block could not be read. */
+    std::shared_ptr<const CBlock> Get()
+    {
+        Wait();
+        nTimePrefetchRead += m_time_read;
+        nTimePrefetchWarm += m_time_warm;
+        nTimePrefetchWait += m_time_wait;
+        LogPrint(BCLog::BENCH, "  - Prefetch block: read %.2fms [%.2fs], warm %u inputs %.2fms [%.2fs], wait %.2fms [%.2fs]\n",
+            m_time_read * MILLI, nTimePrefetchRead * MICRO, m_inputs, m_time_warm * MILLI, nTimePrefetchWarm * MICRO,
+            m_time_wait * MILLI, nTimePrefetchWait * MICRO);
+        if (!m_read || m_block->GetHash() != m_pindex->GetBlockHash()) return nullptr;
+        return m_block;
+    }
+};
 
 struct PerBlockConnectTrace {
     CBlockIndex* pindex = nullptr;
@@ -2602,11 +3045,11 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
     // Remove conflicting transactions from the mempool.;
-    mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+    if (IsActive()) mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update m_chain & related variables.
     m_chain.SetTip(pindexNew);
-    UpdateTip(pindexNew, chainparams);
+    UpdateTip(*this, pindexNew, chainparams);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
@@ -2693,7 +3136,7 @@ void CChainState::PruneBlockIndexCandidates() {
  *
  * @returns true unless a system error occurred
  */
-bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace)
+bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace, std::unique_ptr<CBlockPrefetch>& prefetch)
 {
     AssertLockHeld(cs_main);
 
@@ -2735,9 +3178,23 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         }
         nHeight = nTargetHeight;
 
-        // Connect new blocks.
-        for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+        // Connect new blocks. Each block after the first is read while the
+        // one before it is being connected; the read may have been started
+        // by the previous step.
+        for (auto it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend(); ++it) {
+            CBlockIndex *pindexConnect = *it;
+            std::shared_ptr<const CBlock> pblockConnect;
+            if (pindexConnect == pindexMostWork) {
+                pblockConnect = pblock;
+            } else if (prefetch && prefetch->m_pindex == pindexConnect) {
+                pblockConnect = prefetch->Get();
+            }
+            prefetch.reset();
+            auto itNext = std::next(it);
+            if (itNext != vpindexToConnect.rend() && !(*itNext == pindexMostWork && pblock) && ((*itNext)->nStatus & BLOCK_HAVE_DATA)) {
+                prefetch.reset(new CBlockPrefetch(*itNext, CoinsDB(), chainparams.GetConsensus()));
+            }
+            if (!ConnectTip(state, chainparams, pindexConnect, pblockConnect, connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (state.GetResult() != BlockValidationResult::BLOCK_MUTATED) {
@@ -2751,7 +3208,8 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
                     // A system error occurred (disk space, database error, ...).
                     // Make the mempool consistent with the current tip, just in case
                     // any observers try to use it before shutdown.
-                    UpdateMempoolForReorg(disconnectpool, false);
+                    prefetch.reset();
+                    if (IsActive()) UpdateMempoolForReorg(disconnectpool, false);
                     return false;
                 }
             } else {
@@ -2765,6 +3223,13 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         }
     }
 
+    // Do not leave the helper thread running once cs_main is released; the
+    // block it read is kept for the next step.
+    if (prefetch) prefetch->Wait();
+
+    // The mempool and the warnings follow the active chainstate only.
+    if (!IsActive()) return true;
+
     if (fBlocksDisconnected) {
         // If any blocks were disconnected, disconnectpool may be non empty.  Add
         // any disconnected transactions back to the mempool.
@@ -2826,6 +3291,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
     CBlockIndex *pindexMostWork = nullptr;
     CBlockIndex *pindexNewTip = nullptr;
+    std::unique_ptr<CBlockPrefetch> prefetch;
     int nStopAtHeight = gArgs.GetArg("-stopatheight", DEFAULT_STOPATHEIGHT);
     do {
         boost::this_thread::interruption_point();
@@ -2858,7 +3324,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
                 bool fInvalidFound = false;
                 std::shared_ptr<const CBlock> nullBlockPtr;
-                if (!ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : nullBlockPtr, fInvalidFound, connectTrace)) {
+                if (!ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : nullBlockPtr, fInvalidFound, connectTrace, prefetch)) {
                     // A system error occurred
                     return false;
                 }
@@ -2870,9 +3336,11 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
                 }
                 pindexNewTip = m_chain.Tip();
 
-                for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
-                    assert(trace.pblock && trace.pindex);
-                    GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                if (IsActive()) {
+                    for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
+                        assert(trace.pblock && trace.pindex);
+                        GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                    }
                 }
             } while (!m_chain.Tip() || (starting_tip && CBlockIndexWorkComparator()(m_chain.Tip(), starting_tip)));
             if (!blocks_connected) return true;
@@ -2882,7 +3350,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
             // Notify external listeners about the new tip.
             // Enqueue while holding cs_main to ensure that UpdatedBlockTip is called in the order in which blocks are connected
-            if (pindexFork != pindexNewTip) {
+            if (pindexFork != pindexNewTip && IsActive()) {
                 // Notify ValidationInterface subscribers
                 GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
@@ -2892,7 +3360,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
 
-        if (nStopAtHeight && pindexNewTip && pindexNewTip->nHeight >= nStopAtHeight) StartShutdown();
+        if (nStopAtHeight && pindexNewTip && pindexNewTip->nHeight >= nStopAtHeight && IsActive()) StartShutdown();
 
         // We check shutdown only after giving ActivateBestChainStep a chance to run once so that we
         // never shutdown before connecting the genesis block during LoadChainTip(). Previously this
@@ -3161,11 +3629,28 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
     return pindexNew;
 }
 
+/** Offer a block whose ancestors have all been received to the background chainstate, if it is below the snapshot base. */
+static void AddBackgroundCandidate(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    CChainState* background = ChainstateBackground();
+    if (!background) return;
+    const CBlockIndex* base = LookupBlockIndex(::ChainstateActive().m_from_snapshot_blockhash);
+    if (!base || base->GetAncestor(pindex->nHeight) != pindex) return;
+    const CBlockIndex* tip = background->m_chain.Tip();
+    if (tip == nullptr || !background->setBlockIndexCandidates.value_comp()(pindex, tip)) {
+        background->setBlockIndexCandidates.insert(pindex);
+    }
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
     pindexNew->nTx = block.vtx.size();
-    pindexNew->nChainTx = 0;
+    // The snapshot base keeps the nChainTx taken from the snapshot until its
+    // ancestors are in, as the active chain is built on top of it.
+    if (pindexNew->GetBlockHash() != m_from_snapshot_blockhash) {
+        pindexNew->nChainTx = 0;
+    }
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
@@ -3193,6 +3678,7 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
             if (m_chain.Tip() == nullptr || !setBlockIndexCandidates.value_comp()(pindex, m_chain.Tip())) {
                 setBlockIndexCandidates.insert(pindex);
             }
+            if (IsActive()) AddBackgroundCandidate(pindex);
             std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = m_blockman.m_blocks_unlinked.equal_range(pindex);
             while (range.first != range.second) {
                 std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
@@ -3288,6 +3774,15 @@ static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& st
     return true;
 }
 
+static bool TransactionCheckFailed(const CTransaction& tx, const TxValidationState& tx_state, BlockValidationState& state)
+{
+    // CheckBlock() does context-free validation checks. The only
+    // possible failures are consensus failures.
+    assert(tx_state.GetResult() == TxValidationResult::TX_CONSENSUS);
+    return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, tx_state.GetRejectReason(),
+                         strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), tx_state.GetDebugMessage()));
+}
+
 bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -3303,7 +3798,7 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        uint256 hashMerkleRoot2 = BlockMerkleRootParallel(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.Invalid(BlockValidationResult::BLOCK_MUTATED, "bad-txnmrklroot", "hashMerkleRoot mismatch");
 
@@ -3333,20 +3828,41 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
 
     // Check transactions
     // Must check for duplicate inputs (see CVE-2018-17144)
-    for (const auto& tx : block.vtx) {
-        TxValidationState tx_state;
-        if (!CheckTransaction(*tx, tx_state)) {
-            // CheckBlock() does context-free validation checks. The only
-            // possible failures are consensus failures.
-            assert(tx_state.GetResult() == TxValidationResult::TX_CONSENSUS);
-            return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, tx_state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), tx_state.GetDebugMessage()));
-        }
-    }
     unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(*tx);
+    if (g_parallel_script_checks && block.vtx.size() > TX_PRECHECK_RANGE_SIZE) {
+        // Every transaction gets its own result, so the failure reported is
+        // the first one in block order, however the threads are scheduled.
+        // The ranges run on the worker pool, as CheckBlock is called while
+        // ConnectBlock holds the script-checking threads, and from several
+        // threads at once by the reindex read-ahead.
+        std::vector<TxValidationState> tx_states(block.vtx.size());
+        std::vector<unsigned int> tx_sigops(block.vtx.size());
+        const size_t nRanges = (block.vtx.size() + TX_PRECHECK_RANGE_SIZE - 1) / TX_PRECHECK_RANGE_SIZE;
+        g_worker_pool.RunParallel(nRanges, [&](size_t i) {
+            const size_t nEnd = std::min((i + 1) * TX_PRECHECK_RANGE_SIZE, block.vtx.size());
+            for (size_t nPos = i * TX_PRECHECK_RANGE_SIZE; nPos < nEnd; ++nPos) {
+                CheckTransaction(*block.vtx[nPos], tx_states[nPos]);
+                tx_sigops[nPos] = GetLegacySigOpCount(*block.vtx[nPos]);
+            }
+        });
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            if (!tx_states[i].IsValid())
+                return TransactionCheckFailed(*block.vtx[i], tx_states[i], state);
+        }
+        for (unsigned int nTxSigOps : tx_sigops)
+        {
+            nSigOps += nTxSigOps;
+        }
+    } else {
+        for (const auto& tx : block.vtx) {
+            TxValidationState tx_state;
+            if (!CheckTransaction(*tx, tx_state))
+                return TransactionCheckFailed(*tx, tx_state, state);
+        }
+        for (const auto& tx : block.vtx)
+        {
+            nSigOps += GetLegacySigOpCount(*tx);
+        }
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-blk-sigops", "out-of-bounds SigOpCount");
@@ -3363,24 +3879,33 @@ bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& pa
     return (height >= params.SegwitHeight);
 }
 
-bool DdmsVerifyCoinbaseOutput(const CTransactionRef& cb, const unsigned int n) {
-       for (size_t k = 0; k < DDMS_ALLOWED_SCRIPTS_NUMBER; ++k) {
-		   const CScript& s = ddmsAllowedScripts[k] ;
-		   if ((cb->vout[n].scriptPubKey == s)) {
-			   return true;
-		   }
-       }
-	   return false;
+bool DdmsVerifyCoinbase(const CBlock& block) {
+    return DdmsVerifyCoinbaseOutput(*block.vtx[0]);
+}
+
+bool DdmsVerifyCoinbaseOutput(const CTransaction& coinbase) {
+    const int commitpos = GetWitnessCommitmentIndex(coinbase);
+    for (uint32_t i = 0; i < coinbase.vout.size(); ++i) {
+        if ((int)i != commitpos && !IsDdmsAllowedScript(coinbase.vout[i].scriptPubKey)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 int GetWitnessCommitmentIndex(const CBlock& block)
+{
+    if (block.vtx.empty()) return -1;
+    return GetWitnessCommitmentIndex(*block.vtx[0]);
+}
+
+int GetWitnessCommitmentIndex(const CTransaction& coinbase)
 {
     int commitpos = -1;
-    if (!block.vtx.empty()) {
-        for (size_t o = 0; o < block.vtx[0]->vout.size(); o++) {
-            if (block.vtx[0]->vout[o].scriptPubKey.size() >= 38 && block.vtx[0]->vout[o].scriptPubKey[0] == OP_RETURN && block.vtx[0]->vout[o].scriptPubKey[1] == 0x24 && block.vtx[0]->vout[o].scriptPubKey[2] == 0xaa && block.vtx[0]->vout[o].scriptPubKey[3] == 0x21 && block.vtx[0]->vout[o].scriptPubKey[4] == 0xa9 && block.vtx[0]->vout[o].scriptPubKey[5] == 0xed) {
-                commitpos = o;
-            }
+    for (size_t o = 0; o < coinbase.vout.size(); o++) {
+        const CScript& script = coinbase.vout[o].scriptPubKey;
+        if (script.size() >= 38 && script[0] == OP_RETURN && script[1] == 0x24 && script[2] == 0xaa && script[3] == 0x21 && script[4] == 0xa9 && script[5] == 0xed) {
+            commitpos = o;
         }
     }
     return commitpos;
@@ -3405,7 +3930,7 @@ std::vector<unsigned char> GenerateCoinbaseCommitment(CBlock& block, const CBloc
     std::vector<unsigned char> ret(32, 0x00);
     if (consensusParams.SegwitHeight != std::numeric_limits<int>::max()) {
         if (commitpos == -1) {
-            uint256 witnessroot = BlockWitnessMerkleRoot(block, nullptr);
+            uint256 witnessroot = BlockWitnessMerkleRootParallel(block, nullptr);
             CHash256().Write(witnessroot.begin(), 32).Write(ret.data(), 32).Finalize(witnessroot.begin());
             CTxOut out;
             out.nValue = 0;
@@ -3493,6 +4018,54 @@ static bool ContextualCheckBlockHeader(const CBlockHeader& block, BlockValidatio
     return true;
 }
 
+/** Contextual checks of the coinbase, shared by ContextualCheckBlock and CheckBlockCoinbase. */
+static bool ContextualCheckCoinbase(const CBlockHeader& header, const CTransaction& coinbase, BlockValidationState& state, const Consensus::Params& consensusParams, int nHeight, bool fCheckDdms)
+{
+    // Enforce rule that the coinbase starts with serialized block height
+    if (nHeight >= consensusParams.BIP34Height)
+    {
+        CScript expect = CScript() << nHeight;
+        if (coinbase.vin[0].scriptSig.size() < expect.size() ||
+            !std::equal(expect.begin(), expect.end(), coinbase.vin[0].scriptSig.begin())) {
+            return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-cb-height", "block height mismatch in coinbase");
+        }
+    }
+    // Check if the coinbase goes to the licensed addresses.
+    if (consensusParams.fddms && fCheckDdms && consensusParams.hashGenesisBlock != header.GetHash()) {
+        if (nHeight < consensusParams.nStopDDMSHeight) {
+            if (!DdmsVerifyCoinbaseOutput(coinbase)) {
+                return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "ddms-output-not-allowed");
+            }
+        }
+    }
+    return true;
+}
+
+bool CheckBlockCoinbase(const CBlockHeader& header, const CTransaction& coinbase, BlockValidationState& state, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
+{
+    if (!coinbase.IsCoinBase()) {
+        return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-cb-missing", "first tx is not coinbase");
+    }
+    TxValidationState tx_state;
+    if (!CheckTransaction(coinbase, tx_state)) {
+        return TransactionCheckFailed(coinbase, tx_state, state);
+    }
+
+    const int nHeight = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
+    if (!ContextualCheckCoinbase(header, coinbase, state, consensusParams, nHeight, true)) {
+        return false;
+    }
+
+    // The witness commitment itself needs every transaction, but the reserved
+    // value it is combined with is in the coinbase.
+    if (nHeight >= consensusParams.SegwitHeight && GetWitnessCommitmentIndex(coinbase) != -1) {
+        if (coinbase.vin[0].scriptWitness.stack.size() != 1 || coinbase.vin[0].scriptWitness.stack[0].size() != 32) {
+            return state.Invalid(BlockValidationResult::BLOCK_MUTATED, "bad-witness-nonce-size", strprintf("%s : invalid witness reserved value size", __func__));
+        }
+    }
+    return true;
+}
+
 /** NOTE: This function is not currently invoked by ConnectBlock(), so we
  *  should consider upgrade issues if we change which consensus rules are
  *  enforced in this function (eg by adding a new consensus rule). See comment
@@ -3521,25 +4094,8 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
         }
     }
 
-    // Enforce rule that the coinbase starts with serialized block height
-    if (nHeight >= consensusParams.BIP34Height)
-    {
-        CScript expect = CScript() << nHeight;
-        if (block.vtx[0]->vin[0].scriptSig.size() < expect.size() ||
-            !std::equal(expect.begin(), expect.end(), block.vtx[0]->vin[0].scriptSig.begin())) {
-            return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-cb-height", "block height mismatch in coinbase");
-        }
-    }
-    // Check if the coinbase goes to the licensed addresses.
-	if (consensusParams.fddms && fCheckDdms && consensusParams.hashGenesisBlock != block.GetHash()) {
-        if (nHeight < consensusParams.nStopDDMSHeight) {
-            CTransactionRef cb = block.vtx[0];
-            for (uint32_t i = 0; i < cb->vout.size(); ++i) {
-                if (i != GetWitnessCommitmentIndex(block) && !DdmsVerifyCoinbaseOutput(cb, i)) {
-                    return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "ddms-output-not-allowed");
-                }
-            }
-        }
+    if (!ContextualCheckCoinbase(block, *block.vtx[0], state, consensusParams, nHeight, fCheckDdms)) {
+        return false;
     }
 
     // Validation for witness commitments.
@@ -3555,7 +4111,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
         int commitpos = GetWitnessCommitmentIndex(block);
         if (commitpos != -1) {
             bool malleated = false;
-            uint256 hashWitness = BlockWitnessMerkleRoot(block, &malleated);
+            uint256 hashWitness = BlockWitnessMerkleRootParallel(block, &malleated);
             // The malleation check is ignored; as the transaction tree itself
             // already does not permit it, it is impossible to trigger in the
             // witness tree.
@@ -3592,7 +4148,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3612,7 +4168,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), state.ToString());
 
         // Get prev block index
@@ -3669,8 +4225,13 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             }
         }
     }
-    if (pindex == nullptr)
+    if (pindex == nullptr) {
+        /* Store the auxpow header before the index entry can be flushed,
+         * so that CBlockIndex::GetBlockHeader never needs the block file. */
+        if (block.auxHeader && !pblocktree->WriteAuxBlockHeader(hash, *block.auxHeader))
+            return AbortNode(state, "Failed to write auxpow header");
         pindex = AddToBlockIndex(block);
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3681,11 +4242,40 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // The proof of work (including auxpow) does not depend on the chain, so
+    // verify it for the new headers in parallel before taking cs_main for
+    // the whole message. Headers that fail are checked again below, so that
+    // they are still rejected in order and with the usual reason. Headers
+    // already in the block index are accepted without a check.
+    std::vector<bool> vPowValid(headers.size(), false);
+    if (headers.size() > 1) {
+        std::vector<size_t> vNew;
+        {
+            LOCK(cs_main);
+            for (size_t i = 0; i < headers.size(); ++i) {
+                if (!LookupBlockIndex(headers[i].GetHash())) vNew.push_back(i);
+            }
+        }
+        if (vNew.size() == headers.size()) {
+            vPowValid = CheckProofOfWorkBatch(headers, chainparams.GetConsensus());
+        } else if (vNew.size() > 1) {
+            std::vector<CBlockHeader> vNewHeaders;
+            vNewHeaders.reserve(vNew.size());
+            for (const size_t i : vNew) vNewHeaders.push_back(headers[i]);
+            const std::vector<bool> vNewValid = CheckProofOfWorkBatch(vNewHeaders, chainparams.GetConsensus());
+            for (size_t j = 0; j < vNew.size(); ++j) {
+                vPowValid[vNew[j]] = vNewValid[j];
+            }
+        }
+    }
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); ++i) {
+            const CBlockHeader& header = headers[i];
+            const bool fCheckPOW = !vPowValid[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex);
+            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex, fCheckPOW);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
@@ -3838,6 +4428,10 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     if (!::ChainstateActive().ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed (%s)", __func__, state.ToString());
 
+    // Blocks below the snapshot base extend the background chainstate.
+    if (!ActivateBackgroundChainstate(chainparams, pblock))
+        return error("%s: background ActivateBestChain failed", __func__);
+
     return true;
 }
 
@@ -4141,17 +4735,72 @@ void BlockManager::Unload() {
     m_block_index.clear();
 }
 
-bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+/** Copy the auxpow header of every stored auxpow block into the block tree DB. */
+static bool UpgradeAuxBlockHeaders(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    if (!g_blockman.LoadBlockIndex(
-            chainparams.GetConsensus(), *pblocktree, ::ChainstateActive().setBlockIndexCandidates))
-        return false;
+    std::vector<CBlockIndex*> vToUpgrade;
+    for (const std::pair<const uint256, CBlockIndex*>& item : g_blockman.m_block_index) {
+        CBlockIndex* pindex = item.second;
+        CBlockHeader header;
+        header.nVersion = pindex->nVersion;
+        if (header.IsAuxPow() && (pindex->nStatus & BLOCK_HAVE_DATA) && !pblocktree->HaveAuxBlockHeader(pindex->GetBlockHash())) {
+            vToUpgrade.push_back(pindex);
+        }
+    }
 
-    // Load block file info
-    pblocktree->ReadLastBlockFile(nLastBlockFile);
-    vinfoBlockFile.resize(nLastBlockFile + 1);
-    LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
-    for (int nFile = 0; nFile <= nLastBlockFile; nFile++) {
+    if (!vToUpgrade.empty()) {
+        LogPrintf("Upgrading block index: storing %u auxpow headers...\n", vToUpgrade.size());
+        uiInterface.ShowProgress(_("Upgrading block index...").translated, 0, true);
+    }
+
+    // Read in block file order to keep the disk access sequential
+    std::sort(vToUpgrade.begin(), vToUpgrade.end(), [](const CBlockIndex* a, const CBlockIndex* b) {
+        return std::make_pair(a->nFile, a->nDataPos) < std::make_pair(b->nFile, b->nDataPos);
+    });
+
+    std::vector<std::pair<uint256, std::shared_ptr<CAuxBlockHeader>>> vBatch;
+    size_t nDone = 0;
+    int nReportDone = 0;
+    for (const CBlockIndex* pindex : vToUpgrade) {
+        if (ShutdownRequested()) return false;
+        CBlockHeader header;
+        if (!ReadBlockHeaderFromDisk(header, pindex, chainparams.GetConsensus()))
+            return error("%s: failed to read block header %s", __func__, pindex->GetBlockHash().ToString());
+        vBatch.emplace_back(pindex->GetBlockHash(), header.auxHeader);
+        ++nDone;
+        if (vBatch.size() >= 1000 || nDone == vToUpgrade.size()) {
+            if (!pblocktree->WriteAuxBlockHeaders(vBatch))
+                return error("%s: failed to write auxpow headers", __func__);
+            vBatch.clear();
+        }
+        int nPercentDone = (int)(nDone * 100 / vToUpgrade.size());
+        if (nPercentDone > nReportDone) {
+            nReportDone = nPercentDone;
+            uiInterface.ShowProgress(_("Upgrading block index...").translated, nPercentDone, true);
+            if (nReportDone % 10 == 0) {
+                LogPrintf("[%d%%]...", nReportDone); /* Continued */
+            }
+        }
+    }
+
+    if (!vToUpgrade.empty()) {
+        uiInterface.ShowProgress("", 100, false);
+        LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    }
+    return pblocktree->WriteFlag("auxheaders", true);
+}
+
+bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!g_blockman.LoadBlockIndex(
+            chainparams.GetConsensus(), *pblocktree, ::ChainstateActive().setBlockIndexCandidates))
+        return false;
+
+    // Load block file info
+    pblocktree->ReadLastBlockFile(nLastBlockFile);
+    vinfoBlockFile.resize(nLastBlockFile + 1);
+    LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
+    for (int nFile = 0; nFile <= nLastBlockFile; nFile++) {
         pblocktree->ReadBlockFileInfo(nFile, vinfoBlockFile[nFile]);
     }
     LogPrintf("%s: last block file info: %s\n", __func__, vinfoBlockFile[nLastBlockFile].ToString());
@@ -4182,6 +4831,13 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
         }
     }
 
+    // Fill the auxpow header store from the block files for block indexes
+    // written before the store existed
+    bool fAuxHeadersStored = false;
+    pblocktree->ReadFlag("auxheaders", fAuxHeadersStored);
+    if (!fAuxHeadersStored && !UpgradeAuxBlockHeaders(chainparams))
+        return false;
+
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
     if (fHavePruned)
@@ -4617,6 +5273,8 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
+        // Every auxpow header is stored by AcceptBlockHeader from now on
+        pblocktree->WriteFlag("auxheaders", true);
     }
     return true;
 }
@@ -4773,6 +5431,248 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
     return nLoaded > 0;
 }
 
+namespace {
+
+/** A block found while scanning a block file, without its transactions */
+struct ScannedBlock {
+    uint256 hash;
+    uint256 hashPrev;
+    FlatFilePos pos;
+    unsigned int nSize;
+};
+
+/**
+ * Find the blocks of a block file from their message start and size. Only the
+ * headers are deserialized; the transactions are skipped with a seek.
+ */
+void ScanBlockFile(const CChainParams& chainparams, int nFile, std::vector<ScannedBlock>& blocks)
+{
+    FILE* file = OpenBlockFile(FlatFilePos(nFile, 0), true);
+    if (!file) return; // This error is logged in OpenBlockFile
+
+    // Keep the message start and size in the buffer so that a false match can be rewound.
+    const unsigned int nFrameSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    CBufferedFile blkdat(file, BLOCK_HEADER_READ_BUFFER_SIZE, nFrameSize, SER_DISK, CLIENT_VERSION);
+    try {
+        while (!ShutdownRequested()) {
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            const uint64_t nStart = blkdat.GetPos();
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            unsigned int nSize = 0;
+            blkdat >> buf;
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE) == 0) {
+                blkdat >> nSize;
+            }
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE) {
+                blkdat.SetPos(nStart + 1);
+                continue;
+            }
+
+            CBlockHeader header;
+            blkdat.SetLimit(nStart + nFrameSize + nSize);
+            try {
+                blkdat >> header;
+            } catch (const std::ios_base::failure& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                blkdat.SetLimit();
+                blkdat.Seek(nStart + 1);
+                continue;
+            }
+            blkdat.SetLimit();
+            blocks.push_back(ScannedBlock{header.GetHash(), header.hashPrevBlock, FlatFilePos(nFile, nStart + nFrameSize), nSize});
+            if (!blkdat.Seek(nStart + nFrameSize + nSize)) break;
+        }
+    } catch (const std::exception&) {
+        // no more block headers; don't complain
+    }
+}
+
+/** Run a function on a number of threads, joining them when going out of scope. */
+class ReindexWorkers
+{
+    std::vector<std::thread> m_threads;
+
+public:
+    ReindexWorkers(int count, const std::function<void()>& func)
+    {
+        for (int i = 0; i < count; ++i) {
+            m_threads.emplace_back(&TraceThread<std::function<void()>>, "reindex", func);
+        }
+    }
+    ~ReindexWorkers()
+    {
+        for (std::thread& thread : m_threads) thread.join();
+    }
+};
+
+double MegabytesPerSecond(uint64_t bytes, int64_t micros)
+{
+    return micros > 0 ? bytes / (double)micros : 0.0;
+}
+
+} // namespace
+
+bool ReindexBlockFiles(const CChainParams& chainparams)
+{
+    int nFiles = 0;
+    while (fs::exists(GetBlockPosFilename(FlatFilePos(nFiles, 0)))) ++nFiles;
+    const int nThreads = std::max(1, std::min({GetNumCores(), MAX_REINDEX_THREADS, nFiles}));
+
+    // Scan the block files, one file per thread at a time.
+    int64_t nStart = GetTimeMicros();
+    std::vector<std::vector<ScannedBlock>> files(nFiles);
+    {
+        std::atomic<int> nNextFile{0};
+        ReindexWorkers workers(nThreads, [&] {
+            for (int nFile = nNextFile++; nFile < nFiles; nFile = nNextFile++) {
+                ScanBlockFile(chainparams, nFile, files[nFile]);
+            }
+        });
+    }
+    if (ShutdownRequested()) return false;
+    uint64_t nScannedBytes = 0;
+    size_t nScannedBlocks = 0;
+    for (int nFile = 0; nFile < nFiles; ++nFile) {
+        nScannedBytes += fs::file_size(GetBlockPosFilename(FlatFilePos(nFile, 0)));
+        nScannedBlocks += files[nFile].size();
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    LogPrintf("Reindex: found %u blocks in %d block files (%.1f MB) in %.2fs with %d threads (%.1f MB/s)\n",
+        nScannedBlocks, nFiles, nScannedBytes * 1e-6, nElapsed * 1e-6, nThreads, MegabytesPerSecond(nScannedBytes, nElapsed));
+
+    // Order the blocks so that each one comes after its parent. Blocks whose
+    // parent is neither in a block file nor in the block index are left out,
+    // as LoadExternalBlockFile does with out of order blocks it never connects.
+    std::vector<const ScannedBlock*> order;
+    {
+        std::multimap<uint256, const ScannedBlock*> children;
+        std::unordered_set<uint256, SaltedTxidHasher> seen;
+        LOCK(cs_main);
+        for (const std::vector<ScannedBlock>& blocks : files) {
+            for (const ScannedBlock& block : blocks) {
+                if (!seen.insert(block.hash).second) continue;
+                if (block.hash == chainparams.GetConsensus().hashGenesisBlock || LookupBlockIndex(block.hashPrev)) {
+                    order.push_back(&block);
+                } else {
+                    children.emplace(block.hashPrev, &block);
+                }
+            }
+        }
+        for (size_t i = 0; i < order.size(); ++i) {
+            auto range = children.equal_range(order[i]->hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                order.push_back(it->second);
+            }
+            children.erase(range.first, range.second);
+        }
+        if (!children.empty()) {
+            LogPrint(BCLog::REINDEX, "%s: %u blocks with an unknown parent not loaded\n", __func__, children.size());
+        }
+    }
+
+    // Accept the blocks in order, while the workers read and check the ones
+    // after them, up to REINDEX_READ_AHEAD_SIZE bytes ahead.
+    nStart = GetTimeMicros();
+    Mutex cs_loaded;
+    std::condition_variable cond_loaded;
+    std::vector<std::shared_ptr<CBlock>> loaded(order.size());
+    std::vector<bool> done(order.size());
+    size_t nNextRead = 0;
+    size_t nNextAccept = 0;
+    uint64_t nAheadBytes = 0;
+    bool fStop = false;
+
+    auto read_blocks = [&] {
+        while (true) {
+            size_t i;
+            {
+                WAIT_LOCK(cs_loaded, lock);
+                cond_loaded.wait(lock, [&] {
+                    return fStop || nNextRead == order.size() || nNextRead == nNextAccept ||
+                           nAheadBytes + order[nNextRead]->nSize <= REINDEX_READ_AHEAD_SIZE;
+                });
+                if (fStop || nNextRead == order.size()) return;
+                i = nNextRead++;
+                nAheadBytes += order[i]->nSize;
+            }
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblock, order[i]->pos, chainparams.GetConsensus())) {
+                // Caches a successful result in the block, so AcceptBlock skips it.
+                BlockValidationState state;
+                CheckBlock(*pblock, state, chainparams.GetConsensus());
+            } else {
+                pblock.reset();
+            }
+            LOCK(cs_loaded);
+            loaded[i] = std::move(pblock);
+            done[i] = true;
+            cond_loaded.notify_all();
+        }
+    };
+
+    int nLoaded = 0;
+    uint64_t nLoadedBytes = 0;
+    int64_t nLastLog = nStart;
+    {
+        ReindexWorkers workers(nThreads, read_blocks);
+        auto stop = [&] {
+            LOCK(cs_loaded);
+            fStop = true;
+            cond_loaded.notify_all();
+        };
+        try {
+            for (size_t i = 0; i < order.size(); ++i) {
+                boost::this_thread::interruption_point();
+                std::shared_ptr<CBlock> pblock;
+                {
+                    WAIT_LOCK(cs_loaded, lock);
+                    cond_loaded.wait(lock, [&] { return done[i]; });
+                    pblock = std::move(loaded[i]);
+                    nNextAccept = i + 1;
+                    nAheadBytes -= order[i]->nSize;
+                    cond_loaded.notify_all();
+                }
+                if (!pblock) continue;
+
+                {
+                    LOCK(cs_main);
+                    CBlockIndex* pindex = LookupBlockIndex(order[i]->hash);
+                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+                        BlockValidationState state;
+                        if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, &order[i]->pos, nullptr)) {
+                            nLoaded++;
+                            nLoadedBytes += order[i]->nSize;
+                        }
+                        if (state.IsError()) break;
+                    }
+                }
+
+                // Activate the genesis block so normal node progress can continue
+                if (order[i]->hash == chainparams.GetConsensus().hashGenesisBlock) {
+                    BlockValidationState state;
+                    if (!ActivateBestChain(state, chainparams)) break;
+                }
+
+                NotifyHeaderTip();
+
+                const int64_t nNow = GetTimeMicros();
+                if (nNow - nLastLog > 10 * 1000000) {
+                    LogPrintf("Reindex: loaded %u of %u blocks (%.1f MB/s)\n", i + 1, order.size(), MegabytesPerSecond(nLoadedBytes, nNow - nStart));
+                    nLastLog = nNow;
+                }
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+        stop();
+    }
+    nElapsed = GetTimeMicros() - nStart;
+    LogPrintf("Reindex: loaded %d blocks (%.1f MB) in %.2fs (%.1f MB/s)\n",
+        nLoaded, nLoadedBytes * 1e-6, nElapsed * 1e-6, MegabytesPerSecond(nLoadedBytes, nElapsed));
+    return nLoaded > 0;
+}
+
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -4781,6 +5681,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 
     LOCK(cs_main);
 
+    // The checks below assume that every block up to the tip has been
+    // received, which does not hold for a chainstate loaded from a snapshot.
+    if (g_background_chainstate) {
+        return;
+    }
+
     // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
     // so we have the genesis block in m_blockman.m_block_index but no active chain. (A few of the
     // tests when iterating the block tree require that m_chain has been initialized.)
@@ -5119,6 +6025,554 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+/**
+ * Version of sigcache.dat. Cached results are only as good as the script
+ * interpreter that produced them, so bump this whenever a change to script
+ * verification could turn a previously valid result invalid.
+ */
+static const uint64_t SCRIPT_CACHES_DUMP_VERSION = 1;
+
+/** Key that authenticates sigcache.dat, set once the caches are salted from sigcache.key. */
+static uint256 g_script_caches_mac_key;
+static std::atomic<bool> g_script_caches_keyed{false};
+
+/**
+ * Read the secret of the datadir from sigcache.key, creating it if needed.
+ * The salt of the caches and the key that authenticates sigcache.dat are
+ * derived from it, so sigcache.dat alone neither reveals the salt nor can
+ * be forged.
+ */
+static bool ReadScriptCachesKey(std::vector<unsigned char>& key)
+{
+    const fs::path path = GetDataDir() / "sigcache.key";
+    key.assign(32, 0);
+    if (fs::exists(path)) {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull() || fs::file_size(path) != key.size()) {
+            return error("%s: %s is not a valid key file", __func__, path.string());
+        }
+        file.read((char*)key.data(), key.size());
+        return true;
+    }
+
+    GetStrongRandBytes(key.data(), key.size());
+    const fs::path path_new = GetDataDir() / "sigcache.key.new";
+    CAutoFile file(fsbridge::fopen(path_new, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: failed to create %s", __func__, path.string());
+    }
+    file.write((const char*)key.data(), key.size());
+    if (!FileCommit(file.Get())) {
+        return error("%s: failed to write %s", __func__, path.string());
+    }
+    file.fclose();
+    return RenameOver(path_new, path);
+}
+
+static uint256 DeriveScriptCachesKey(const std::vector<unsigned char>& key, const std::string& purpose)
+{
+    uint256 out;
+    CHMAC_SHA256(key.data(), key.size()).Write((const unsigned char*)purpose.data(), purpose.size()).Finalize(out.begin());
+    return out;
+}
+
+static uint256 ScriptCachesMAC(const CDataStream& data)
+{
+    uint256 mac;
+    CHMAC_SHA256(g_script_caches_mac_key.begin(), g_script_caches_mac_key.size()).Write((const unsigned char*)data.data(), data.size()).Finalize(mac.begin());
+    return mac;
+}
+
+bool LoadScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    // Salt the caches with the secret of the datadir before they are used,
+    // so that the entries of this run can be loaded by the next one.
+    std::vector<unsigned char> key;
+    if (!ReadScriptCachesKey(key)) {
+        LogPrintf("Failed to read the signature cache key. The signature cache will not be persisted.\n");
+        return false;
+    }
+    g_script_caches_mac_key = DeriveScriptCachesKey(key, "sigcache.dat authentication");
+    RestoreSignatureCacheSnapshot(DeriveScriptCachesKey(key, "signature cache salt"), {});
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = DeriveScriptCachesKey(key, "script execution cache salt");
+    }
+    g_script_caches_keyed = true;
+
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    std::vector<uint256> sig_entries, script_entries;
+    try {
+        CDataStream data(SER_DISK, CLIENT_VERSION);
+        data.resize(fs::file_size(GetDataDir() / "sigcache.dat"));
+        file.read(data.data(), data.size());
+        if (data.size() < sizeof(uint256)) {
+            throw std::ios_base::failure("file too short");
+        }
+
+        // The entries are trusted to skip script checks, so the file must
+        // have been written by this datadir.
+        uint256 mac;
+        memcpy(mac.begin(), data.data() + data.size() - mac.size(), mac.size());
+        data.resize(data.size() - mac.size());
+        if (ScriptCachesMAC(data) != mac) {
+            LogPrintf("Signature cache file on disk failed its integrity check. Continuing anyway.\n");
+            return false;
+        }
+
+        uint64_t version;
+        data >> version;
+        if (version != SCRIPT_CACHES_DUMP_VERSION) {
+            LogPrintf("Signature cache file on disk has version %u, expected %u. Continuing anyway.\n", version, SCRIPT_CACHES_DUMP_VERSION);
+            return false;
+        }
+        data >> sig_entries >> script_entries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    RestoreSignatureCacheSnapshot(DeriveScriptCachesKey(key, "signature cache salt"), sig_entries);
+    {
+        LOCK(cs_main);
+        for (const uint256& entry : script_entries) {
+            scriptExecutionCache.insert(entry);
+        }
+    }
+    LogPrintf("Imported signature cache from disk: %u signature entries, %u script execution entries, %gs\n",
+        sig_entries.size(), script_entries.size(), (GetTimeMicros() - start) * MICRO);
+    return true;
+}
+
+bool DumpScriptCaches()
+{
+    // Entries salted with anything but the secret of the datadir, for
+    // example after a failed start, would replace a good file with
+    // useless ones.
+    if (!g_script_caches_keyed) {
+        return false;
+    }
+
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    GetSignatureCacheSnapshot(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        script_entries = scriptExecutionCache.live_elements();
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        CDataStream data(SER_DISK, CLIENT_VERSION);
+        data << SCRIPT_CACHES_DUMP_VERSION;
+        data << sig_entries << script_entries;
+        const uint256 mac = ScriptCachesMAC(data);
+
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file.write(data.data(), data.size());
+        file << mac;
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature cache: %u signature entries, %u script execution entries, %gs to copy, %gs to dump\n",
+            sig_entries.size(), script_entries.size(), (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Give the snapshot base the nChainTx recorded in the snapshot and link the
+ * blocks received on top of it, then offer the snapshot chainstate every
+ * block it may connect.
+ */
+static void LinkSnapshotBase(CChainState& snapshot, CBlockIndex* base, unsigned int nchaintx) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!base->HaveTxsDownloaded()) {
+        base->nChainTx = nchaintx;
+        std::deque<CBlockIndex*> queue;
+        queue.push_back(base);
+        while (!queue.empty()) {
+            CBlockIndex* pindex = queue.front();
+            queue.pop_front();
+            auto range = g_blockman.m_blocks_unlinked.equal_range(pindex);
+            while (range.first != range.second) {
+                auto it = range.first++;
+                it->second->nChainTx = pindex->nChainTx + it->second->nTx;
+                queue.push_back(it->second);
+                g_blockman.m_blocks_unlinked.erase(it);
+            }
+        }
+    }
+
+    snapshot.setBlockIndexCandidates.insert(base);
+    for (const std::pair<const uint256, CBlockIndex*>& entry : g_blockman.m_block_index) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nHeight > base->nHeight && pindex->IsValid(BLOCK_VALID_TRANSACTIONS) &&
+            pindex->HaveTxsDownloaded() && pindex->GetAncestor(base->nHeight) == base) {
+            snapshot.setBlockIndexCandidates.insert(pindex);
+        }
+    }
+}
+
+/** Keep the background chainstate from connecting anything but the ancestors of the snapshot base. */
+static void RestrictBackgroundCandidates(CChainState& background, const CBlockIndex* base) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    for (auto it = background.setBlockIndexCandidates.begin(); it != background.setBlockIndexCandidates.end();) {
+        if (base->GetAncestor((*it)->nHeight) != *it) {
+            it = background.setBlockIndexCandidates.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/** Read the coins of a snapshot into the coins database of the chainstate that is built from it. */
+static bool LoadSnapshotCoins(CChainState& snapshot, CAutoFile& coins_file, const SnapshotMetadata& metadata, const CBlockIndex* base, std::string& error)
+{
+    CCoinsViewCache& coins_cache = *WITH_LOCK(::cs_main, return &snapshot.CoinsTip());
+    const uint256 base_blockhash = base->GetBlockHash();
+    uint64_t coins_processed = 0;
+    COutPoint outpoint;
+    Coin coin;
+
+    int64_t nStart = GetTimeMillis();
+    while (coins_processed < metadata.m_coins_count) {
+        try {
+            coins_file >> outpoint;
+            coins_file >> coin;
+        } catch (const std::ios_base::failure&) {
+            error = strprintf("Bad snapshot format or truncated snapshot after deserializing %d coins", coins_processed);
+            return false;
+        }
+        if (coin.nHeight > (uint32_t)base->nHeight || coin.out.IsNull()) {
+            error = strprintf("Bad snapshot data after deserializing %d coins", coins_processed);
+            return false;
+        }
+        try {
+            coins_cache.AddCoin(outpoint, std::move(coin), false);
+        } catch (const std::logic_error&) {
+            error = strprintf("Duplicate coin %s in snapshot", outpoint.ToString());
+            return false;
+        }
+        ++coins_processed;
+
+        if (coins_processed % 1000000 == 0) {
+            LogPrintf("[snapshot] %d coins loaded (%.2f%%, %.2f MB)\n",
+                coins_processed, coins_processed * 100.0 / metadata.m_coins_count,
+                coins_cache.DynamicMemoryUsage() * (1.0 / (1 << 20)));
+        }
+        if (coins_processed % 120000 == 0) {
+            if (ShutdownRequested()) {
+                error = "Shutdown requested while loading the snapshot";
+                return false;
+            }
+            // Stay within the share of -dbcache the snapshot chainstate gets.
+            if (coins_cache.DynamicMemoryUsage() > nCoinCacheUsage / 2) {
+                coins_cache.SetBestBlock(base_blockhash);
+                if (!coins_cache.Flush()) {
+                    error = "Failed to write the snapshot coins";
+                    return false;
+                }
+            }
+        }
+    }
+
+    // The snapshot must hold exactly the announced number of coins.
+    bool out_of_coins = false;
+    try {
+        coins_file >> outpoint;
+    } catch (const std::ios_base::failure&) {
+        out_of_coins = true;
+    }
+    if (!out_of_coins) {
+        error = strprintf("Bad snapshot: coins left over after deserializing %d coins", coins_processed);
+        return false;
+    }
+
+    coins_cache.SetBestBlock(base_blockhash);
+    if (!coins_cache.Flush()) {
+        error = "Failed to write the snapshot coins";
+        return false;
+    }
+    LogPrintf("[snapshot] loaded %d coins in %dms\n", coins_processed, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, const uint256& txoutset_hash, const CChainParams& chainparams, std::string& error)
+{
+    CBlockIndex* base;
+    {
+        LOCK(cs_main);
+        if (g_background_chainstate) {
+            error = "A snapshot chainstate is already in use";
+            return false;
+        }
+        base = LookupBlockIndex(metadata.m_base_blockhash);
+        if (!base) {
+            error = strprintf("The header of the snapshot base block %s must be received first", metadata.m_base_blockhash.ToString());
+            return false;
+        }
+        if (base->nStatus & BLOCK_FAILED_MASK) {
+            error = strprintf("The snapshot base block %s is invalid", metadata.m_base_blockhash.ToString());
+            return false;
+        }
+        const CBlockIndex* tip = ::ChainActive().Tip();
+        if (base->nHeight <= tip->nHeight || base->GetAncestor(tip->nHeight) != tip) {
+            error = "The snapshot base block must be a descendant of the current tip";
+            return false;
+        }
+        if (metadata.m_nchaintx <= (unsigned int)base->nHeight) {
+            error = "Bad snapshot metadata: transaction count is too low";
+            return false;
+        }
+    }
+
+    const fs::path snapshot_dir = GetDataDir() / SNAPSHOT_CHAINSTATE_DIR;
+    std::unique_ptr<CChainState> snapshot = MakeUnique<CChainState>(g_blockman, metadata.m_base_blockhash);
+    {
+        LOCK(cs_main);
+        snapshot->InitCoinsDB(nMaxCoinsDBCache << 20, false, true, SNAPSHOT_CHAINSTATE_DIR);
+        snapshot->InitCoinsCache();
+    }
+    const auto discard = [&]() {
+        snapshot.reset();
+        fs::remove_all(snapshot_dir);
+        return false;
+    };
+
+    LogPrintf("[snapshot] loading %d coins at block %s (height %d)\n", metadata.m_coins_count, base->GetBlockHash().ToString(), base->nHeight);
+    if (!LoadSnapshotCoins(*snapshot, coins_file, metadata, base, error)) {
+        return discard();
+    }
+
+    CCoinsStats stats;
+    if (!GetUTXOStats(WITH_LOCK(::cs_main, return &snapshot->CoinsDB()), stats)) {
+        error = "Failed to compute the hash of the snapshot coins";
+        return discard();
+    }
+    if (stats.hashSerialized != txoutset_hash) {
+        error = strprintf("Bad snapshot content hash: expected %s, got %s", txoutset_hash.ToString(), stats.hashSerialized.ToString());
+        return discard();
+    }
+    if (!WITH_LOCK(::cs_main, return snapshot->CoinsDB().WriteSnapshotBase(metadata, txoutset_hash))) {
+        error = "Failed to write the snapshot metadata";
+        return discard();
+    }
+
+    {
+        LOCK(cs_main);
+        CBlockIndex* old_tip = ::ChainActive().Tip();
+        if (g_background_chainstate || base->GetAncestor(old_tip->nHeight) != old_tip || base->nHeight <= old_tip->nHeight) {
+            error = "The chain moved past the snapshot base block while it was loading";
+            return discard();
+        }
+
+        LinkSnapshotBase(*snapshot, base, metadata.m_nchaintx);
+        snapshot->m_chain.SetTip(base);
+        RestrictBackgroundCandidates(*g_chainstate, base);
+
+        // The mempool was checked against the coins of the previous tip.
+        mempool.clear();
+        g_background_chainstate = std::move(g_chainstate);
+        g_chainstate = std::move(snapshot);
+        g_snapshot_validated = false;
+        UpdateTip(*g_chainstate, base, chainparams);
+
+        const bool fInitialDownload = g_chainstate->IsInitialBlockDownload();
+        GetMainSignals().UpdatedBlockTip(base, old_tip, fInitialDownload);
+        uiInterface.NotifyBlockTip(fInitialDownload, base);
+        LogPrintf("[snapshot] active chainstate is now at height %d, validating the %d blocks below it in the background\n",
+            base->nHeight, base->nHeight - old_tip->nHeight);
+    }
+
+    BlockValidationState state;
+    if (!::ChainstateActive().ActivateBestChain(state, chainparams, nullptr)) {
+        error = strprintf("ActivateBestChain failed (%s)", state.ToString());
+        return false;
+    }
+    return ActivateBackgroundChainstate(chainparams, nullptr);
+}
+
+/**
+ * Once the background chainstate reached the snapshot base, compare its coins
+ * with the ones the snapshot was loaded from. The result is recorded in the
+ * snapshot coins database and acted upon at the next startup.
+ */
+static void MaybeCompleteSnapshotValidation() LOCKS_EXCLUDED(cs_main)
+{
+    // Only one thread compares the coins and records the result.
+    static Mutex completion_mutex;
+    LOCK(completion_mutex);
+
+    const CBlockIndex* base;
+    CCoinsView* coins_view = nullptr;
+    std::unique_ptr<CCoinsViewCursor> cursor;
+    uint256 txoutset_hash;
+    bool valid = true;
+    {
+        LOCK(cs_main);
+        CChainState* background = ChainstateBackground();
+        if (!background) return;
+        CChainState& snapshot = ::ChainstateActive();
+        base = LookupBlockIndex(snapshot.m_from_snapshot_blockhash);
+        assert(base);
+
+        for (const CBlockIndex* failed : g_blockman.m_failed_blocks) {
+            if (base->GetAncestor(failed->nHeight) == failed) valid = false;
+        }
+        if (valid) {
+            if (background->m_chain.Tip() != base) return;
+
+            // Create the cursor under the same cs_main hold as the flush, so
+            // that it reads the coins at the snapshot base.
+            SnapshotMetadata metadata;
+            background->ForceFlushStateToDisk();
+            if (!snapshot.CoinsDB().ReadSnapshotBase(metadata, txoutset_hash)) {
+                AbortNode("Failed to compare the background chainstate with the snapshot");
+                return;
+            }
+            coins_view = &background->CoinsDB();
+            cursor.reset(coins_view->Cursor());
+        }
+    }
+
+    if (valid) {
+        // Hash the whole set without cs_main, which would stall the node
+        // for the duration of the scan.
+        CCoinsStats stats;
+        if (!GetUTXOStats(coins_view, stats, CoinStatsHashType::HASH_SERIALIZED, nullptr, std::move(cursor))) {
+            AbortNode("Failed to compare the background chainstate with the snapshot");
+            return;
+        }
+        valid = stats.hashSerialized == txoutset_hash;
+        if (!valid) {
+            LogPrintf("[snapshot] UTXO set hash at the snapshot base is %s, the snapshot has %s\n",
+                stats.hashSerialized.ToString(), txoutset_hash.ToString());
+        }
+    }
+
+    LOCK(cs_main);
+    if (!::ChainstateActive().CoinsDB().WriteSnapshotValidation(valid)) {
+        AbortNode("Failed to write the snapshot validation result");
+        return;
+    }
+    if (valid) {
+        g_snapshot_validated = true;
+        LogPrintf("[snapshot] background validation reached the snapshot base %s: the snapshot is valid\n", base->GetBlockHash().ToString());
+    } else {
+        AbortNode("The UTXO snapshot does not match the blocks below it",
+            _("The loaded UTXO snapshot is invalid. Restart to discard it and synchronize from the blocks.").translated);
+    }
+}
+
+bool ActivateBackgroundChainstate(const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock)
+{
+    CChainState* background = WITH_LOCK(cs_main, return ChainstateBackground());
+    if (!background) return true;
+
+    BlockValidationState state;
+    if (!background->ActivateBestChain(state, chainparams, pblock)) {
+        return error("%s: ActivateBestChain failed (%s)", __func__, state.ToString());
+    }
+    MaybeCompleteSnapshotValidation();
+    return true;
+}
+
+bool CleanupSnapshotChainstate(bool wipe, std::string& error)
+{
+    const fs::path snapshot_dir = GetDataDir() / SNAPSHOT_CHAINSTATE_DIR;
+    if (!fs::exists(snapshot_dir)) return true;
+
+    bool validated = false;
+    bool valid = false;
+    if (!wipe) {
+        CCoinsViewDB db(snapshot_dir, 1 << 20, false, false);
+        SnapshotMetadata metadata;
+        uint256 txoutset_hash;
+        // A snapshot whose load was interrupted has no metadata.
+        wipe = !db.ReadSnapshotBase(metadata, txoutset_hash);
+        validated = db.ReadSnapshotValidation(valid);
+    }
+
+    try {
+        if (wipe || (validated && !valid)) {
+            LogPrintf("[snapshot] removing the snapshot chainstate\n");
+            fs::remove_all(snapshot_dir);
+        } else if (validated) {
+            LogPrintf("[snapshot] replacing the chainstate with the validated snapshot chainstate\n");
+            fs::remove_all(GetDataDir() / "chainstate");
+            fs::rename(snapshot_dir, GetDataDir() / "chainstate");
+        }
+    } catch (const fs::filesystem_error& e) {
+        error = strprintf("Failed to clean up the snapshot chainstate: %s", fsbridge::get_filesystem_error_message(e));
+        return false;
+    }
+    return true;
+}
+
+bool LoadSnapshotChainstate(const CChainParams& chainparams, std::string& error)
+{
+    AssertLockHeld(cs_main);
+    if (!fs::exists(GetDataDir() / SNAPSHOT_CHAINSTATE_DIR)) return true;
+
+    std::unique_ptr<CChainState> snapshot = MakeUnique<CChainState>(g_blockman);
+    snapshot->InitCoinsDB(nMaxCoinsDBCache << 20, false, false, SNAPSHOT_CHAINSTATE_DIR);
+    SnapshotMetadata metadata;
+    uint256 txoutset_hash;
+    if (!snapshot->CoinsDB().ReadSnapshotBase(metadata, txoutset_hash)) {
+        error = "Error reading the snapshot chainstate metadata";
+        return false;
+    }
+    snapshot->m_from_snapshot_blockhash = metadata.m_base_blockhash;
+    CBlockIndex* base = LookupBlockIndex(metadata.m_base_blockhash);
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    if (!base || (tip && base->GetAncestor(tip->nHeight) != tip)) {
+        error = "The snapshot chainstate does not build on the chainstate";
+        return false;
+    }
+    if (!snapshot->ReplayBlocks(chainparams)) {
+        error = "Unable to replay blocks on the snapshot chainstate";
+        return false;
+    }
+    snapshot->InitCoinsCache();
+
+    LinkSnapshotBase(*snapshot, base, metadata.m_nchaintx);
+    if (!snapshot->LoadChainTip(chainparams)) {
+        error = "Error initializing the snapshot chainstate";
+        return false;
+    }
+    RestrictBackgroundCandidates(*g_chainstate, base);
+
+    g_background_chainstate = std::move(g_chainstate);
+    g_chainstate = std::move(snapshot);
+    g_snapshot_validated = false;
+    LogPrintf("[snapshot] loaded the snapshot chainstate based on block %s (height %d), background chainstate at height %d\n",
+        base->GetBlockHash().ToString(), base->nHeight, g_background_chainstate->m_chain.Height());
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
@@ -24,6 +24,7 @@
 #include <serialize.h>
 
 #include <atomic>
+#include <chrono>
 #include <map>
 #include <memory>
 #include <set>
@@ -32,6 +33,9 @@
 #include <vector>
 
 class CChainState;
+class CAutoFile;
+class CBlockView;
+class SnapshotMetadata;
 class BlockValidationState;
 class CBlockIndex;
 class CBlockTreeDB;
@@ -75,9 +79,23 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The read buffer used when only the header of a stored block is needed */
+static const unsigned int BLOCK_HEADER_READ_BUFFER_SIZE = 0x1000; // 4 KiB
+/** Maximum number of threads scanning block files and reading blocks ahead during -reindex */
+static const int MAX_REINDEX_THREADS = 8;
+/** Bytes of blocks read ahead of the one being accepted during -reindex */
+static const uint64_t REINDEX_READ_AHEAD_SIZE = 256 * 1024 * 1024;
 
 /** Maximum number of dedicated script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 15;
+static const int MAX_SCRIPTCHECK_THREADS = 63;
+/** Maximum number of dedicated script-checking threads started when -par is 0 or negative; larger counts must be set explicitly */
+static const int MAX_AUTO_SCRIPTCHECK_THREADS = 15;
+/** Number of headers whose proofs of work one worker pool thread verifies together */
+static const size_t AUXPOW_CHECK_RANGE_SIZE = 32;
+/** Number of block transactions one worker pool thread prechecks together */
+static const size_t TX_PRECHECK_RANGE_SIZE = 64;
+/** Number of pairs of hashes one worker pool thread hashes together; smaller tree levels are hashed on the calling thread */
+static const size_t MERKLE_HASH_RANGE_SIZE = 1024;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
@@ -101,6 +119,10 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Default for -coinsflushbatch, the number of modified coins written by each step of the background coins flusher (0 to disable it). */
+static const unsigned int DEFAULT_COINS_FLUSH_BATCH = 50000;
+/** Time between the steps of the background coins flusher. */
+static constexpr std::chrono::seconds COINS_FLUSH_INTERVAL{1};
 /** Block download timeout base, expressed in millionths of the block interval (i.e. 10 min) */
 static const int64_t BLOCK_DOWNLOAD_TIMEOUT_BASE = 1000000;
 /** Additional block download timeout per parallel downloading peer (i.e. 5 min) */
@@ -116,6 +138,8 @@ static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = false;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 
@@ -233,6 +257,12 @@ FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const FlatFilePos &pos);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos *dbp = nullptr);
+/**
+ * Rebuild the block index from the blk?????.dat files for -reindex. The files
+ * are scanned in parallel for block headers, and the blocks are then accepted
+ * in chain order while worker threads read and check the next ones.
+ */
+bool ReindexBlockFiles(const CChainParams& chainparams);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -242,6 +272,8 @@ bool LoadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Log the utilisation of the script checking threads (master first) */
+void LogScriptCheckStats();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
@@ -272,6 +304,14 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nManualPruneHeight);
 
+/**
+ * Write a batch of the modified coins of each chainstate to its coins
+ * database, keeping them cached. Run by the scheduler every
+ * COINS_FLUSH_INTERVAL, so that the flushes of a full coins cache have little
+ * left to write, and to write all of them periodically.
+ */
+void FlushCoinsIncremental();
+
 /** (try to) add transaction to memory pool
  * plTxnReplaced will be appended to with all transactions replaced from mempool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
@@ -355,6 +395,16 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Compute all levels of a merkle tree like ComputeMerkleLevels, with the large
+ * levels split over the worker pool.
+ */
+std::vector<std::vector<uint256>> ComputeMerkleLevelsParallel(std::vector<uint256> leaves, bool* mutated = nullptr);
+/** BlockMerkleRoot, computed with ComputeMerkleLevelsParallel */
+uint256 BlockMerkleRootParallel(const CBlock& block, bool* mutated = nullptr);
+/** BlockWitnessMerkleRoot, computed with ComputeMerkleLevelsParallel */
+uint256 BlockWitnessMerkleRootParallel(const CBlock& block, bool* mutated = nullptr);
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -362,8 +412,13 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read only the header (including the auxpow header) of a stored block, without its transactions */
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const FlatFilePos& pos, const Consensus::Params& consensusParams);
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Read a stored block into a CBlockView, without deserializing its transactions */
+bool ReadBlockViewFromDisk(CBlockView& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, const CMessageHeader::MessageStartChars& message_start);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
@@ -384,6 +439,20 @@ bool RewindBlockIndex(const CChainParams& params) LOCKS_EXCLUDED(cs_main);
 
 /** Compute at which vout of the block's coinbase transaction the witness commitment occurs, or -1 if not found */
 int GetWitnessCommitmentIndex(const CBlock& block);
+int GetWitnessCommitmentIndex(const CTransaction& coinbase);
+
+/** Check that every output of the block's coinbase transaction, except the witness commitment, pays to a DDMS allowed script */
+bool DdmsVerifyCoinbase(const CBlock& block);
+bool DdmsVerifyCoinbaseOutput(const CTransaction& coinbase);
+
+/**
+ * Check what can be checked of a block from its header and coinbase alone:
+ * the coinbase height, the DDMS coinbase outputs and the witness reserved
+ * value. This runs before the rest of the block is downloaded. The coinbase
+ * is not yet tied to the header by the merkle root, so a failure only means
+ * that this copy of the block is bad, not that the block is invalid.
+ */
+bool CheckBlockCoinbase(const CBlockHeader& header, const CTransaction& coinbase, BlockValidationState& state, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 /** Update uncommitted block structures (currently: only the witness reserved value). This is safe for submitted blocks. */
 void UpdateUncommittedBlockStructures(CBlock& block, const CBlockIndex* pindexPrev, const Consensus::Params& consensusParams);
@@ -398,6 +467,12 @@ std::vector<unsigned char> GenerateCoinbaseCommitment(CBlock& block, const CBloc
  */
 bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params);
 
+/** Check proof-of-work of several block headers, in parallel on the worker
+ * pool unless parallel checks are disabled (-par=1).
+ * @return One flag per header, true if its PoW is correct.
+ */
+std::vector<bool> CheckProofOfWorkBatch(const std::vector<CBlockHeader>& headers, const Consensus::Params& params);
+
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
 class CVerifyDB {
 public:
@@ -419,13 +494,19 @@ enum DisconnectResult
 };
 
 class ConnectTrace;
+class CBlockPrefetch;
 
 /** @see CChainState::FlushStateToDisk */
 enum class FlushStateMode {
     NONE,
     IF_NEEDED,
     PERIODIC,
-    ALWAYS
+    ALWAYS,
+    //! Write the blocks and block index that the modified coins may refer
+    //! to, before the background coins flusher writes them.
+    INCREMENTAL,
+    //! Write all the modified coins, keeping them cached.
+    SYNC,
 };
 
 struct CBlockIndexWorkComparator
@@ -494,12 +575,14 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     * Pass fCheckPOW = false if the proof of work was already verified.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -598,9 +681,18 @@ private:
     std::unique_ptr<CoinsViews> m_coins_views;
 
 public:
-    CChainState(BlockManager& blockman) : m_blockman(blockman) {}
+    explicit CChainState(BlockManager& blockman, const uint256& from_snapshot_blockhash = uint256())
+        : m_blockman(blockman), m_from_snapshot_blockhash(from_snapshot_blockhash) {}
     CChainState();
 
+    //! The base block of the UTXO snapshot this chainstate was loaded from;
+    //! null for a chainstate built by connecting every block since genesis.
+    uint256 m_from_snapshot_blockhash;
+
+    //! @returns whether this is the chainstate that serves the tip, the
+    //! mempool and the validation interface.
+    bool IsActive() const;
+
     /**
      * Initialize the CoinsViews UTXO set database management data structures. The in-memory
      * cache is initialized separately.
@@ -677,6 +769,50 @@ public:
     //! Unconditionally flush all changes to disk.
     void ForceFlushStateToDisk();
 
+    /**
+     * Write up to batch_size modified coins of the tip cache to the coins
+     * database, keeping them cached, or all of them once DATABASE_FLUSH_INTERVAL
+     * has passed since they were last all written. The coins are taken out of
+     * the cache under cs_main, and written after it is released, so that block
+     * connection and RPCs do not wait for the database.
+     *
+     * @returns true unless a system error occurred
+     */
+    bool WriteCoinsInBackground(const CChainParams& chainparams, BlockValidationState& state, size_t batch_size) LOCKS_EXCLUDED(cs_main);
+
+    //! Activity of the coins flushes, reported by getcoinsflushinfo.
+    struct CoinsFlushStats {
+        //! Batches and coins written by the background coins flusher.
+        uint64_t incremental_batches{0};
+        uint64_t incremental_coins{0};
+        //! Flushes that wrote all the modified coins, and the coins they wrote.
+        uint64_t full_flushes{0};
+        uint64_t full_flush_coins{0};
+        //! Duration of the last of them.
+        int64_t last_full_flush_micros{0};
+    };
+    CoinsFlushStats m_coins_flush_stats GUARDED_BY(::cs_main);
+
+private:
+    //! When all the modified coins were last written to the coins database.
+    int64_t m_last_coins_sync GUARDED_BY(::cs_main){0};
+
+    /**
+     * Whether WriteCoinsInBackground is writing coins without cs_main, which
+     * any other write to the coins database must wait for, and whether one
+     * of those writes failed, after which the coins are not written anymore.
+     */
+    Mutex m_coins_write_mutex;
+    std::condition_variable m_coins_write_cv;
+    bool m_coins_write_in_flight GUARDED_BY(m_coins_write_mutex){false};
+    bool m_coins_write_failed GUARDED_BY(m_coins_write_mutex){false};
+
+    //! Wait until no coins are written by WriteCoinsInBackground, and return
+    //! whether the coins database can be written.
+    bool WaitForCoinsWrite();
+
+public:
+
     //! Prune blockfiles from the disk if necessary and then flush chainstate changes
     //! if we pruned.
     void PruneAndFlush();
@@ -749,7 +885,7 @@ public:
         size_t max_mempool_size_bytes) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
 private:
-    bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
+    bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace, std::unique_ptr<CBlockPrefetch>& prefetch) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
     bool ConnectTip(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
 
     void InvalidBlockFound(CBlockIndex *pindex, const BlockValidationState &state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -789,6 +925,39 @@ BlockMap& BlockIndex();
 // directly, e.g. init.cpp.
 extern std::unique_ptr<CChainState> g_chainstate;
 
+/**
+ * While g_chainstate was loaded from a UTXO snapshot, this is the chainstate
+ * that connects the blocks below the snapshot base in the background, so that
+ * the snapshot can be compared against them. It only ever reaches the base.
+ */
+extern std::unique_ptr<CChainState> g_background_chainstate;
+
+/** @returns the chainstate still validating the history of the active snapshot chainstate, or nullptr. */
+CChainState* ChainstateBackground() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/** Directory name of the coins database of a chainstate loaded from a UTXO snapshot. */
+static const char* const SNAPSHOT_CHAINSTATE_DIR = "chainstate_snapshot";
+
+/**
+ * Load the coins written by dumptxoutset into a new chainstate and make it the
+ * active one, keeping the current chainstate to validate the blocks below the
+ * snapshot base. The coins must hash to txoutset_hash (see hash_serialized_2).
+ */
+bool ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, const uint256& txoutset_hash, const CChainParams& chainparams, std::string& error) LOCKS_EXCLUDED(cs_main);
+
+/**
+ * Deal with the snapshot chainstate left by a previous run before any coins
+ * database is opened: promote it once validated, discard it if it was found
+ * invalid or if wipe is set.
+ */
+bool CleanupSnapshotChainstate(bool wipe, std::string& error);
+
+/** Connect the blocks received below the snapshot base, if a snapshot is being validated. */
+bool ActivateBackgroundChainstate(const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock = nullptr) LOCKS_EXCLUDED(cs_main);
+
+/** Reopen the snapshot chainstate left by a previous run on top of the loaded g_chainstate. */
+bool LoadSnapshotChainstate(const CChainParams& chainparams, std::string& error) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern std::unique_ptr<CBlockTreeDB> pblocktree;
 
@@ -815,6 +984,16 @@ bool DumpMempool(const CTxMemPool& pool);
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the signature and script execution caches to disk. Does nothing unless LoadScriptCaches salted them. */
+bool DumpScriptCaches();
+
+/**
+ * Salt the signature and script execution caches from the secret in
+ * sigcache.key and load the entries of sigcache.dat if it authenticates
+ * with that secret. Must run before any script is verified.
+ */
+bool LoadScriptCaches();
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -0,0 +1,85 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <workerpool.h>
+
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+
+CWorkerPool g_worker_pool;
+
+void CWorkerPool::Job::RunParts()
+{
+    size_t i;
+    while ((i = m_next++) < m_count) {
+        try {
+            m_fn(i);
+        } catch (...) {
+            m_errors[i] = std::current_exception();
+        }
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        if (++m_done == m_count) m_cond.notify_all();
+    }
+}
+
+std::shared_ptr<CWorkerPool::Job> CWorkerPool::Start(size_t count, std::function<void(size_t)> fn, size_t max_threads)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>(count, std::move(fn));
+    // A thread that runs Wait helps as well, so a single part is only handed
+    // to the pool if the caller wants to do something else meanwhile.
+    const size_t helpers = std::min<size_t>({count, (size_t)m_threads, max_threads});
+    if (helpers > 0) {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        for (size_t i = 0; i < helpers; ++i) {
+            m_queue.push_back(job);
+        }
+        if (helpers == 1) {
+            m_cond.notify_one();
+        } else {
+            m_cond.notify_all();
+        }
+    }
+    return job;
+}
+
+void CWorkerPool::Wait(Job& job)
+{
+    job.RunParts();
+    {
+        // The parts may refer to the stack of the caller, so the caller must
+        // not be interrupted while a pool thread runs one.
+        boost::this_thread::disable_interruption no_interruption;
+        boost::unique_lock<boost::mutex> lock(job.m_mutex);
+        while (job.m_done < job.m_count) {
+            job.m_cond.wait(lock);
+        }
+    }
+    for (const std::exception_ptr& error : job.m_errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+void CWorkerPool::Thread()
+{
+    // Count the thread until it stops, including by interruption.
+    struct ThreadGuard {
+        std::atomic<int>& threads;
+        explicit ThreadGuard(std::atomic<int>& threadsIn) : threads(threadsIn) { ++threads; }
+        ~ThreadGuard() { --threads; }
+    } guard(m_threads);
+
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            while (m_queue.empty()) {
+                m_cond.wait(lock);
+            }
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        job->RunParts();
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ELCASH_WORKERPOOL_H
+#define ELCASH_WORKERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Number of threads in the worker pool started by init */
+static const int WORKER_POOL_THREADS = 8;
+
+/**
+ * Pool of long-lived threads for work that mostly waits on the disk, such as
+ * reading blocks and reading or writing the coins database, and for the
+ * block checks that run outside ConnectBlock, split by callers into parts
+ * that run in parallel.
+ *
+ * The threads run Thread(), and stop when they are interrupted. The thread
+ * that waits for a job runs the parts no pool thread has started yet, so a
+ * job completes even when all the pool threads are busy or none is running,
+ * and waiting for a job from a pool thread cannot deadlock.
+ *
+ * Usage:
+ *
+ * g_worker_pool.RunParallel(n, [&](size_t i) { ... }); // Runs part 0 to n - 1
+ *
+ * std::shared_ptr<CWorkerPool::Job> job = g_worker_pool.Start(1, [=](size_t) { ... });
+ * ... // Do something else while a pool thread runs the part
+ * g_worker_pool.Wait(*job);
+ */
+class CWorkerPool
+{
+public:
+    /** Parts of work started together, and their completion. */
+    class Job
+    {
+        friend class CWorkerPool;
+
+        const size_t m_count;
+        const std::function<void(size_t)> m_fn;
+        std::atomic<size_t> m_next{0};
+        size_t m_done{0};
+        std::vector<std::exception_ptr> m_errors;
+        boost::mutex m_mutex;
+        boost::condition_variable m_cond;
+
+        /** Run parts until none is left to start. */
+        void RunParts();
+
+    public:
+        Job(size_t count, std::function<void(size_t)> fn) : m_count(count), m_fn(std::move(fn)), m_errors(count) {}
+    };
+
+    /**
+     * Start fn(0) to fn(count - 1) on at most max_threads of the pool threads.
+     * Long jobs should leave some threads to the others, which would
+     * otherwise wait for them.
+     */
+    std::shared_ptr<Job> Start(size_t count, std::function<void(size_t)> fn, size_t max_threads = std::numeric_limits<size_t>::max());
+
+    /** Run the parts of the job that are not started yet, wait for the others, and rethrow the first error. */
+    void Wait(Job& job);
+
+    /** Run fn(0) to fn(count - 1) on at most max_threads of the pool threads and the calling thread, and rethrow the first error. */
+    void RunParallel(size_t count, std::function<void(size_t)> fn, size_t max_threads = std::numeric_limits<size_t>::max())
+    {
+        Wait(*Start(count, std::move(fn), max_threads));
+    }
+
+    /** Run jobs until the thread is interrupted. */
+    void Thread();
+
+    /** Number of threads running Thread(). */
+    int NumThreads() const { return m_threads; }
+
+private:
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    //! One entry per pool thread that may help with the job.
+    std::deque<std::shared_ptr<Job>> m_queue;
+    std::atomic<int> m_threads{0};
+};
+
+/** The worker pool of the node. */
+extern CWorkerPool g_worker_pool;
+
+#endif // ELCASH_WORKERPOOL_H
@@ -11,6 +11,7 @@ from test_framework.util import (
   assert_equal,
   assert_greater_than_or_equal,
   assert_raises_rpc_error,
+  get_rpc_proxy,
 )
 
 from test_framework.auxpow import reverseHex
@@ -24,6 +25,21 @@ from test_framework.messages import (
 )
 
 from decimal import Decimal
+import threading
+
+class LongpollThread (threading.Thread):
+
+  def __init__ (self, node, addr, longpollid):
+    threading.Thread.__init__ (self)
+    self.addr = addr
+    self.longpollid = longpollid
+    self.result = None
+    # We can't use the same connection from two threads.
+    self.node = get_rpc_proxy (node.url, 1, timeout=600,
+                               coveragedir=node.coverage_dir)
+
+  def run (self):
+    self.result = self.node.createauxblock (self.addr, self.longpollid)
 
 class AuxpowMiningTest (BitcoinTestFramework):
 
@@ -44,6 +60,12 @@ class AuxpowMiningTest (BitcoinTestFramework):
     # Test with createauxblock/submitauxblock.
     self.test_create_submit_auxblock ()
 
+    # Test waiting for a new block with createauxblock.
+    self.test_longpoll ()
+
+    # Test batch submission with submitauxblocks.
+    self.test_submit_batch ()
+
   def test_common (self, create, submit):
     # Verify data that can be found in another way.
     auxblock = create()
@@ -168,5 +190,54 @@ class AuxpowMiningTest (BitcoinTestFramework):
     auxblock2 = self.nodes[0].createauxblock("THG2uNG2VASsFWK4DmpZZpkwKtC5Qjkyoo")
     assert auxblock1['hash'] != auxblock2['hash']
 
+  def test_longpoll (self):
+    coinbaseAddr = "TDv1D3WV2gFK87ucb8bDG7KGjNh5HCPZPi"
+    auxblock = self.nodes[0].createauxblock (coinbaseAddr)
+    assert_equal (auxblock['longpollid'], auxblock['hash'])
+
+    # With a different id, the current block is returned right away.
+    auxblock2 = self.nodes[0].createauxblock (coinbaseAddr, "00" * 32)
+    assert_equal (auxblock2['hash'], auxblock['hash'])
+
+    # Otherwise the call waits until a new block is found.
+    thr = LongpollThread (self.nodes[0], coinbaseAddr, auxblock['longpollid'])
+    thr.start ()
+    thr.join (5)
+    assert thr.is_alive ()
+
+    self.nodes[1].generatetoaddress (1, coinbaseAddr)
+    thr.join (60)
+    assert not thr.is_alive ()
+    assert thr.result['hash'] != auxblock['hash']
+    assert_equal (thr.result['previousblockhash'],
+                  self.nodes[1].getbestblockhash ())
+
+  def test_submit_batch (self):
+    auxblock1 = self.nodes[0].createauxblock ("TMyMSQpgJR4QL6z6u5zz2dLWudi1x5Fobw")
+    auxblock2 = self.nodes[0].createauxblock ("THG2uNG2VASsFWK4DmpZZpkwKtC5Qjkyoo")
+    target = b"%064x" % uint256_from_compact (int (auxblock1['bits'], 16))
+
+    bad = computeAuxpow (auxblock1['hash'], target, False)
+    good1 = computeAuxpow (auxblock1['hash'], target, True)
+    good2 = computeAuxpow (auxblock2['hash'], target, True)
+    proofs = [
+      {"hash": auxblock1['hash'], "auxpow": bad},
+      {"hash": "00" * 32, "auxpow": good1},
+      {"hash": auxblock1['hash'], "auxpow": good1},
+      {"hash": auxblock1['hash'], "auxpow": good1},
+      {"hash": auxblock2['hash'], "auxpow": good2},
+    ]
+    # The block for the second script competes with the first one, but is
+    # accepted as well.  The tip stays with the first one.
+    res = self.nodes[0].submitauxblocks (proofs)
+    assert_equal (res, ["invalid", "unknown", "accepted", "duplicate",
+                        "accepted"])
+    assert_equal (self.nodes[0].getbestblockhash (), auxblock1['hash'])
+
+    # The submitted block is no longer kept for submitauxblock.
+    assert_raises_rpc_error (-8, "block hash unknown",
+                             self.nodes[0].submitauxblock,
+                             auxblock1['hash'], good1)
+
 if __name__ == '__main__':
   AuxpowMiningTest ().main ()
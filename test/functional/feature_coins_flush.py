@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the background coins flusher.
+
+- Check that node0, which writes a single modified coin per second, keeps
+  the written coins cached and reports its backlog in getcoinsflushinfo.
+- Kill node0 while its coins database only has a part of the modified coins,
+  and check that the UTXO set is recovered on restart.
+- Check that disconnecting a block completes the partial write first.
+"""
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    wait_until,
+)
+
+
+class CoinsFlushTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-coinsflushbatch=1"], []]
+
+    def kill_node(self, i):
+        node = self.nodes[i]
+        node.process.kill()
+        node.process.wait(timeout=60)
+        node.stdout.close()
+        node.stderr.close()
+        node.running = False
+        node.process = None
+        node.rpc_connected = False
+        node.rpc = None
+
+    def wait_for_partial_write(self, node):
+        wait_until(lambda: node.getcoinsflushinfo()['partial_write'])
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        info = node0.getcoinsflushinfo()
+        assert_equal(info['dirty_coins'], 0)
+        assert_equal(info['partial_write'], False)
+
+        self.log.info("Write the modified coins in the background")
+        node0.generatetoaddress(20, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.sync_all()
+        cache_coins = node0.getcoinsflushinfo()['cache_coins']
+        wait_until(lambda: node0.getcoinsflushinfo()['incremental_coins'] >= 3)
+        info = node0.getcoinsflushinfo()
+        assert info['partial_write']
+        assert 0 < info['dirty_coins'] < 20
+        assert_equal(info['cache_coins'], cache_coins)
+        assert_equal(info['incremental_batches'], info['incremental_coins'])
+
+        self.log.info("Recover the UTXO set after a crash in the middle of the background write")
+        best_hash = node0.getbestblockhash()
+        utxo_hash = node1.gettxoutsetinfo()['hash_serialized_2']
+        self.kill_node(0)
+        with node0.assert_debug_log(["Replaying blocks"]):
+            self.start_node(0)
+        assert_equal(node0.getbestblockhash(), best_hash)
+        assert_equal(node0.gettxoutsetinfo()['hash_serialized_2'], utxo_hash)
+
+        self.log.info("Complete the background write before disconnecting a block")
+        connect_nodes(node0, 1)
+        node0.generatetoaddress(5, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.sync_all()
+        self.wait_for_partial_write(node0)
+        full_flushes = node0.getcoinsflushinfo()['full_flushes']
+        tip = node0.getbestblockhash()
+        node0.invalidateblock(tip)
+        assert node0.getcoinsflushinfo()['full_flushes'] > full_flushes
+        assert_equal(node0.getblockcount(), 24)
+        self.kill_node(0)
+        self.start_node(0)
+        node0.reconsiderblock(tip)
+        assert_equal(node0.getbestblockhash(), tip)
+        assert_equal(node0.gettxoutsetinfo()['hash_serialized_2'], node1.gettxoutsetinfo()['hash_serialized_2'])
+
+
+if __name__ == '__main__':
+    CoinsFlushTest().main()
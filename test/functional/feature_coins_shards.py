@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the sharded layout of the coins database.
+
+- Check that node0, which splits its coins into shards, has the same UTXO set
+  and hash_serialized_2 as node1, which keeps a single database.
+- Convert the databases of both nodes at startup with -coinsdbshards and check
+  that the UTXO set and the shard directories follow.
+- Check that a database keeps its layout when -coinsdbshards is not set.
+"""
+import os
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+)
+
+
+class CoinsShardsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-coinsdbshards=4"], []]
+
+    def shard_dirs(self, node):
+        chainstate = os.path.join(node.datadir, self.chain, 'chainstate')
+        shards = [d for d in os.listdir(chainstate) if d.startswith('shards')]
+        if not shards:
+            return []
+        assert_equal(len(shards), 1)
+        return sorted(os.listdir(os.path.join(chainstate, shards[0])))
+
+    def check_utxo_set(self):
+        self.sync_all()
+        info = [node.gettxoutsetinfo() for node in self.nodes]
+        assert_equal(info[0]['hash_serialized_2'], info[1]['hash_serialized_2'])
+        assert_equal(info[0]['txouts'], info[1]['txouts'])
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        assert_equal(self.shard_dirs(node0), ['000', '001', '002', '003'])
+        assert_equal(self.shard_dirs(node1), [])
+
+        self.log.info("Keep the same UTXO set in shards")
+        node0.generatetoaddress(110, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.check_utxo_set()
+
+        self.log.info("Convert the databases at startup")
+        with node0.assert_debug_log(["Converting the coin database from 4 to 0 shards"]):
+            self.restart_node(0, ["-coinsdbshards=0"])
+        assert_equal(self.shard_dirs(node0), [])
+        with node1.assert_debug_log(["Converting the coin database from 0 to 3 shards"]):
+            self.restart_node(1, ["-coinsdbshards=3"])
+        assert_equal(self.shard_dirs(node1), ['000', '001', '002'])
+        connect_nodes(node0, 1)
+        self.check_utxo_set()
+
+        self.log.info("Keep the layout of an existing database")
+        self.restart_node(1, [])
+        assert_equal(self.shard_dirs(node1), ['000', '001', '002'])
+        connect_nodes(node0, 1)
+        node1.generatetoaddress(10, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.check_utxo_set()
+
+
+if __name__ == '__main__':
+    CoinsShardsTest().main()
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the UTXO set statistics index.
+
+- Check that the statistics of node0, read from its -coinstatsindex, match
+  those that node1 computes by scanning its UTXO set.
+- Query the statistics as of past blocks by height and by hash.
+- Check that the index follows the chain across a reorg and a restart.
+"""
+from test_framework.address import (
+    ADDRESS_BCRT1_P2WSH_OP_TRUE,
+    ADDRESS_BCRT1_UNSPENDABLE,
+)
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxInWitness,
+    CTxOut,
+    ToHex,
+)
+from test_framework.script import (
+    CScript,
+    OP_RETURN,
+    OP_TRUE,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    wait_until,
+)
+
+STATS_KEYS = ['height', 'bestblock', 'txouts', 'bogosize', 'muhash', 'total_amount']
+
+
+class CoinStatsIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-coinstatsindex"], []]
+
+    def index_stats(self, *args):
+        """Statistics of node0, once its index has caught up."""
+        def synced():
+            try:
+                self.stats = self.nodes[0].gettxoutsetinfo('muhash', *args)
+                return True
+            except Exception:
+                return False
+        wait_until(synced, timeout=30)
+        assert 'transactions' not in self.stats
+        assert 'disk_size' not in self.stats
+        return {key: self.stats[key] for key in STATS_KEYS}
+
+    def scan_stats(self):
+        """Statistics of node1, computed by scanning its UTXO set."""
+        stats = self.nodes[1].gettxoutsetinfo('muhash')
+        assert 'transactions' in stats
+        return {key: stats[key] for key in STATS_KEYS}
+
+    def spend_coinbase(self, height):
+        """Spend the coinbase output of a block, with an unspendable output."""
+        node = self.nodes[0]
+        script = bytes.fromhex(node.validateaddress(ADDRESS_BCRT1_P2WSH_OP_TRUE)['scriptPubKey'])
+        coinbase = node.getblock(node.getblockhash(height), 2)['tx'][0]
+        vout = [out['scriptPubKey']['hex'] for out in coinbase['vout']].index(script.hex())
+        value = int(coinbase['vout'][vout]['value'] * COIN)
+        tx = CTransaction()
+        tx.vin = [CTxIn(COutPoint(int(coinbase['txid'], 16), vout))]
+        tx.vout = [
+            CTxOut(value // 2, script),
+            CTxOut(value // 2 - 10000, script),
+            CTxOut(0, CScript([OP_RETURN, b'stats'])),
+        ]
+        tx.wit.vtxinwit = [CTxInWitness()]
+        tx.wit.vtxinwit[0].scriptWitness.stack = [CScript([OP_TRUE])]
+        return node.sendrawtransaction(ToHex(tx))
+
+    def run_test(self):
+        node0, node1 = self.nodes
+
+        self.log.info("Match the statistics of a scan of the UTXO set")
+        node0.generatetoaddress(110, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.sync_all()
+        assert_equal(self.index_stats(), self.scan_stats())
+        before_spend = self.index_stats()
+
+        for height in range(1, 4):
+            self.spend_coinbase(height)
+        node0.generatetoaddress(1, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.sync_all()
+        after_spend = self.index_stats()
+        assert_equal(after_spend, self.scan_stats())
+        assert_equal(after_spend['txouts'], before_spend['txouts'] + 1 + 3)
+
+        self.log.info("Query the statistics as of past blocks")
+        assert_equal(self.index_stats(110), before_spend)
+        assert_equal(self.index_stats(before_spend['bestblock']), before_spend)
+        assert_equal(self.index_stats(0)['txouts'], 0)
+        assert_raises_rpc_error(-8, "Target block height 112 after current tip 111", node0.gettxoutsetinfo, 'muhash', 112)
+        assert_raises_rpc_error(-8, "Querying specific block heights requires coinstatsindex", node1.gettxoutsetinfo, 'muhash', 110)
+        assert_raises_rpc_error(-8, "Querying specific block heights requires coinstatsindex", node0.gettxoutsetinfo, 'hash_serialized_2', 110)
+        assert_raises_rpc_error(-8, "foo is not a valid hash_type", node0.gettxoutsetinfo, 'foo')
+        assert 'hash_serialized_2' in node0.gettxoutsetinfo()
+        assert 'muhash' not in node0.gettxoutsetinfo('none')
+        assert_raises_rpc_error(-1, "Loading a UTXO snapshot is not supported with -txindex, -blockfilterindex or -coinstatsindex", node0.loadtxoutset, 'utxo.dat', '00' * 32)
+
+        self.log.info("Follow the chain across a reorg")
+        self.spend_coinbase(4)
+        blocks = node0.generatetoaddress(2, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        self.sync_all()
+        assert_equal(self.index_stats(), self.scan_stats())
+        node0.invalidateblock(blocks[0])
+        assert_equal(self.index_stats(), after_spend)
+        node0.reconsiderblock(blocks[0])
+        self.sync_all()
+        assert_equal(self.index_stats(), self.scan_stats())
+
+        self.log.info("Keep the statistics across a restart")
+        self.restart_node(0, ["-coinstatsindex"])
+        assert_equal(self.index_stats(), self.scan_stats())
+        assert_equal(self.index_stats(110), before_spend)
+
+        self.log.info("Catch up with a reorg that happened while the index was disabled")
+        self.restart_node(0, [])
+        node0.invalidateblock(blocks[0])
+        node0.generatetoaddress(3, ADDRESS_BCRT1_UNSPENDABLE)
+        self.restart_node(0, ["-coinstatsindex"])
+        connect_nodes(node0, 1)
+        self.sync_all()
+        assert_equal(self.index_stats(), self.scan_stats())
+        assert_equal(self.index_stats(111), after_spend)
+
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
@@ -112,11 +112,20 @@ class ConfArgsTest(BitcoinTestFramework):
             ])
         self.stop_node(0)
 
+    def test_script_check_threads(self):
+        self.log.info('Test that an explicit -par above the automatic limit starts every thread')
+        with self.nodes[0].assert_debug_log(expected_msgs=['Script verification uses 31 additional threads']):
+            self.start_node(0, extra_args=['-par=32', '-debug=bench'])
+        # Every thread registers with the script check queue, which logs one line per thread on shutdown
+        with self.nodes[0].assert_debug_log(expected_msgs=['Script check thread 31:'], unexpected_msgs=['Script check thread 32:']):
+            self.stop_node(0)
+
     def run_test(self):
         self.stop_node(0)
 
         self.test_log_buffer()
         self.test_args_log()
+        self.test_script_check_threads()
 
         self.test_config_file_parser()
 
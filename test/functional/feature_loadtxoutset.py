@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test loading a UTXO snapshot with loadtxoutset.
+
+- Dump the UTXO set of node0 and load it into node1, which only has the
+  headers, and check that node1 continues from the snapshot base at once.
+- Check that snapshots with a wrong hash or an unknown base are refused.
+- Check that the snapshot chainstate survives a restart.
+- Connect the nodes and check that node1 validates the blocks below the
+  snapshot base in the background, then replaces its chainstate with the
+  snapshot one on the next restart.
+"""
+import os
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    wait_until,
+)
+
+SNAPSHOT_BASE_HEIGHT = 150
+
+
+class LoadTxOutSetTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        # node1 must not download the blocks before the snapshot is loaded.
+        self.setup_nodes()
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        node0.generatetoaddress(SNAPSHOT_BASE_HEIGHT, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        dump = node0.dumptxoutset('utxo.dat')
+        base_hash = node0.getbestblockhash()
+        assert_equal(dump['base_hash'], base_hash)
+        assert_equal(dump['txoutset_hash'], node0.gettxoutsetinfo()['hash_serialized_2'])
+        node0.generatetoaddress(10, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+
+        self.log.info("Refuse a snapshot whose base header is unknown")
+        assert_raises_rpc_error(-1, "must be received first", node1.loadtxoutset, dump['path'], dump['txoutset_hash'])
+
+        for height in range(1, SNAPSHOT_BASE_HEIGHT + 1):
+            node1.submitheader(node0.getblockheader(node0.getblockhash(height), False))
+
+        self.log.info("Refuse a snapshot that does not match the expected hash")
+        assert_raises_rpc_error(-1, "Bad snapshot content hash", node1.loadtxoutset, dump['path'], "00" * 32)
+        assert_equal(node1.getblockcount(), 0)
+        assert 'snapshot' not in node1.getblockchaininfo()
+
+        self.log.info("Load the snapshot and continue from its base")
+        res = node1.loadtxoutset(dump['path'], dump['txoutset_hash'])
+        assert_equal(res['coins_loaded'], dump['coins_written'])
+        assert_equal(res['base_hash'], base_hash)
+        assert_equal(res['base_height'], SNAPSHOT_BASE_HEIGHT)
+        assert_equal(node1.getbestblockhash(), base_hash)
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], dump['txoutset_hash'])
+        snapshot = node1.getblockchaininfo()['snapshot']
+        assert_equal(snapshot['base_hash'], base_hash)
+        assert_equal(snapshot['base_height'], SNAPSHOT_BASE_HEIGHT)
+        assert_equal(snapshot['background_blocks'], 0)
+        assert_equal(snapshot['validated'], False)
+        assert_raises_rpc_error(-1, "Block not found on disk", node1.getblock, node0.getblockhash(1))
+        assert_raises_rpc_error(-1, "already in use", node1.loadtxoutset, dump['path'], dump['txoutset_hash'])
+
+        self.log.info("Keep the snapshot chainstate across a restart")
+        self.restart_node(1)
+        assert_equal(node1.getbestblockhash(), base_hash)
+        assert_equal(node1.getblockchaininfo()['snapshot']['validated'], False)
+
+        self.log.info("Sync the tip and validate the history in the background")
+        connect_nodes(node1, 0)
+        wait_until(lambda: node1.getbestblockhash() == node0.getbestblockhash())
+        wait_until(lambda: node1.getblockchaininfo()['snapshot']['validated'])
+        snapshot = node1.getblockchaininfo()['snapshot']
+        assert_equal(snapshot['background_blocks'], SNAPSHOT_BASE_HEIGHT)
+        assert_equal(snapshot['background_progress'], 1)
+        assert_equal(node1.getblock(node0.getblockhash(1))['height'], 1)
+
+        self.log.info("Replace the chainstate with the validated snapshot chainstate on restart")
+        with node1.assert_debug_log(["replacing the chainstate with the validated snapshot chainstate"]):
+            self.restart_node(1)
+        assert 'snapshot' not in node1.getblockchaininfo()
+        assert not os.path.exists(os.path.join(node1.datadir, self.chain, 'chainstate_snapshot'))
+        assert_equal(node1.getbestblockhash(), node0.getbestblockhash())
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], node0.gettxoutsetinfo()['hash_serialized_2'])
+
+
+if __name__ == '__main__':
+    LoadTxOutSetTest().main()
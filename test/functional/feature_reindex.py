@@ -7,7 +7,10 @@
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has reindexed up to block 3.
 - Stop the node and restart it with -reindex-chainstate. Verify that the node has reindexed up to block 3.
+- Swap two blocks in blk00000.dat and verify that -reindex still loads every block.
 """
+import os
+import struct
 
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import wait_until
@@ -27,11 +30,35 @@ class ReindexTest(BitcoinTestFramework):
         wait_until(lambda: self.nodes[0].getblockcount() == blockcount)
         self.log.info("Success")
 
+    def out_of_order(self):
+        node = self.nodes[0]
+        blockcount = node.getblockcount()
+        self.stop_nodes()
+        blk_path = os.path.join(node.datadir, self.chain, 'blocks', 'blk00000.dat')
+        with open(blk_path, 'rb') as f:
+            data = f.read()
+        # Split the file into its message start, size and block records.
+        records = []
+        pos = 0
+        while pos + 8 <= len(data) and data[pos:pos + 4] != b'\x00' * 4:
+            size = struct.unpack('<I', data[pos + 4:pos + 8])[0]
+            records.append(data[pos:pos + 8 + size])
+            pos += 8 + size
+        records[1], records[2] = records[2], records[1]
+        with open(blk_path, 'wb') as f:
+            f.write(b''.join(records) + data[pos:])
+
+        with node.assert_debug_log(["Reindex: found {} blocks in 1 block files".format(blockcount + 1), "MB/s"]):
+            self.start_nodes([["-reindex"]])
+            wait_until(lambda: node.getblockcount() == blockcount)
+        self.log.info("Success")
+
     def run_test(self):
         self.reindex(False)
         self.reindex(True)
         self.reindex(False)
         self.reindex(True)
+        self.out_of_order()
 
 if __name__ == '__main__':
     ReindexTest().main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -persistsigcache.
+
+- Put a transaction in the mempool of a node running with -persistsigcache
+  and check that its cached script result is dumped on shutdown and
+  imported on restart.
+- Mine the transaction and check that the spent cache entry is no longer
+  persisted.
+- Check that a file which does not authenticate with sigcache.key, or has
+  another version, is not imported, and that a node which could not salt
+  its caches does not overwrite the file.
+- Check that a node without -persistsigcache neither dumps nor loads.
+"""
+from decimal import Decimal
+import hashlib
+import hmac
+import os
+import struct
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.messages import (
+    CTransaction,
+    CTxInWitness,
+    FromHex,
+)
+from test_framework.script import (
+    CScript,
+    OP_TRUE,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+
+class SigCachePersistTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-persistsigcache"]]
+
+    def run_test(self):
+        node = self.nodes[0]
+        sigcache_path = os.path.join(node.datadir, self.chain, "sigcache.dat")
+        key_path = os.path.join(node.datadir, self.chain, "sigcache.key")
+
+        block = node.getblock(node.generatetoaddress(101, ADDRESS_BCRT1_P2WSH_OP_TRUE)[0])
+        value = node.gettxout(block['tx'][0], 0)['value'] - Decimal('0.001')
+        tx = FromHex(
+            CTransaction(),
+            node.createrawtransaction(
+                inputs=[{
+                    'txid': block['tx'][0],
+                    'vout': 0,
+                }], outputs=[{
+                    ADDRESS_BCRT1_P2WSH_OP_TRUE: value,
+                }]),
+        )
+        tx.wit.vtxinwit = [CTxInWitness()]
+        tx.wit.vtxinwit[0].scriptWitness.stack = [CScript([OP_TRUE])]
+        txid = node.sendrawtransaction(tx.serialize().hex())
+
+        self.log.info("Dump the cached script result of the mempool transaction on shutdown")
+        with node.assert_debug_log(["Dumped signature cache: 0 signature entries, 1 script execution entries"]):
+            self.stop_node(0)
+        assert os.path.isfile(sigcache_path)
+        assert os.path.isfile(key_path)
+
+        self.log.info("Import it on restart, before the mempool is loaded")
+        with node.assert_debug_log(["Imported signature cache from disk: 0 signature entries, 1 script execution entries"]):
+            self.start_node(0)
+        wait_until(lambda: node.getmempoolinfo()['loaded'])
+        assert_equal(node.getrawmempool(), [txid])
+
+        self.log.info("Entries used up by a block are not persisted")
+        node.generatetoaddress(1, ADDRESS_BCRT1_P2WSH_OP_TRUE)
+        assert_equal(node.getrawmempool(), [])
+        with node.assert_debug_log(["Dumped signature cache: 0 signature entries, 0 script execution entries"]):
+            self.stop_node(0)
+
+        self.log.info("A file that fails the integrity check is not imported")
+        with open(sigcache_path, 'rb') as f:
+            good = f.read()
+        with open(sigcache_path, 'wb') as f:
+            f.write(bytes([good[0] ^ 1]) + good[1:])
+        with node.assert_debug_log(["Signature cache file on disk failed its integrity check"], unexpected_msgs=["Imported signature cache"]):
+            self.start_node(0)
+        self.stop_node(0)
+
+        self.log.info("A file of another version is not imported")
+        with open(key_path, 'rb') as f:
+            mac_key = hmac.new(f.read(), b"sigcache.dat authentication", hashlib.sha256).digest()
+        data = struct.pack("<Q", 2) + good[8:-32]
+        with open(sigcache_path, 'wb') as f:
+            f.write(data + hmac.new(mac_key, data, hashlib.sha256).digest())
+        with node.assert_debug_log(["Signature cache file on disk has version 2, expected 1"], unexpected_msgs=["Imported signature cache"]):
+            self.start_node(0)
+        self.stop_node(0)
+
+        self.log.info("A node that could not read its key leaves the file alone")
+        with open(sigcache_path, 'rb') as f:
+            good = f.read()
+        with open(key_path, 'rb') as f:
+            key = f.read()
+        with open(key_path, 'wb') as f:
+            f.write(key[:16])
+        with node.assert_debug_log(["Failed to read the signature cache key"], unexpected_msgs=["Imported signature cache"]):
+            self.start_node(0)
+        with node.assert_debug_log([], unexpected_msgs=["Dumped signature cache"]):
+            self.stop_node(0)
+        with open(sigcache_path, 'rb') as f:
+            assert_equal(f.read(), good)
+        with open(key_path, 'wb') as f:
+            f.write(key)
+        with node.assert_debug_log(["Imported signature cache from disk: 0 signature entries, 0 script execution entries"]):
+            self.start_node(0)
+        self.stop_node(0)
+
+        self.log.info("Without -persistsigcache the snapshot is ignored")
+        os.remove(sigcache_path)
+        with node.assert_debug_log([], unexpected_msgs=["Imported signature cache", "Failed to open signature cache"]):
+            self.start_node(0, extra_args=["-persistsigcache=0"])
+        self.stop_node(0)
+        assert not os.path.exists(sigcache_path)
+
+
+if __name__ == '__main__':
+    SigCachePersistTest().main()
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that a large block is dropped as soon as its coinbase is found invalid.
+
+A block message larger than a single socket read is checked once its header
+and coinbase have arrived. A block whose coinbase fails those checks gets its
+peer disconnected before the rest of the message is processed, while a
+valid large block is still accepted.
+"""
+from test_framework.blocktools import add_witness_commitment, create_block, create_coinbase, create_tx_with_script
+from test_framework.messages import CTxOut, msg_block
+from test_framework.mininode import P2PDataStore
+from test_framework.script import CScript, OP_RETURN
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+# Large enough to be received over several socket reads.
+FILLER_SIZE = 500000
+
+
+class EarlyBlockRejectTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def large_block(self, coinbase_utxo):
+        node = self.nodes[0]
+        best_block = node.getblock(node.getbestblockhash())
+        block = create_block(int(best_block['hash'], 16), create_coinbase(best_block['height'] + 1), best_block['time'] + 1)
+        tx = create_tx_with_script(coinbase_utxo, 0, script_sig=b'\x51', amount=coinbase_utxo.vout[0].nValue)
+        tx.vout.append(CTxOut(0, CScript([OP_RETURN, b'\x00' * FILLER_SIZE])))
+        tx.rehash()
+        block.vtx.append(tx)
+        add_witness_commitment(block)
+        return block
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.add_p2p_connection(P2PDataStore())
+
+        best_block = node.getblock(node.getbestblockhash())
+        block1 = create_block(int(best_block['hash'], 16), create_coinbase(1), best_block['time'] + 1)
+        block1.solve()
+        node.p2p.send_blocks_and_test([block1], node, success=True)
+        node.generatetoaddress(100, node.get_deterministic_priv_key().address)
+
+        self.log.info("Drop a large block whose coinbase lacks the witness reserved value")
+        block = self.large_block(block1.vtx[0])
+        block.vtx[0].wit.vtxinwit = []
+        block.vtx[0].rehash()
+        block.hashMerkleRoot = block.calc_merkle_root()
+        block.solve()
+        with node.assert_debug_log(["received invalid start of block {}".format(block.hash), "bad-witness-nonce-size"]):
+            node.p2p.send_message(msg_block(block))
+            node.p2p.wait_for_disconnect()
+        assert block.hash not in [tip['hash'] for tip in node.getchaintips()]
+
+        self.log.info("Accept a valid large block")
+        node.disconnect_p2ps()
+        node.add_p2p_connection(P2PDataStore())
+        block = self.large_block(block1.vtx[0])
+        block.solve()
+        node.p2p.send_blocks_and_test([block], node, success=True)
+        assert_equal(node.getbestblockhash(), block.hash)
+
+
+if __name__ == '__main__':
+    EarlyBlockRejectTest().main()
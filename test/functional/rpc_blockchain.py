@@ -13,6 +13,7 @@ Test the following RPCs:
     - getblockheader
     - getchaintxstats
     - getnetworkhashps
+    - getissuedsupply
     - verifychain
 
 Tests correspond to code in rpc/blockchain.cpp.
@@ -61,6 +62,7 @@ class BlockchainTest(BitcoinTestFramework):
         self._test_getblockheader()
         self._test_getdifficulty()
         self._test_getnetworkhashps()
+        self._test_getissuedsupply()
         self._test_stopatheight()
         self._test_waitforblockheight()
         assert self.nodes[0].verifychain(4, 0)
@@ -280,6 +282,16 @@ class BlockchainTest(BitcoinTestFramework):
         # This should be 2 hashes every 10 minutes or 1/300
         assert abs(hashes_per_second * 300 - 1) < 0.0001
 
+    def _test_getissuedsupply(self):
+        self.log.info("Test getissuedsupply")
+        node = self.nodes[0]
+        assert_equal(node.getissuedsupply(), {'height': 200, 'supply': Decimal('100500'), 'blockreward': Decimal('500')})
+        assert_equal(node.getissuedsupply(0)['supply'], Decimal('500'))
+        # The first reward reduction takes effect at height 4200.
+        assert_equal(node.getissuedsupply(4200), {'height': 4200, 'supply': Decimal('2100075'), 'blockreward': Decimal('75')})
+        assert_equal(node.getissuedsupply(10000000)['supply'], Decimal('21000000'))
+        assert_raises_rpc_error(-8, "Block height out of range", node.getissuedsupply, -1)
+
     def _test_stopatheight(self):
         assert_equal(self.nodes[0].getblockcount(), 200)
         self.nodes[0].generatetoaddress(6, self.nodes[0].get_deterministic_priv_key().address)
@@ -70,6 +70,8 @@ EXTENDED_SCRIPTS = [
     # Longest test should go first, to favor running tests in parallel
     'feature_pruning.py',
     'feature_dbcrash.py',
+    'feature_coins_flush.py',
+    'feature_coins_shards.py',
 ]
 
 BASE_SCRIPTS = [
@@ -124,6 +126,9 @@ BASE_SCRIPTS = [
     'wallet_avoidreuse.py',
     'mempool_reorg.py',
     'mempool_persist.py',
+    'feature_sigcache_persist.py',
+    'feature_loadtxoutset.py',
+    'feature_coinstatsindex.py',
     'wallet_multiwallet.py',
     'wallet_multiwallet.py --usecli',
     'wallet_createwallet.py',
@@ -155,6 +160,7 @@ BASE_SCRIPTS = [
     'mining_prioritisetransaction.py',
     'p2p_invalid_locator.py',
     'p2p_invalid_block.py',
+    'p2p_early_block_reject.py',
     'p2p_invalid_messages.py',
     'p2p_invalid_tx.py',
     'feature_assumevalid.py',